@@ -0,0 +1,76 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#include "banded_depth.h"
+#include <stdexcept>
+
+namespace liquibook { namespace book {
+
+BandedDepth::BandedDepth(Price band_width)
+: band_width_(band_width),
+  last_change_(0),
+  last_published_change_(0),
+  has_empty_bands_(false)
+{
+  if (!band_width_) {
+    throw std::runtime_error("BandedDepth band width must be positive");
+  }
+}
+
+Price
+BandedDepth::basis_point_band_width(Price reference_price, 
+                                    uint32_t basis_points)
+{
+  Price width = Price((uint64_t(reference_price) * basis_points) / 10000);
+  return width ? width : 1;
+}
+
+Price
+BandedDepth::band_width() const
+{
+  return band_width_;
+}
+
+const BidLevelMap&
+BandedDepth::bids() const
+{
+  return bid_bands_;
+}
+
+const AskLevelMap&
+BandedDepth::asks() const
+{
+  return ask_bands_;
+}
+
+bool
+BandedDepth::changed() const
+{
+  return last_change_ > last_published_change_;
+}
+
+ChangeId
+BandedDepth::last_change() const
+{
+  return last_change_;
+}
+
+ChangeId
+BandedDepth::last_published_change() const
+{
+  return last_published_change_;
+}
+
+void
+BandedDepth::published()
+{
+  last_published_change_ = last_change_;
+  // Removals are now published, forget the empty bands
+  if (has_empty_bands_) {
+    erase_empty_bands(bid_bands_);
+    erase_empty_bands(ask_bands_);
+    has_empty_bands_ = false;
+  }
+}
+
+} }
@@ -0,0 +1,145 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef banded_depth_h
+#define banded_depth_h
+
+#include "depth.h"
+#include "depth_level.h"
+#include "types.h"
+
+namespace liquibook { namespace book {
+
+/// @brief container of limit order data aggregated into price bands of a
+///    fixed width, across the whole book.  Maintained incrementally from the
+///    level changes reported by OrderBook::on_level_change().  Each band is
+///    a DepthLevel whose price is the lowest price in the band.  A band 
+///    emptied since the last publish remains, with an order count of zero, 
+///    until published() so the removal can be published.
+class BandedDepth {
+public:
+  /// @brief construct
+  /// @param band_width the width of each band, in price units
+  explicit BandedDepth(Price band_width);
+
+  /// @brief calculate a band width in basis points of a reference price
+  /// @param reference_price the price the bands are relative to
+  /// @param basis_points the width of each band in basis points
+  /// @return the band width, at least one price unit
+  static Price basis_point_band_width(Price reference_price, 
+                                      uint32_t basis_points);
+
+  /// @brief get the width of each band
+  Price band_width() const;
+
+  /// @brief get the band containing a price
+  /// @param price the price
+  /// @return the lowest price in the band
+  Price band_price(Price price) const;
+
+  /// @brief get the bid bands, best first
+  const BidLevelMap& bids() const;
+
+  /// @brief get the ask bands, best first
+  const AskLevelMap& asks() const;
+
+  /// @brief apply a change to a price level
+  /// @param price the price of the level
+  /// @param count_delta the change in the level's order count
+  /// @param qty_delta the change in the level's aggregate quantity
+  /// @param is_bid indicator of bid or ask
+  void change_level(Price price, 
+                    int32_t count_delta, 
+                    int32_t qty_delta, 
+                    bool is_bid);
+
+  /// @brief has the banded depth changed since the last publish
+  bool changed() const;
+
+  /// @brief what was the last change?
+  ChangeId last_change() const;
+
+  /// @brief what was the last published change?
+  ChangeId last_published_change() const;
+
+  /// @brief note the id of last published change, and remove empty bands
+  void published();
+
+private:
+  Price band_width_;
+  BidLevelMap bid_bands_;
+  AskLevelMap ask_bands_;
+  ChangeId last_change_;
+  ChangeId last_published_change_;
+  bool has_empty_bands_;
+
+  template <class BandMap>
+  void change_band(BandMap& bands, 
+                   Price band, 
+                   int32_t count_delta, 
+                   int32_t qty_delta);
+
+  template <class BandMap>
+  void erase_empty_bands(BandMap& bands);
+};
+
+inline void
+BandedDepth::change_level(
+  Price price, 
+  int32_t count_delta, 
+  int32_t qty_delta, 
+  bool is_bid)
+{
+  if (is_bid) {
+    change_band(bid_bands_, band_price(price), count_delta, qty_delta);
+  } else {
+    change_band(ask_bands_, band_price(price), count_delta, qty_delta);
+  }
+}
+
+inline Price
+BandedDepth::band_price(Price price) const
+{
+  return price - (price % band_width_);
+}
+
+template <class BandMap>
+inline void
+BandedDepth::change_band(
+  BandMap& bands, 
+  Price band, 
+  int32_t count_delta, 
+  int32_t qty_delta)
+{
+  typename BandMap::iterator level = bands.lower_bound(band);
+  // If there is no band at this price, insert one
+  if (level == bands.end() || level->first != band) {
+    level = bands.insert(level, std::make_pair(band, DepthLevel()));
+    level->second.init(band, false);
+  }
+  uint32_t order_count = level->second.order_count() + count_delta;
+  level->second.set(order_count, 
+                    level->second.aggregate_qty() + qty_delta);
+  level->second.last_change(++last_change_);
+  if (!order_count) {
+    has_empty_bands_ = true;
+  }
+}
+
+template <class BandMap>
+void
+BandedDepth::erase_empty_bands(BandMap& bands)
+{
+  typename BandMap::iterator band = bands.begin();
+  while (band != bands.end()) {
+    if (band->second.order_count()) {
+      ++band;
+    } else {
+      bands.erase(band++);
+    }
+  }
+}
+
+} }
+
+#endif
@@ -0,0 +1,248 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef book_manager_h
+#define book_manager_h
+
+#include "order_book.h"
+#include "types.h"
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace liquibook { namespace book {
+
+/// @brief owner of the order books of many securities.  Each symbol is given
+///        a dense integer id when its book is added, so orders are routed to
+///        their book by index rather than by symbol lookup.  Callbacks are
+///        performed only for the books with work since the last time.
+template <class OrderPtr = Order*, class TypedOrderBook = OrderBook<OrderPtr> >
+class BookManager {
+public:
+  typedef TypedOrderBook Book;
+
+  /// @brief construct
+  BookManager();
+
+  /// @brief destroy, and every book
+  ~BookManager();
+
+  /// @brief add a book for a symbol
+  /// @param symbol the symbol of the security, which must be new
+  /// @return the id of the symbol, one more than that of the last added
+  SymbolId add_book(const std::string& symbol);
+
+  /// @brief find the id of a symbol.  Not for use on the hot path - look up
+  ///        ids once and route by id.
+  /// @param symbol the symbol to find
+  /// @param symbol_id the id of the symbol (out)
+  /// @return true if the symbol was found
+  bool find_symbol(const std::string& symbol, SymbolId& symbol_id) const;
+
+  /// @brief get the symbol of an id
+  const std::string& symbol(SymbolId symbol_id) const;
+
+  /// @brief get the number of books
+  size_t size() const;
+
+  /// @brief access the book of a symbol
+  TypedOrderBook& book(SymbolId symbol_id);
+
+  /// @brief access the book of a symbol
+  const TypedOrderBook& book(SymbolId symbol_id) const;
+
+  /// @brief add an order to the book of a symbol
+  /// @param symbol_id the id of the symbol
+  /// @param order the order to add
+  /// @param conditions special conditions on the order
+  /// @return true if the add resulted in a fill
+  bool add(SymbolId symbol_id,
+           const OrderPtr& order,
+           OrderConditions conditions = 0);
+#ifdef LIQUIBOOK_HAS_MOVE
+  /// @brief add an order to the book of a symbol, taking the order pointer
+  bool add(SymbolId symbol_id,
+           OrderPtr&& order,
+           OrderConditions conditions = 0);
+#endif
+
+  /// @brief cancel an order in the book of a symbol
+  /// @param symbol_id the id of the symbol
+  /// @param order the order to cancel
+  void cancel(SymbolId symbol_id, const OrderPtr& order);
+
+  /// @brief replace an order in the book of a symbol
+  /// @param symbol_id the id of the symbol
+  /// @param order the order to replace
+  /// @param size_delta the change in size for the order (positive or negative)
+  /// @param new_price the new order price, or PRICE_UNCHANGED
+  /// @return true if the replace resulted in a fill
+  bool replace(SymbolId symbol_id,
+               const OrderPtr& order,
+               int32_t size_delta = SIZE_UNCHANGED,
+               Price new_price = PRICE_UNCHANGED);
+
+  /// @brief perform the callbacks of every book changed since last called,
+  ///        in the order the books were first changed
+  void perform_callbacks();
+
+private:
+  // Not copyable
+  BookManager(const BookManager&);
+  BookManager& operator=(const BookManager&);
+
+  /// @brief get a book to route to, noting it has callbacks to perform
+  TypedOrderBook& route(SymbolId symbol_id);
+
+  typedef std::vector<TypedOrderBook*> Books;
+  typedef std::map<std::string, SymbolId> SymbolIds;
+  Books books_;                        // indexed by symbol id
+  std::vector<std::string> symbols_;   // indexed by symbol id
+  std::vector<bool> pending_;          // indexed by symbol id
+  std::vector<SymbolId> pending_ids_;  // books with callbacks to perform
+  SymbolIds symbol_ids_;
+};
+
+template <class OrderPtr, class TypedOrderBook>
+BookManager<OrderPtr, TypedOrderBook>::BookManager()
+{
+}
+
+template <class OrderPtr, class TypedOrderBook>
+BookManager<OrderPtr, TypedOrderBook>::~BookManager()
+{
+  typename Books::iterator book;
+  for (book = books_.begin(); book != books_.end(); ++book) {
+    delete *book;
+  }
+}
+
+template <class OrderPtr, class TypedOrderBook>
+SymbolId
+BookManager<OrderPtr, TypedOrderBook>::add_book(const std::string& symbol)
+{
+  SymbolId symbol_id = SymbolId(books_.size());
+  if (!symbol_ids_.insert(std::make_pair(symbol, symbol_id)).second) {
+    throw std::runtime_error("BookManager symbol already has a book");
+  }
+  books_.push_back(new TypedOrderBook());
+  symbols_.push_back(symbol);
+  pending_.push_back(false);
+  return symbol_id;
+}
+
+template <class OrderPtr, class TypedOrderBook>
+bool
+BookManager<OrderPtr, TypedOrderBook>::find_symbol(
+  const std::string& symbol,
+  SymbolId& symbol_id) const
+{
+  typename SymbolIds::const_iterator found = symbol_ids_.find(symbol);
+  if (found != symbol_ids_.end()) {
+    symbol_id = found->second;
+    return true;
+  }
+  return false;
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline const std::string&
+BookManager<OrderPtr, TypedOrderBook>::symbol(SymbolId symbol_id) const
+{
+  return symbols_[symbol_id];
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline size_t
+BookManager<OrderPtr, TypedOrderBook>::size() const
+{
+  return books_.size();
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline TypedOrderBook&
+BookManager<OrderPtr, TypedOrderBook>::book(SymbolId symbol_id)
+{
+  return *books_[symbol_id];
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline const TypedOrderBook&
+BookManager<OrderPtr, TypedOrderBook>::book(SymbolId symbol_id) const
+{
+  return *books_[symbol_id];
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline bool
+BookManager<OrderPtr, TypedOrderBook>::add(
+  SymbolId symbol_id,
+  const OrderPtr& order,
+  OrderConditions conditions)
+{
+  return route(symbol_id).add(order, conditions);
+}
+
+#ifdef LIQUIBOOK_HAS_MOVE
+template <class OrderPtr, class TypedOrderBook>
+inline bool
+BookManager<OrderPtr, TypedOrderBook>::add(
+  SymbolId symbol_id,
+  OrderPtr&& order,
+  OrderConditions conditions)
+{
+  return route(symbol_id).add(std::move(order), conditions);
+}
+#endif
+
+template <class OrderPtr, class TypedOrderBook>
+inline void
+BookManager<OrderPtr, TypedOrderBook>::cancel(
+  SymbolId symbol_id,
+  const OrderPtr& order)
+{
+  route(symbol_id).cancel(order);
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline bool
+BookManager<OrderPtr, TypedOrderBook>::replace(
+  SymbolId symbol_id,
+  const OrderPtr& order,
+  int32_t size_delta,
+  Price new_price)
+{
+  return route(symbol_id).replace(order, size_delta, new_price);
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline void
+BookManager<OrderPtr, TypedOrderBook>::perform_callbacks()
+{
+  std::vector<SymbolId>::iterator symbol_id;
+  for (symbol_id = pending_ids_.begin(); symbol_id != pending_ids_.end();
+       ++symbol_id) {
+    pending_[*symbol_id] = false;
+    books_[*symbol_id]->perform_callbacks();
+  }
+  pending_ids_.clear();
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline TypedOrderBook&
+BookManager<OrderPtr, TypedOrderBook>::route(SymbolId symbol_id)
+{
+  if (symbol_id >= books_.size()) {
+    throw std::runtime_error("BookManager symbol id not known");
+  }
+  if (!pending_[symbol_id]) {
+    pending_[symbol_id] = true;
+    pending_ids_.push_back(symbol_id);
+  }
+  return *books_[symbol_id];
+}
+
+} }
+
+#endif
@@ -61,6 +61,11 @@ public:
   /// @brief create a new accept callback
   static Callback<OrderPtr> accept(const OrderPtr& order,
                                    const TransId& trans_id);
+#ifdef LIQUIBOOK_HAS_MOVE
+  /// @brief create a new accept callback, taking the order pointer
+  static Callback<OrderPtr> accept(OrderPtr&& order,
+                                   const TransId& trans_id);
+#endif
   /// @brief create a new reject callback
   static Callback<OrderPtr> reject(const OrderPtr& order,
                                    const char* reason,
@@ -71,9 +76,23 @@ public:
                                  const Quantity& qty,
                                  const Price& price,
                                  const TransId& trans_id);
+#ifdef LIQUIBOOK_HAS_MOVE
+  /// @brief create a new fill callback, taking the matched order pointer,
+  ///        as when the matched order is filled and leaves the book
+  static Callback<OrderPtr> fill(const OrderPtr& inbound_order,
+                                 OrderPtr&& matched_order,
+                                 const Quantity& qty,
+                                 const Price& price,
+                                 const TransId& trans_id);
+#endif
   /// @brief create a new cancel callback
   static Callback<OrderPtr> cancel(const OrderPtr& order,
                                    const TransId& trans_id);
+#ifdef LIQUIBOOK_HAS_MOVE
+  /// @brief create a new cancel callback, taking the order pointer
+  static Callback<OrderPtr> cancel(OrderPtr&& order,
+                                   const TransId& trans_id);
+#endif
   /// @brief create a new cancel reject callback
   static Callback<OrderPtr> cancel_reject(const OrderPtr& order,
                                           const char* reason,
@@ -129,6 +148,20 @@ Callback<OrderPtr> Callback<OrderPtr>::accept(
   return result;
 }
 
+#ifdef LIQUIBOOK_HAS_MOVE
+template <class OrderPtr>
+Callback<OrderPtr> Callback<OrderPtr>::accept(
+  OrderPtr&& order,
+  const TransId& trans_id)
+{
+  Callback<OrderPtr> result;
+  result.type = cb_order_accept;
+  result.order = std::move(order);
+  result.trans_id = trans_id;
+  return result;
+}
+#endif
+
 template <class OrderPtr>
 Callback<OrderPtr> Callback<OrderPtr>::reject(
   const OrderPtr& order,
@@ -161,6 +194,26 @@ Callback<OrderPtr> Callback<OrderPtr>::fill(
   return result;
 }
 
+#ifdef LIQUIBOOK_HAS_MOVE
+template <class OrderPtr>
+Callback<OrderPtr> Callback<OrderPtr>::fill(
+  const OrderPtr& inbound_order,
+  OrderPtr&& matched_order,
+  const Quantity& qty,
+  const Price& price,
+  const TransId& trans_id)
+{
+  Callback<OrderPtr> result;
+  result.type = cb_order_fill;
+  result.order = inbound_order;
+  result.matched_order = std::move(matched_order);
+  result.fill_qty = qty;
+  result.fill_price = price;
+  result.trans_id = trans_id;
+  return result;
+}
+#endif
+
 template <class OrderPtr>
 Callback<OrderPtr> Callback<OrderPtr>::cancel(
   const OrderPtr& order,
@@ -173,6 +226,20 @@ Callback<OrderPtr> Callback<OrderPtr>::cancel(
   return result;
 }
 
+#ifdef LIQUIBOOK_HAS_MOVE
+template <class OrderPtr>
+Callback<OrderPtr> Callback<OrderPtr>::cancel(
+  OrderPtr&& order,
+  const TransId& trans_id)
+{
+  Callback<OrderPtr> result;
+  result.type = cb_order_cancel;
+  result.order = std::move(order);
+  result.trans_id = trans_id;
+  return result;
+}
+#endif
+
 template <class OrderPtr>
 Callback<OrderPtr> Callback<OrderPtr>::cancel_reject(
   const OrderPtr& order,
@@ -0,0 +1,223 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef conflating_depth_publisher_h
+#define conflating_depth_publisher_h
+
+#include "depth.h"
+#include "depth_delta_encoder.h"
+#include "depth_subscriber.h"
+#include "types.h"
+#include <stdexcept>
+#include <string.h>
+
+namespace liquibook { namespace book {
+
+/// @brief publisher of a Depth to slow consumers, conflating its changes.
+///        An update is due once an interval has passed since the last, or
+///        a number of transactions have been applied since, whichever is
+///        first.  The update holds only the net change: levels changed
+///        since the last update, but since changed back, are left out.
+///        Updates are encoded as by DepthDeltaEncoder.  Time is given by
+///        the caller, in any unit, so the publisher reads no clock.
+template <int SIZE=5>
+class ConflatingDepthPublisher {
+#if __cplusplus >= 201103L
+  static_assert(SIZE <= 256, "level_index holds at most 256 levels");
+#else
+  typedef char level_index_fits[SIZE <= 256 ? 1 : -1];
+#endif
+public:
+  /// @brief size of an update in which every level has changed
+  static const size_t MAX_ENCODED_SIZE =
+      DepthDeltaEncoder<SIZE>::MAX_ENCODED_SIZE;
+
+  /// @brief construct a publisher which has published nothing
+  /// @param depth the depth to publish, which must outlive the publisher
+  /// @param interval the time between updates, or 0 for no limit
+  /// @param max_transactions the transactions between updates, or 0 for
+  ///        no limit.  Not 0 if the interval is 0.
+  ConflatingDepthPublisher(const Depth<SIZE>& depth,
+                           uint64_t interval,
+                           TransId max_transactions);
+
+  /// @brief is an update due
+  /// @param now the current time
+  /// @param trans_id the ID of the last transaction applied to the depth
+  bool due(uint64_t now, TransId trans_id) const;
+
+  /// @brief encode an update if due
+  /// @param now the current time
+  /// @param trans_id the ID of the last transaction applied to the depth
+  /// @param buffer the buffer to encode into
+  /// @param buffer_size the size of the buffer, at least MAX_ENCODED_SIZE
+  /// @return the number of bytes encoded, or 0 if not due or there is no
+  ///         net change
+  size_t publish(uint64_t now,
+                 TransId trans_id,
+                 char* buffer,
+                 size_t buffer_size);
+
+  /// @brief encode an update of any net change, due or not, as when the
+  ///        depth has become quiet
+  /// @param now the current time
+  /// @param trans_id the ID of the last transaction applied to the depth
+  /// @param buffer the buffer to encode into
+  /// @param buffer_size the size of the buffer, at least MAX_ENCODED_SIZE
+  /// @return the number of bytes encoded, or 0 if there is no net change
+  size_t flush(uint64_t now,
+               TransId trans_id,
+               char* buffer,
+               size_t buffer_size);
+
+  /// @brief get the number of updates encoded
+  uint32_t updates() const;
+
+private:
+  DepthSubscriber<SIZE> subscriber_;
+  DepthLevel published_[SIZE * 2];  // as last published, bids then asks
+  uint64_t interval_;
+  TransId max_transactions_;
+  uint64_t last_time_;
+  TransId last_trans_id_;
+  uint32_t updates_;
+
+  /// @brief encode the levels of one side differing from those published
+  /// @param level the first level of the side
+  /// @param published the first level of the side as published
+  /// @param side the side being encoded
+  /// @param out where to encode the next delta (in/out)
+  /// @return the number of deltas encoded
+  uint16_t encode_side(const DepthLevel* level,
+                       DepthLevel* published,
+                       uint8_t side,
+                       char*& out);
+};
+
+template <int SIZE>
+const size_t ConflatingDepthPublisher<SIZE>::MAX_ENCODED_SIZE;
+
+template <int SIZE>
+ConflatingDepthPublisher<SIZE>::ConflatingDepthPublisher(
+  const Depth<SIZE>& depth,
+  uint64_t interval,
+  TransId max_transactions)
+: subscriber_(depth),
+  interval_(interval),
+  max_transactions_(max_transactions),
+  last_time_(0),
+  last_trans_id_(0),
+  updates_(0)
+{
+  if (!interval && !max_transactions) {
+    throw std::runtime_error("ConflatingDepthPublisher has no limit");
+  }
+  // As a depth when constructed, so the first update holds every level set
+  for (int index = 0; index < SIZE * 2; ++index) {
+    published_[index].init(0, false);
+    published_[index].last_change(0);
+  }
+}
+
+template <int SIZE>
+inline bool
+ConflatingDepthPublisher<SIZE>::due(uint64_t now, TransId trans_id) const
+{
+  if (!subscriber_.changed()) {
+    return false;
+  }
+  return (interval_ && now - last_time_ >= interval_) ||
+         (max_transactions_ && trans_id - last_trans_id_ >= max_transactions_);
+}
+
+template <int SIZE>
+inline size_t
+ConflatingDepthPublisher<SIZE>::publish(
+  uint64_t now,
+  TransId trans_id,
+  char* buffer,
+  size_t buffer_size)
+{
+  if (!due(now, trans_id)) {
+    return 0;
+  }
+  return flush(now, trans_id, buffer, buffer_size);
+}
+
+template <int SIZE>
+inline size_t
+ConflatingDepthPublisher<SIZE>::flush(
+  uint64_t now,
+  TransId trans_id,
+  char* buffer,
+  size_t buffer_size)
+{
+  if (buffer_size < MAX_ENCODED_SIZE) {
+    throw std::runtime_error("ConflatingDepthPublisher buffer too small");
+  }
+  if (!subscriber_.changed()) {
+    return 0;
+  }
+  const Depth<SIZE>& depth = subscriber_.depth();
+  char* out = buffer + sizeof(DepthDeltaHeader);
+  DepthDeltaHeader header;
+  header.change_id = depth.last_change();
+  header.delta_count =
+      encode_side(depth.bids(), published_, DepthDelta::side_bid, out) +
+      encode_side(depth.asks(), published_ + SIZE, DepthDelta::side_ask,
+                  out);
+  subscriber_.seen();
+  last_time_ = now;
+  last_trans_id_ = trans_id;
+  // The changes may have cancelled out
+  if (!header.delta_count) {
+    return 0;
+  }
+  memcpy(buffer, &header, sizeof(DepthDeltaHeader));
+  ++updates_;
+  return out - buffer;
+}
+
+template <int SIZE>
+inline uint32_t
+ConflatingDepthPublisher<SIZE>::updates() const
+{
+  return updates_;
+}
+
+template <int SIZE>
+inline uint16_t
+ConflatingDepthPublisher<SIZE>::encode_side(
+  const DepthLevel* level,
+  DepthLevel* published,
+  uint8_t side,
+  char*& out)
+{
+  uint16_t count = 0;
+  DepthDelta delta;
+  delta.side = side;
+  for (int index = 0; index < SIZE; ++index, ++level, ++published) {
+    // Only levels changed since seen can differ from those published
+    if (!subscriber_.changed(level)) {
+      continue;
+    }
+    if (level->price() == published->price() &&
+        level->order_count() == published->order_count() &&
+        level->aggregate_qty() == published->aggregate_qty()) {
+      continue;
+    }
+    *published = *level;
+    delta.level_index = uint8_t(index);
+    delta.price = level->price();
+    delta.aggregate_qty = level->aggregate_qty();
+    delta.order_count = level->order_count();
+    memcpy(out, &delta, sizeof(DepthDelta));
+    out += sizeof(DepthDelta);
+    ++count;
+  }
+  return count;
+}
+
+} }
+
+#endif
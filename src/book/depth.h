@@ -5,16 +5,24 @@
 #define depth_h
 
 #include "depth_level.h"
+#include "level_search.h"
 #include "types.h"
 #include <map>
 #include <cmath>
+#include <stdexcept>
 #include <string.h>
 
 namespace liquibook { namespace book {
 
+// Levels aggregated by price, best first
+typedef std::map<Price, DepthLevel, std::greater<Price> > BidLevelMap;
+typedef std::map<Price, DepthLevel, std::less<Price> > AskLevelMap;
+
 /// @brief container of limit order data aggregated by price.  Designed so that
 ///    the depth levels themselves are easily copyable with a single memcpy
-///    when used with a separate callback thread.
+///    when used with a separate callback thread.  The prices of each side 
+///    are also kept contiguously as search keys, so a level is found with
+///    a few vector compares rather than a walk over the levels.
 template <int SIZE=5> 
 class Depth {
 public:
@@ -47,12 +55,6 @@ public:
   /// @param is_bid indicator of bid or ask
   void add_order(Price price, Quantity qty, bool is_bid);
 
-  /// @brief ignore future fill quantity on a side, due to a match at 
-  ///        accept time for an order
-  /// @param qty the open quantity to ignore
-  /// @param is_bid indicator of bid or ask
-  void ignore_fill_qty(Quantity qty, bool is_bid);
-
   /// @brief handle an order fill
   /// @param price the price level of the order
   /// @param open_qty the open quantity of the order
@@ -89,6 +91,44 @@ public:
                      Quantity new_qty,
                      bool is_bid);
 
+  /// @brief set the aggregate state of a level, as maintained elsewhere
+  /// @param price the price level
+  /// @param order_count the number of orders at the level, 0 to erase it
+  /// @param qty the aggregate open quantity at the level
+  /// @param is_bid indicator of bid or ask
+  /// @return true if the update erased a level
+  bool set_level(Price price, 
+                 uint32_t order_count, 
+                 Quantity qty, 
+                 bool is_bid);
+
+  /// @brief update a bid level from an aggregation of every bid level kept
+  ///        elsewhere, such as OrderBook::bid_levels().  A depth updated this
+  ///        way keeps no excess levels, restoring from the aggregation 
+  ///        instead, so any number of depths can share one aggregation.
+  /// @param level the changed level, with an order count of zero if removed
+  /// @param levels the aggregation, still containing the changed level
+  /// @return true if the update erased a visible level
+  bool update_level(const DepthLevel& level, const BidLevelMap& levels);
+
+  /// @brief update an ask level from an aggregation of every ask level kept
+  ///        elsewhere, such as OrderBook::ask_levels().
+  /// @param level the changed level, with an order count of zero if removed
+  /// @param levels the aggregation, still containing the changed level
+  /// @return true if the update erased a visible level
+  bool update_level(const DepthLevel& level, const AskLevelMap& levels);
+
+  /// @brief replace the contents of this depth with aggregated levels, in
+  ///        one pass.  The best levels become visible, the rest excess, and 
+  ///        every visible level is marked changed.
+  /// @param bid the best bid level, as a (Price, DepthLevel) pair
+  /// @param bid_end one past the last bid level
+  /// @param ask the best ask level, as a (Price, DepthLevel) pair
+  /// @param ask_end one past the last ask level
+  template <class BidIterator, class AskIterator>
+  void restore(BidIterator bid, BidIterator bid_end,
+               AskIterator ask, AskIterator ask_end);
+
   /// @brief does this depth need bid restoration after level erasure
   /// @param restoration_price the price to restore after (out)
   /// @return true if restoration is needed (previously was full)
@@ -102,6 +142,9 @@ public:
   /// @brief has the depth changed since the last publish
   bool changed() const;
 
+  /// @brief what was the last change?
+  ChangeId last_change() const;
+
   /// @brief what was the last published change?
   ChangeId last_published_change() const;
 
@@ -109,14 +152,13 @@ public:
   void published();
 
 private:
+  enum { KEY_COUNT = LevelKeyCount<SIZE>::value };
   DepthLevel levels_[SIZE*2];
+  uint32_t bid_keys_[KEY_COUNT];
+  uint32_t ask_keys_[KEY_COUNT];
   ChangeId last_change_;
   ChangeId last_published_change_;
-  Quantity ignore_bid_fill_qty_;
-  Quantity ignore_ask_fill_qty_;
 
-  typedef std::map<Price, DepthLevel, std::greater<Price> > BidLevelMap;
-  typedef std::map<Price, DepthLevel, std::less<Price> > AskLevelMap;
   BidLevelMap excess_bid_levels_;
   AskLevelMap excess_ask_levels_;
 
@@ -127,13 +169,62 @@ private:
   /// @return the level, or NULL if not found and full
   DepthLevel* find_level(Price price, bool is_bid, bool should_create = true);
 
+  /// @brief search the visible levels for a price
+  /// @param price the price to find
+  /// @param is_bid indicator of bid or ask
+  /// @return the level with the price, or the level it belongs before (may 
+  ///         be blank), or one past the last level if worse than all
+  DepthLevel* search_level(Price price, bool is_bid);
+
+  /// @brief update the search key of one level after its price changed
+  /// @param level the level
+  /// @param is_bid indicator of bid or ask
+  void update_key(const DepthLevel* level, bool is_bid);
+
+  /// @brief update the search keys of a side after its levels shifted
+  /// @param is_bid indicator of bid or ask
+  void update_keys(bool is_bid);
+
   /// @brief insert a new level before this level and shift down
   /// @param level the level to insert before
   /// @param is_bid indicator of bid or ask
   /// @param price the price to initialize the level at
+  /// @param keep_excess should a level shifted out be kept as excess
   void insert_level_before(DepthLevel* level,
                            bool is_bid,
-                           Price price);
+                           Price price,
+                           bool keep_excess = true);
+
+  /// @brief update a visible level from a complete aggregation
+  /// @param aggregate the changed level
+  /// @param levels the aggregation of the side
+  /// @param is_bid indicator of bid or ask
+  /// @return true if the update erased a visible level
+  template <class LevelMap>
+  bool update_visible_level(const DepthLevel& aggregate,
+                            const LevelMap& levels,
+                            bool is_bid);
+
+  /// @brief erase a visible level and shift up, restoring the last level 
+  ///        from a complete aggregation
+  /// @param level the level to erase
+  /// @param levels the aggregation of the side
+  /// @param is_bid indicator of bid or ask
+  template <class LevelMap>
+  void erase_visible_level(DepthLevel* level,
+                           const LevelMap& levels,
+                           bool is_bid);
+
+  /// @brief restore the levels of one side
+  /// @param level the first level of the side
+  /// @param source the best aggregated level of the side
+  /// @param source_end one past the last aggregated level of the side
+  /// @param excess_levels the excess levels of the side
+  template <class Iterator, class LevelMap>
+  void restore_side(DepthLevel* level,
+                    Iterator source,
+                    Iterator source_end,
+                    LevelMap& excess_levels);
 
   /// @brief erase a level and shift up
   /// @param level the level to erase
@@ -144,11 +235,13 @@ private:
 template <int SIZE> 
 Depth<SIZE>::Depth()
 : last_change_(0),
-  last_published_change_(0),
-  ignore_bid_fill_qty_(0),
-  ignore_ask_fill_qty_(0)
+  last_published_change_(0)
 {
   memset(levels_, 0, sizeof(DepthLevel) * SIZE * 2);
+  for (int index = 0; index < KEY_COUNT; ++index) {
+    bid_keys_[index] = BLANK_LEVEL_KEY;
+    ask_keys_[index] = BLANK_LEVEL_KEY;
+  }
 }
 
 template <int SIZE> 
@@ -227,23 +320,6 @@ Depth<SIZE>::add_order(Price price, Quantity qty, bool is_bid)
   }
 }
 
-template <int SIZE> 
-inline void
-Depth<SIZE>::ignore_fill_qty(Quantity qty, bool is_bid)
-{
-  if (is_bid) {
-    if (ignore_bid_fill_qty_) {
-      throw std::runtime_error("Unexpected ignore_bid_fill_qty_");
-    }
-    ignore_bid_fill_qty_ = qty;
-  } else {
-    if (ignore_ask_fill_qty_) {
-      throw std::runtime_error("Unexpected ignore_ask_fill_qty_");
-    }
-    ignore_ask_fill_qty_ = qty;
-  }  
-}
-
 template <int SIZE> 
 inline void
 Depth<SIZE>::fill_order(
@@ -252,11 +328,7 @@ Depth<SIZE>::fill_order(
   Quantity fill_qty, 
   bool is_bid)
 {
-  if (is_bid && ignore_bid_fill_qty_) {
-    ignore_bid_fill_qty_ -= fill_qty;
-  } else if ((!is_bid) && ignore_ask_fill_qty_) {
-    ignore_ask_fill_qty_ -= fill_qty;
-  } else if (open_qty == fill_qty) {
+  if (open_qty == fill_qty) {
     close_order(price, open_qty, is_bid);
   } else {
     change_qty_order(price, -(int32_t)fill_qty, is_bid);
@@ -321,6 +393,97 @@ Depth<SIZE>::replace_order(
   return erased;
 }
 
+template <int SIZE> 
+inline bool
+Depth<SIZE>::set_level(
+  Price price, 
+  uint32_t order_count, 
+  Quantity qty, 
+  bool is_bid)
+{
+  // If the level is now empty, erase it if known
+  if (!order_count) {
+    DepthLevel* level = find_level(price, is_bid, false);
+    if (level) {
+      erase_level(level, is_bid);
+      return true;
+    }
+    return false;
+  }
+  ChangeId last_change_copy = last_change_;
+  DepthLevel* level = find_level(price, is_bid);
+  last_change_ = last_change_copy + 1; // Ensure incremented
+  level->set(order_count, qty);
+  level->last_change(last_change_);
+  return false;
+}
+
+template <int SIZE> 
+inline bool
+Depth<SIZE>::update_level(const DepthLevel& level, const BidLevelMap& levels)
+{
+  return update_visible_level(level, levels, true);
+}
+
+template <int SIZE> 
+inline bool
+Depth<SIZE>::update_level(const DepthLevel& level, const AskLevelMap& levels)
+{
+  return update_visible_level(level, levels, false);
+}
+
+template <int SIZE> 
+template <class BidIterator, class AskIterator>
+inline void
+Depth<SIZE>::restore(
+  BidIterator bid, 
+  BidIterator bid_end,
+  AskIterator ask, 
+  AskIterator ask_end)
+{
+  // Increment only once
+  ++last_change_;
+  restore_side(bids(), bid, bid_end, excess_bid_levels_);
+  restore_side(asks(), ask, ask_end, excess_ask_levels_);
+  update_keys(true);
+  update_keys(false);
+}
+
+template <int SIZE> 
+template <class Iterator, class LevelMap>
+inline void
+Depth<SIZE>::restore_side(
+  DepthLevel* level,
+  Iterator source,
+  Iterator source_end,
+  LevelMap& excess_levels)
+{
+  const DepthLevel* past_end = level + SIZE;
+  // Fill visible levels, blanking any beyond the source
+  for ( ; level != past_end; ++level) {
+    if (source != source_end) {
+      level->init(source->first, false);
+      level->set(source->second.order_count(), 
+                 source->second.aggregate_qty());
+      ++source;
+    } else {
+      level->init(INVALID_LEVEL_PRICE, false);
+    }
+    level->last_change(last_change_);
+  }
+  // Remaining levels are excess, appended in order
+  excess_levels.clear();
+  for ( ; source != source_end; ++source) {
+    DepthLevel excess_level;
+    excess_level.init(source->first, true);
+    excess_level.set(source->second.order_count(), 
+                     source->second.aggregate_qty());
+    excess_level.last_change(last_change_);
+    excess_levels.insert(excess_levels.end(), 
+                         std::make_pair(source->first, excess_level));
+  }
+}
+
 template <int SIZE> 
 inline bool
 Depth<SIZE>::needs_bid_restoration(Price& restoration_price)
@@ -367,27 +530,21 @@ template <int SIZE>
 DepthLevel*
 Depth<SIZE>::find_level(Price price, bool is_bid, bool should_create)
 {
-  // Find starting and ending point
-  DepthLevel* level = is_bid ? bids() : asks();
-  const DepthLevel* past_end = is_bid ? asks() : end();
-  // Linear search each level
-  for ( ; level != past_end; ++level) {
-    if (level->price() == price) {
-      break;
+  // Find the level, or where it belongs
+  DepthLevel* level = search_level(price, is_bid);
+  DepthLevel* past_end = is_bid ? asks() : levels_ + SIZE * 2;
+  // If the level is visible, but not at this price
+  if (level != past_end && level->price() != price) {
+    // If the level should not be created, it may be in excess
+    if (!should_create) {
+      level = past_end;
     // Else if the level is blank
-    } else if (should_create && level->price() == INVALID_LEVEL_PRICE) {
+    } else if (level->price() == INVALID_LEVEL_PRICE) {
       level->init(price, false);  // Change ID will be assigned by caller
-      break;  // Blank slot
-    // Else if the bid level price is too low
-    } else if (is_bid && should_create && level->price() < price) {
-      // Insert a slot
-      insert_level_before(level, is_bid, price);
-      break;
-    // Else if the ask level price is too high
-    } else if ((!is_bid) && should_create && level->price() > price) {
-      // Insert a slot
+      update_key(level, is_bid);
+    // Else insert a slot
+    } else {
       insert_level_before(level, is_bid, price);
-      break;
     }
   }
   // If level was not found
@@ -406,6 +563,9 @@ Depth<SIZE>::find_level(Price price, bool is_bid, bool should_create)
         insert_result = excess_bid_levels_.insert(
             std::make_pair(price, new_level));
         level = &insert_result.first->second;
+      // Else not found anywhere
+      } else {
+        level = NULL;
       }
     } else {
       // Search in excess ask levels
@@ -421,22 +581,62 @@ Depth<SIZE>::find_level(Price price, bool is_bid, bool should_create)
         insert_result = excess_ask_levels_.insert(
             std::make_pair(price, new_level));
         level = &insert_result.first->second;
+      // Else not found anywhere
+      } else {
+        level = NULL;
       }
     }
   }
   return level;
 }
 
+template <int SIZE> 
+inline DepthLevel*
+Depth<SIZE>::search_level(Price price, bool is_bid)
+{
+  if (is_bid) {
+    return bids() + search_level_keys(bid_keys_, KEY_COUNT, 
+                                      bid_level_key(price));
+  } else {
+    return asks() + search_level_keys(ask_keys_, KEY_COUNT, 
+                                      ask_level_key(price));
+  }
+}
+
+template <int SIZE> 
+inline void
+Depth<SIZE>::update_key(const DepthLevel* level, bool is_bid)
+{
+  if (is_bid) {
+    bid_keys_[level - bids()] = bid_level_key(level->price());
+  } else {
+    ask_keys_[level - asks()] = ask_level_key(level->price());
+  }
+}
+
+template <int SIZE> 
+void
+Depth<SIZE>::update_keys(bool is_bid)
+{
+  const DepthLevel* level = is_bid ? bids() : asks();
+  uint32_t* keys = is_bid ? bid_keys_ : ask_keys_;
+  for (int index = 0; index < SIZE; ++index, ++level) {
+    keys[index] = is_bid ? bid_level_key(level->price()) :
+                           ask_level_key(level->price());
+  }
+}
+
 template <int SIZE> 
 void
 Depth<SIZE>::insert_level_before(DepthLevel* level, 
                                  bool is_bid,
-                                 Price price)
+                                 Price price,
+                                 bool keep_excess)
 {
   DepthLevel* last_side_level = is_bid ? last_bid_level() : last_ask_level();
 
-  // If the last level has valid data
-  if (last_side_level->price() != INVALID_LEVEL_PRICE) {
+  // If the last level has valid data, and excess is kept
+  if (keep_excess && last_side_level->price() != INVALID_LEVEL_PRICE) {
     DepthLevel excess_level;
     excess_level.init(0, true);  // Will assign over price
     excess_level = *last_side_level;
@@ -466,6 +666,7 @@ Depth<SIZE>::insert_level_before(DepthLevel* level,
     --current_level;
    }
    level->init(price, false);
+   update_keys(is_bid);
 }
 
 template <int SIZE> 
@@ -527,7 +728,94 @@ Depth<SIZE>::erase_level(DepthLevel* level, bool is_bid)
       }
       last_side_level->last_change(last_change_);
     }
+    update_keys(is_bid);
+  }
+}
+
+template <int SIZE> 
+template <class LevelMap>
+inline bool
+Depth<SIZE>::update_visible_level(
+  const DepthLevel& aggregate,
+  const LevelMap& levels,
+  bool is_bid)
+{
+  Price price = aggregate.price();
+  // Find the level, or where it belongs
+  DepthLevel* level = search_level(price, is_bid);
+  const DepthLevel* past_end = is_bid ? asks() : end();
+  // If worse than every visible level, this depth is not affected
+  if (level == past_end) {
+    return false;
+  }
+  // If the level is visible
+  if (level->price() == price) {
+    // If the last order has left the level
+    if (!aggregate.order_count()) {
+      erase_visible_level(level, levels, is_bid);
+      return true;
+    }
+    level->set(aggregate.order_count(), aggregate.aggregate_qty());
+    level->last_change(++last_change_);
+  // Else if this is a new level
+  } else if (aggregate.order_count()) {
+    ChangeId last_change_copy = last_change_;
+    if (level->price() == INVALID_LEVEL_PRICE) {
+      level->init(price, false);
+      update_key(level, is_bid);
+    } else {
+      // Shift worse levels down, the last is still in the aggregation
+      insert_level_before(level, is_bid, price, false);
+    }
+    last_change_ = last_change_copy + 1; // Ensure incremented
+    level->set(aggregate.order_count(), aggregate.aggregate_qty());
+    level->last_change(last_change_);
+  }
+  return false;
+}
+
+template <int SIZE> 
+template <class LevelMap>
+void
+Depth<SIZE>::erase_visible_level(
+  DepthLevel* level, 
+  const LevelMap& levels,
+  bool is_bid)
+{
+  DepthLevel* last_side_level = is_bid ? last_bid_level() : last_ask_level();
+  // Remember the worst visible price, before shifting
+  Price last_price = last_side_level->price();
+  // Increment once
+  ++last_change_;
+  DepthLevel* current_level = level;
+  // Level to end
+  while (current_level < last_side_level) {
+    // If this is the first level, or the level to be overwritten is valid
+    if ((current_level->price() != INVALID_LEVEL_PRICE) ||
+        (current_level == level)) {
+      // Copy to current level from one lower
+      *current_level = *(current_level + 1);
+      // Mark the current level as updated
+      current_level->last_change(last_change_);
+    }
+    // Move forward one
+    ++current_level;
   }
+
+  // If the last level was valid, restore it from the aggregation
+  if (last_price != INVALID_LEVEL_PRICE) {
+    typename LevelMap::const_iterator next = levels.upper_bound(last_price);
+    if (next != levels.end()) {
+      last_side_level->init(next->first, false);
+      last_side_level->set(next->second.order_count(), 
+                           next->second.aggregate_qty());
+    } else {
+      // Nothing to restore, last level is blank
+      last_side_level->init(INVALID_LEVEL_PRICE, false);
+    }
+    last_side_level->last_change(last_change_);
+  }
+  update_keys(is_bid);
 }
 
 template <int SIZE> 
@@ -538,6 +826,14 @@ Depth<SIZE>::changed() const
 }
 
 
+template <int SIZE> 
+ChangeId
+Depth<SIZE>::last_change() const
+{
+  return last_change_;
+}
+
+
 template <int SIZE> 
 ChangeId
 Depth<SIZE>::last_published_change() const
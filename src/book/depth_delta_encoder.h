@@ -0,0 +1,181 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef depth_delta_encoder_h
+#define depth_delta_encoder_h
+
+#include "depth.h"
+#include "depth_subscriber.h"
+#include "types.h"
+#include <stdexcept>
+#include <string.h>
+
+namespace liquibook { namespace book {
+
+#pragma pack(push, 1)
+/// @brief header of an encoded depth update
+struct DepthDeltaHeader {
+  ChangeId change_id;    // last change of the depth when encoded
+  uint16_t delta_count;  // number of DepthDelta records following
+};
+
+/// @brief a single changed level within an encoded depth update.  A level
+///   with an order count of zero has been emptied.
+struct DepthDelta {
+  enum Side {
+    side_bid = 0,
+    side_ask = 1
+  };
+  uint8_t side;
+  uint8_t level_index;
+  Price price;
+  Quantity aggregate_qty;
+  uint32_t order_count;
+};
+#pragma pack(pop)
+
+/// @brief encoder of the levels of a Depth changed since its last publish
+///        into a compact binary update.  Does no allocation - the caller
+///        supplies the buffer, sized with MAX_ENCODED_SIZE.  Level indexes
+///        are encoded in a single byte, so SIZE may not exceed 256.
+template <int SIZE=5>
+class DepthDeltaEncoder {
+#if __cplusplus >= 201103L
+  static_assert(SIZE <= 256, "level_index holds at most 256 levels");
+#else
+  typedef char level_index_fits[SIZE <= 256 ? 1 : -1];
+#endif
+public:
+  /// @brief size of an update in which every level has changed
+  static const size_t MAX_ENCODED_SIZE =
+      sizeof(DepthDeltaHeader) + sizeof(DepthDelta) * SIZE * 2;
+
+  /// @brief encode the changed levels and mark the depth as published
+  /// @param depth the depth to encode
+  /// @param buffer the buffer to encode into
+  /// @param buffer_size the size of the buffer, at least MAX_ENCODED_SIZE
+  /// @return the number of bytes encoded, or 0 if the depth has not changed
+  static size_t encode(Depth<SIZE>& depth, char* buffer, size_t buffer_size);
+
+  /// @brief encode the levels changed since a subscriber last saw the 
+  ///        depth, and mark them seen by the subscriber
+  /// @param subscriber the subscriber to encode for
+  /// @param buffer the buffer to encode into
+  /// @param buffer_size the size of the buffer, at least MAX_ENCODED_SIZE
+  /// @return the number of bytes encoded, or 0 if the depth has not changed
+  static size_t encode(DepthSubscriber<SIZE>& subscriber,
+                       char* buffer,
+                       size_t buffer_size);
+
+private:
+  /// @brief encode the levels changed since a given change
+  /// @param depth the depth to encode
+  /// @param last_published_change the change to compare levels to
+  /// @param buffer the buffer to encode into, of MAX_ENCODED_SIZE
+  /// @return the number of bytes encoded
+  static size_t encode_changes(const Depth<SIZE>& depth,
+                               ChangeId last_published_change,
+                               char* buffer);
+
+  /// @brief encode the changed levels of one side
+  /// @param level the first level of the side
+  /// @param side the side being encoded
+  /// @param last_published_change the change to compare levels to
+  /// @param out where to encode the next delta (in/out)
+  /// @return the number of deltas encoded
+  static uint16_t encode_side(const DepthLevel* level,
+                              uint8_t side,
+                              ChangeId last_published_change,
+                              char*& out);
+};
+
+template <int SIZE>
+const size_t DepthDeltaEncoder<SIZE>::MAX_ENCODED_SIZE;
+
+template <int SIZE>
+inline size_t
+DepthDeltaEncoder<SIZE>::encode(
+  Depth<SIZE>& depth,
+  char* buffer,
+  size_t buffer_size)
+{
+  if (buffer_size < MAX_ENCODED_SIZE) {
+    throw std::runtime_error("DepthDeltaEncoder buffer too small");
+  }
+  if (!depth.changed()) {
+    return 0;
+  }
+  size_t encoded_size = 
+      encode_changes(depth, depth.last_published_change(), buffer);
+  depth.published();
+  return encoded_size;
+}
+
+template <int SIZE>
+inline size_t
+DepthDeltaEncoder<SIZE>::encode(
+  DepthSubscriber<SIZE>& subscriber,
+  char* buffer,
+  size_t buffer_size)
+{
+  if (buffer_size < MAX_ENCODED_SIZE) {
+    throw std::runtime_error("DepthDeltaEncoder buffer too small");
+  }
+  if (!subscriber.changed()) {
+    return 0;
+  }
+  size_t encoded_size = encode_changes(subscriber.depth(), 
+                                       subscriber.last_seen_change(), 
+                                       buffer);
+  subscriber.seen();
+  return encoded_size;
+}
+
+template <int SIZE>
+inline size_t
+DepthDeltaEncoder<SIZE>::encode_changes(
+  const Depth<SIZE>& depth,
+  ChangeId last_published_change,
+  char* buffer)
+{
+  char* out = buffer + sizeof(DepthDeltaHeader);
+  DepthDeltaHeader header;
+  header.change_id = depth.last_change();
+  header.delta_count =
+      encode_side(depth.bids(), DepthDelta::side_bid,
+                  last_published_change, out) +
+      encode_side(depth.asks(), DepthDelta::side_ask,
+                  last_published_change, out);
+  memcpy(buffer, &header, sizeof(DepthDeltaHeader));
+  return out - buffer;
+}
+
+template <int SIZE>
+inline uint16_t
+DepthDeltaEncoder<SIZE>::encode_side(
+  const DepthLevel* level,
+  uint8_t side,
+  ChangeId last_published_change,
+  char*& out)
+{
+  uint16_t count = 0;
+  DepthDelta delta;
+  delta.side = side;
+  for (int index = 0; index < SIZE; ++index, ++level) {
+    // Only levels changed since last publish are encoded
+    if (level->changed_since(last_published_change)) {
+      delta.level_index = uint8_t(index);
+      delta.price = level->price();
+      delta.aggregate_qty = level->aggregate_qty();
+      delta.order_count = level->order_count();
+      memcpy(out, &delta, sizeof(DepthDelta));
+      out += sizeof(DepthDelta);
+      ++count;
+    }
+  }
+  return count;
+}
+
+} }
+
+#endif
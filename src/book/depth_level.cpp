@@ -44,6 +44,13 @@ DepthLevel::init(Price price, bool is_excess)
   is_excess_ = is_excess;
 }
 
+void
+DepthLevel::set(uint32_t order_count, Quantity qty)
+{
+  order_count_ = order_count;
+  aggregate_qty_ = qty;
+}
+
 uint32_t
 DepthLevel::order_count() const
 {
@@ -28,6 +28,11 @@ public:
 
   void init(Price price, bool is_excess);
 
+  /// @brief set the order count and aggregate quantity of the level
+  /// @param order_count number of orders at the level
+  /// @param qty aggregate open quantity at the level
+  void set(uint32_t order_count, Quantity qty);
+
   /// @brief add an order to the level
   /// @param qty open quantity of the order
   void add_order(Quantity qty);
@@ -0,0 +1,104 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef depth_subscriber_h
+#define depth_subscriber_h
+
+#include "depth.h"
+
+namespace liquibook { namespace book {
+
+/// @brief a consumer of a Depth tracking its own publication, so several
+///        consumers (e.g. a real-time and a conflated feed) can each see
+///        the levels changed since they last looked, without copying the
+///        depth.  Independent of the depth's own changed() and published().
+template <int SIZE=5>
+class DepthSubscriber {
+public:
+  /// @brief construct a subscriber which has seen none of the depth
+  /// @param depth the depth to follow, which must outlive the subscriber
+  explicit DepthSubscriber(const Depth<SIZE>& depth);
+
+  /// @brief get the depth followed
+  const Depth<SIZE>& depth() const;
+
+  /// @brief has the depth changed since this subscriber last saw it
+  bool changed() const;
+
+  /// @brief what was the last change seen by this subscriber?
+  ChangeId last_seen_change() const;
+
+  /// @brief has a level changed since this subscriber last saw the depth
+  /// @param level the level, of the depth followed
+  bool changed(const DepthLevel* level) const;
+
+  /// @brief find the next level changed since this subscriber last saw the
+  ///        depth, bids (best to worst) then asks (best to worst)
+  /// @param level the level to start from, such as depth().bids()
+  /// @return the changed level, or depth().end() if there is none
+  const DepthLevel* next_changed(const DepthLevel* level) const;
+
+  /// @brief note that this subscriber has seen the current depth
+  void seen();
+
+private:
+  const Depth<SIZE>& depth_;
+  ChangeId last_seen_change_;
+};
+
+template <int SIZE>
+DepthSubscriber<SIZE>::DepthSubscriber(const Depth<SIZE>& depth)
+: depth_(depth),
+  last_seen_change_(0)
+{
+}
+
+template <int SIZE>
+inline const Depth<SIZE>&
+DepthSubscriber<SIZE>::depth() const
+{
+  return depth_;
+}
+
+template <int SIZE>
+inline bool
+DepthSubscriber<SIZE>::changed() const
+{
+  return depth_.last_change() > last_seen_change_;
+}
+
+template <int SIZE>
+inline ChangeId
+DepthSubscriber<SIZE>::last_seen_change() const
+{
+  return last_seen_change_;
+}
+
+template <int SIZE>
+inline bool
+DepthSubscriber<SIZE>::changed(const DepthLevel* level) const
+{
+  return level->changed_since(last_seen_change_);
+}
+
+template <int SIZE>
+inline const DepthLevel*
+DepthSubscriber<SIZE>::next_changed(const DepthLevel* level) const
+{
+  const DepthLevel* past_end = depth_.end();
+  while (level != past_end && !level->changed_since(last_seen_change_)) {
+    ++level;
+  }
+  return level;
+}
+
+template <int SIZE>
+inline void
+DepthSubscriber<SIZE>::seen()
+{
+  last_seen_change_ = depth_.last_change();
+}
+
+} }
+
+#endif
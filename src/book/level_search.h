@@ -0,0 +1,85 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef level_search_h
+#define level_search_h
+
+#include "types.h"
+
+#if defined(__AVX2__)
+# define LIQUIBOOK_AVX2_SEARCH
+# include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+      (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define LIQUIBOOK_SSE2_SEARCH
+# include <emmintrin.h>
+#endif
+
+namespace liquibook { namespace book {
+
+// Search keys of depth level prices.  Keys of each side ascend from best to
+// worst level, and blank levels have the highest key, so a level is found
+// (or its insertion point) as the first key not less than that of the price.
+const uint32_t BLANK_LEVEL_KEY(0xFFFFFFFF);
+
+/// @brief get the search key of a bid price - descending prices ascend
+inline uint32_t bid_level_key(Price price) { return ~price; }
+
+/// @brief get the search key of an ask price - blank (0) becomes highest
+inline uint32_t ask_level_key(Price price) { return price - 1; }
+
+/// @brief number of keys held for a side of SIZE levels, padded with blank
+///        keys so a whole number of vectors can be compared
+template <int SIZE>
+struct LevelKeyCount {
+  enum { value = ((SIZE + 7) / 8) * 8 };
+};
+
+/// @brief find the first key not less than a key
+/// @param keys ascending keys, padded with BLANK_LEVEL_KEY to count
+/// @param count the number of keys, a multiple of 8
+/// @param key the key to find
+/// @return the index of the key, or its insertion point
+inline int
+search_level_keys(const uint32_t* keys, int count, uint32_t key)
+{
+  // Count the keys less than the key - every comparison is done, without
+  // branching, as keys are few
+  int less = 0;
+#if defined(LIQUIBOOK_AVX2_SEARCH) || defined(LIQUIBOOK_SSE2_SEARCH)
+  // Number of set bits in each 4 bit mask
+  static const int bit_counts[16] =
+      { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+#endif
+#if defined(LIQUIBOOK_AVX2_SEARCH)
+  // AVX2 compares signed values, so bias both sides
+  const __m256i bias = _mm256_set1_epi32(int(0x80000000));
+  const __m256i target = _mm256_xor_si256(_mm256_set1_epi32(int(key)), bias);
+  for (int index = 0; index < count; index += 8) {
+    __m256i values = _mm256_xor_si256(
+        _mm256_loadu_si256((const __m256i*)(keys + index)), bias);
+    int mask = _mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpgt_epi32(target, values)));
+    less += bit_counts[mask & 0xF] + bit_counts[mask >> 4];
+  }
+#elif defined(LIQUIBOOK_SSE2_SEARCH)
+  // SSE2 compares signed values, so bias both sides
+  const __m128i bias = _mm_set1_epi32(int(0x80000000));
+  const __m128i target = _mm_xor_si128(_mm_set1_epi32(int(key)), bias);
+  for (int index = 0; index < count; index += 4) {
+    __m128i values = _mm_xor_si128(
+        _mm_loadu_si128((const __m128i*)(keys + index)), bias);
+    less += bit_counts[_mm_movemask_ps(
+        _mm_castsi128_ps(_mm_cmpgt_epi32(target, values)))];
+  }
+#else
+  for (int index = 0; index < count; ++index) {
+    less += (keys[index] < key);
+  }
+#endif
+  return less;
+}
+
+} }
+
+#endif
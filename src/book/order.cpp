@@ -9,4 +9,16 @@ Order::is_limit() const {
   return (price() > 0);
 }
 
+Price
+Order::stop_price() const
+{
+  return 0;
+}
+
+Quantity
+Order::display_qty() const
+{
+  return 0;
+}
+
 } }
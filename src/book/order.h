@@ -23,6 +23,16 @@ public:
 
   /// @brief get the quantity of this order
   virtual Quantity order_qty() const = 0;
+
+  /// @brief get the price at which this order is triggered, if added as a
+  ///        stop order (oc_stop).  Defaults to 0, for orders never added
+  ///        as stop orders
+  virtual Price stop_price() const;
+
+  /// @brief get the quantity shown at a time, if added as an iceberg
+  ///        order (oc_iceberg).  Defaults to 0, for orders never added
+  ///        as icebergs
+  virtual Quantity display_qty() const;
 };
 
 } }
@@ -7,13 +7,16 @@
 #include "callback.h"
 #include "order.h"
 #include "order_listener.h"
+#include "depth.h"
 #include "depth_level.h"
+#include "order_queues.h"
 #include <map>
 #include <vector>
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
 #include <list>
+#include <utility>
 
 namespace liquibook { namespace book {
 
@@ -24,16 +27,37 @@ template<class OrderPtr>
 class OrderListener;
 
 /// @brief Tracker of an order's state, to keep inside the OrderBook.  
-///   Kept separate from the order itself.
+///   Kept separate from the order itself.  The order fields used in matching
+///   are copied in at construction, so matching does not call through the 
+///   order interface, or touch the order's memory.
 template <class OrderPtr = Order*>
 class OrderTracker {
 public:
   /// @brief construct
   OrderTracker(const OrderPtr& order, OrderConditions conditions = 0);
+#ifdef LIQUIBOOK_HAS_MOVE
+  /// @brief construct, taking the order pointer
+  OrderTracker(OrderPtr&& order, OrderConditions conditions = 0);
+#endif
+
+  /// @brief construct with the state of an order kept elsewhere, such as in
+  ///        a checkpoint, rather than from the order
+  /// @param hidden_qty the open quantity an iceberg order does not show
+  OrderTracker(const OrderPtr& order,
+               bool is_buy,
+               Price price,
+               Quantity order_qty,
+               Quantity open_qty,
+               OrderConditions conditions,
+               Quantity hidden_qty = 0);
 
   /// @brief modify the order quantity
   void change_qty(int32_t delta);
 
+  /// @brief modify the order price
+  /// @param price the new price of the order
+  void change_price(Price price);
+
   /// @brief fill an order
   /// @param qty the number of shares filled in this fill
   void fill(Quantity qty); 
@@ -47,6 +71,34 @@ public:
   /// @brief get the open quantity of this order
   Quantity open_qty() const;
 
+  /// @brief get the open quantity of this order shown in the book, less
+  ///        than the open quantity only for an iceberg order
+  Quantity visible_qty() const;
+
+  /// @brief get the open quantity of this order not shown in the book
+  Quantity hidden_qty() const;
+
+  /// @brief get the quantity an iceberg order shows at a time, or 0 if not
+  ///        an iceberg order.  Read from the order, as only an iceberg
+  ///        showing more needs it.
+  Quantity display_qty() const;
+
+  /// @brief is this an iceberg order?
+  bool iceberg() const;
+
+  /// @brief show the display quantity of an iceberg order, or its open
+  ///        quantity if less, hiding the rest
+  void display();
+
+  /// @brief get the quantity of this order
+  Quantity order_qty() const;
+
+  /// @brief get the price of this order, or 0 if a market order
+  Price price() const;
+
+  /// @brief is this order a buy?
+  bool is_buy() const;
+
   /// @brief get the order pointer
   const OrderPtr& ptr() const;
 
@@ -59,9 +111,18 @@ public:
   /// @ brief is this order marked immediate or cancel?
   bool immediate_or_cancel() const;
 
+  /// @brief get the special conditions on this order
+  OrderConditions conditions() const;
+
 private:
+  // Side of the order, kept with the conditions to keep trackers compact
+  static const OrderConditions buy_condition = 0x80000000;
+
   OrderPtr order_;
+  Price price_;
+  Quantity order_qty_;
   Quantity open_qty_;
+  Quantity hidden_qty_;
   OrderConditions conditions_;
 };
 
@@ -76,21 +137,39 @@ public:
   typedef OrderListener<OrderPtr > TypedOrderListener;
   typedef OrderBookListener<OrderPtr > TypedOrderBookListener;
   typedef std::vector<TypedCallback > Callbacks;
-  typedef std::multimap<Price, Tracker, std::greater<Price> >  Bids;
-  typedef std::multimap<Price, Tracker, std::less<Price> >     Asks;
+  typedef OrderQueues<Tracker, std::greater<Price> >           Bids;
+  typedef OrderQueues<Tracker, std::less<Price> >              Asks;
+  typedef BidLevelMap BidLevels;
+  typedef AskLevelMap AskLevels;
+  typedef std::multimap<Price, Tracker, std::less<Price> >     BuyStops;
+  typedef std::multimap<Price, Tracker, std::greater<Price> >  SellStops;
   typedef std::list<typename Bids::iterator> DeferredBidCrosses;
   typedef std::list<typename Asks::iterator> DeferredAskCrosses;
 
   /// @brief construct
   OrderBook();
 
-  /// @brief add an order to book
+  /// @brief destroy.  Virtual, as books are derived from, and managed
+  ///        through pointers to their derived types' bases.
+  virtual ~OrderBook();
+
+  /// @brief add an order to book.  A stop order (oc_stop) is held until a
+  ///        trade at or through its stop price (at or above for a buy, at
+  ///        or below for a sell), then added as a market or limit order.
+  ///        An iceberg order (oc_iceberg) rests showing only its display
+  ///        quantity.  Once that is filled it shows the next, from the
+  ///        quantity hidden, behind the other orders of its price.
   /// @param order the order to add
   /// @param conditions special conditions on the order
   /// @return true if the add resulted in a fill
   virtual bool add(const OrderPtr& order, OrderConditions conditions = 0);
+#ifdef LIQUIBOOK_HAS_MOVE
+  /// @brief add an order to book, taking the order pointer, so that the
+  ///        book keeps it without a copy
+  virtual bool add(OrderPtr&& order, OrderConditions conditions = 0);
+#endif
 
-  /// @brief cancel an order in the book
+  /// @brief cancel an order in the book, or a stop order not yet triggered
   virtual void cancel(const OrderPtr& order);
 
   /// @brief replace an order in the book
@@ -108,15 +187,98 @@ public:
   /// @brief access the asks container
   const Asks& asks() const { return asks_; };
 
+  /// @brief access the limit bids aggregated by price
+  const BidLevels& bid_levels() const { return bid_levels_; };
+
+  /// @brief access the limit asks aggregated by price
+  const AskLevels& ask_levels() const { return ask_levels_; };
+
+  /// @brief access the buy stop orders not yet triggered, by stop price
+  const BuyStops& buy_stops() const { return buy_stops_; };
+
+  /// @brief access the sell stop orders not yet triggered, by stop price
+  const SellStops& sell_stops() const { return sell_stops_; };
+
+  /// @brief get the price of the last trade, or 0 if none, against which
+  ///        stop orders are triggered
+  Price market_price() const { return market_price_; };
+
+  /// @brief get the ID of the last transaction.  Each aggregated level's 
+  ///        last change is the ID of the transaction that last changed it.
+  TransId trans_id() const { return trans_id_; };
+
+  /// @brief populate a level with the best aggregated bid below a price
+  /// @param price the price to find a level below (MARKET_ORDER_BID_SORT_PRICE
+  ///        for the best bid)
+  /// @param level the level to populate, blank if none found (out)
+  /// @return true if a level was found
+  bool populate_bid_depth_level_after(const Price& price,
+                                      DepthLevel& level) const;
+
+  /// @brief populate a level with the best aggregated ask above a price
+  /// @param price the price to find a level above (MARKET_ORDER_ASK_SORT_PRICE
+  ///        for the best ask)
+  /// @param level the level to populate, blank if none found (out)
+  /// @return true if a level was found
+  bool populate_ask_depth_level_after(const Price& price,
+                                      DepthLevel& level) const;
+
+  /// @brief rebuild a depth from the aggregated levels in one pass, for
+  ///        snapshots or to verify a depth maintained incrementally
+  /// @param depth the depth to rebuild
+  template <int SIZE>
+  void populate_depth(Depth<SIZE>& depth) const;
+
   /// @brief perform all callbacks in the queue
   virtual void perform_callbacks();
 
   /// @brief perform an individual callback
   virtual void perform_callback(TypedCallback& cb);
 
+  /// @brief discard all callbacks in the queue without performing them, as
+  ///        when replaying commands whose outcome was already reported.
+  ///        Orders are not told of the events discarded.
+  void discard_callbacks();
+
   /// @brief log the orders in the book.
   void log() const;
 
+  /// @brief restore a resting order without matching it, as from a 
+  ///        checkpoint.  Orders of a price are restored in priority order.
+  ///        The aggregated levels are restored separately.
+  /// @param tracker the tracker of the order
+  void restore_order(const Tracker& tracker);
+
+  /// @brief restore a stop order not yet triggered, as from a checkpoint.
+  ///        Stop orders of a stop price are restored in the order added.
+  /// @param tracker the tracker of the order
+  /// @param stop_price the price at which the order is triggered
+  void restore_stop(const Tracker& tracker, Price stop_price);
+
+  /// @brief restore an aggregated limit price level, as from a checkpoint
+  /// @param level the level
+  /// @param is_bid indicator of bid or ask
+  void restore_level(const DepthLevel& level, bool is_bid);
+
+  /// @brief complete a restore, once every order and level is restored
+  /// @param trans_id the ID of the last transaction before the checkpoint
+  /// @param market_price the price of the last trade before the checkpoint,
+  ///        which triggers stop orders
+  void restored(TransId trans_id, Price market_price = 0);
+
+  /// @brief change an aggregated limit price level directly, in a
+  ///        transaction of its own, without an order or matching.  For
+  ///        books built from a market-by-order feed, whose orders are
+  ///        matched elsewhere.
+  /// @param price the price of the level
+  /// @param count_delta the change in order count (+1, -1, or 0)
+  /// @param qty_delta the change in aggregate quantity (+ or -)
+  /// @param is_bid indicator of bid or ask
+  void apply_level_change(Price price,
+                          int32_t count_delta,
+                          int32_t qty_delta,
+                          bool is_bid);
+
 protected:
   /// @brief match a new ask to current bids
   /// @param inbound_order the inbound order
@@ -139,8 +301,30 @@ protected:
   /// @brief perform fill on two orders
   /// @param inbound_tracker the new (or changed) order tracker
   /// @param current_tracker the current order tracker
-  void cross_orders(Tracker& inbound_tracker, 
-                    Tracker& current_tracker);
+  /// @param current_price the book price of the current order
+  /// @param current_is_bid indicator of the current order's side
+  /// @return true if the current order, an iceberg, showed more of its
+  ///         quantity, and so must be requeued
+  bool cross_orders(Tracker& inbound_tracker, 
+                    Tracker& current_tracker,
+                    Price current_price,
+                    bool current_is_bid);
+
+  /// @brief notification of a change to an aggregated limit price level,
+  ///        made during matching after the level is updated
+  /// @param level the updated level, with an order count of zero if the 
+  ///        level has been removed
+  /// @param count_delta the change in the level's order count
+  /// @param qty_delta the change in the level's aggregate quantity
+  /// @param is_bid indicator of bid or ask
+  virtual void on_level_change(const DepthLevel& level, 
+                               int32_t count_delta,
+                               int32_t qty_delta,
+                               bool is_bid);
+
+  /// @brief notification of the completion of a restore, to rebuild any
+  ///        state kept from the aggregated levels, such as a depth
+  virtual void on_restore();
 
   /// @brief perform validation on the order, and create reject callbacks if not
   /// @param order the order to validate
@@ -163,6 +347,10 @@ protected:
   /// @brief find an ask
   void find_ask(const OrderPtr& order, typename Asks::iterator& result);
 
+  /// @brief add the stop orders triggered by the market price, and any
+  ///        triggered by their trades in turn, in this transaction
+  void trigger_stops();
+
   /// @brief match an inbound with a current order
   virtual bool matches(const Tracker& inbound_order, 
                        const Price& inbound_price, 
@@ -173,15 +361,56 @@ protected:
 private:
   Bids bids_;
   Asks asks_;
+  BidLevels bid_levels_;
+  AskLevels ask_levels_;
+  BuyStops buy_stops_;
+  SellStops sell_stops_;
   DeferredBidCrosses deferred_bid_crosses_;
   DeferredAskCrosses deferred_ask_crosses_;
   Callbacks callbacks_;
   TypedOrderBookListener* book_listener_;
   TypedOrderListener* order_listener_;
   TransId trans_id_;
+  Price market_price_;
 
   Price sort_price(const OrderPtr& order);
   bool add_order(Tracker& order_tracker, Price order_price);
+
+  /// @brief add a valid inbound order, once its accept callback is issued
+  /// @param inbound the tracker of the order, moved into the book if it
+  ///        rests or waits for its stop price
+  /// @param accept_cb_index the position of the accept callback
+  bool add_inbound(Tracker& inbound, size_t accept_cb_index);
+
+  /// @brief move a resting iceberg order which has shown more of its
+  ///        quantity behind the other orders of its price
+  /// @param orders the bids or asks
+  /// @param order the order to move
+  /// @return the order after it, or the order itself if already last at its
+  ///         price, and so not moved
+  template <class Orders>
+  typename Orders::iterator requeue(Orders& orders,
+                                    typename Orders::iterator order);
+
+  /// @brief is a stop order of a stop price triggered by the market price
+  bool stop_triggered(Price stop_price, bool is_buy) const;
+
+  /// @brief update the aggregated level of a resting order's price
+  /// @param price the book price of the order
+  /// @param count_delta the change in order count (+1, -1, or 0)
+  /// @param qty_delta the change in open quantity (+ or -)
+  /// @param is_bid indicator of bid or ask
+  void update_level(Price price, 
+                    int32_t count_delta, 
+                    int32_t qty_delta, 
+                    bool is_bid);
+
+  template <class Levels>
+  void update_level(Levels& levels,
+                    Price price, 
+                    int32_t count_delta, 
+                    int32_t qty_delta, 
+                    bool is_bid);
 };
 
 template <class OrderPtr>
@@ -190,8 +419,46 @@ OrderTracker<OrderPtr>::OrderTracker(
   const OrderPtr& order, 
   OrderConditions conditions)
 : order_(order),
+  price_(order->price()),
+  order_qty_(order->order_qty()),
+  open_qty_(order->open_qty()),
+  hidden_qty_(0),
+  conditions_(order->is_buy() ? (conditions | buy_condition) : conditions)
+{
+}
+
+#ifdef LIQUIBOOK_HAS_MOVE
+template <class OrderPtr>
+inline
+OrderTracker<OrderPtr>::OrderTracker(
+  OrderPtr&& order, 
+  OrderConditions conditions)
+: order_(std::move(order)),
+  price_(order_->price()),
+  order_qty_(order_->order_qty()),
   open_qty_(order_->open_qty()),
-  conditions_(conditions)
+  hidden_qty_(0),
+  conditions_(order_->is_buy() ? (conditions | buy_condition) : conditions)
+{
+}
+#endif
+
+template <class OrderPtr>
+inline
+OrderTracker<OrderPtr>::OrderTracker(
+  const OrderPtr& order, 
+  bool is_buy,
+  Price price,
+  Quantity order_qty,
+  Quantity open_qty,
+  OrderConditions conditions,
+  Quantity hidden_qty)
+: order_(order),
+  price_(price),
+  order_qty_(order_qty),
+  open_qty_(open_qty),
+  hidden_qty_(hidden_qty),
+  conditions_(is_buy ? (conditions | buy_condition) : conditions)
 {
 }
 
@@ -205,6 +472,15 @@ OrderTracker<OrderPtr>::change_qty(int32_t delta)
         std::runtime_error("Replace size reduction larger than open quantity");
   }
   open_qty_ += delta;
+  order_qty_ += delta;
+  hidden_qty_ = std::min(hidden_qty_, open_qty_);
+}
+
+template <class OrderPtr>
+inline void
+OrderTracker<OrderPtr>::change_price(Price price)
+{
+  price_ = price;
 }
 
 template <class OrderPtr>
@@ -215,6 +491,7 @@ OrderTracker<OrderPtr>::fill(Quantity qty)
     throw std::runtime_error("Fill size larger than open quantity");
   }
   open_qty_ -= qty;
+  hidden_qty_ = std::min(hidden_qty_, open_qty_);
 }
 
 template <class OrderPtr>
@@ -228,7 +505,7 @@ template <class OrderPtr>
 inline Quantity
 OrderTracker<OrderPtr>::filled_qty() const
 {
-  return order_->order_qty() - open_qty();
+  return order_qty_ - open_qty_;
 }
 
 template <class OrderPtr>
@@ -238,6 +515,65 @@ OrderTracker<OrderPtr>::open_qty() const
   return open_qty_;
 }
 
+template <class OrderPtr>
+inline Quantity
+OrderTracker<OrderPtr>::visible_qty() const
+{
+  return open_qty_ - hidden_qty_;
+}
+
+template <class OrderPtr>
+inline Quantity
+OrderTracker<OrderPtr>::hidden_qty() const
+{
+  return hidden_qty_;
+}
+
+template <class OrderPtr>
+inline Quantity
+OrderTracker<OrderPtr>::display_qty() const
+{
+  return iceberg() ? order_->display_qty() : 0;
+}
+
+template <class OrderPtr>
+inline bool
+OrderTracker<OrderPtr>::iceberg() const
+{
+  return (conditions_ & oc_iceberg) != 0;
+}
+
+template <class OrderPtr>
+inline void
+OrderTracker<OrderPtr>::display()
+{
+  // Only an iceberg reads its display quantity from the order
+  Quantity shown_qty = iceberg() ? order_->display_qty() : 0;
+  hidden_qty_ = (shown_qty && open_qty_ > shown_qty) ?
+                open_qty_ - shown_qty : 0;
+}
+
+template <class OrderPtr>
+inline Quantity
+OrderTracker<OrderPtr>::order_qty() const
+{
+  return order_qty_;
+}
+
+template <class OrderPtr>
+inline Price
+OrderTracker<OrderPtr>::price() const
+{
+  return price_;
+}
+
+template <class OrderPtr>
+inline bool
+OrderTracker<OrderPtr>::is_buy() const
+{
+  return (conditions_ & buy_condition) != 0;
+}
+
 template <class OrderPtr>
 inline const OrderPtr&
 OrderTracker<OrderPtr>::ptr() const
@@ -266,15 +602,28 @@ OrderTracker<OrderPtr>::immediate_or_cancel() const
   return bool((conditions_ & oc_immediate_or_cancel) != 0);
 }
 
+template <class OrderPtr>
+inline OrderConditions
+OrderTracker<OrderPtr>::conditions() const
+{
+  return conditions_ & ~buy_condition;
+}
+
 template <class OrderPtr>
 OrderBook<OrderPtr>::OrderBook()
 : book_listener_(NULL),
   order_listener_(NULL),
-  trans_id_(0)
+  trans_id_(0),
+  market_price_(0)
 {
   callbacks_.reserve(16);
 }
 
+template <class OrderPtr>
+OrderBook<OrderPtr>::~OrderBook()
+{
+}
+
 template <class OrderPtr>
 inline bool
 OrderBook<OrderPtr>::add(const OrderPtr& order, OrderConditions conditions)
@@ -289,21 +638,71 @@ OrderBook<OrderPtr>::add(const OrderPtr& order, OrderConditions conditions)
     // reject created by is_valid
   } else {
     callbacks_.push_back(TypedCallback::accept(order, trans_id_));
-    TypedCallback& accept_cb = callbacks_.back();
+    // Callbacks may be reallocated while matching, so note the position
+    Tracker inbound(order, conditions);
+    matched = add_inbound(inbound, callbacks_.size() - 1);
+  }
+  return matched;
+}
 
-    Price order_price = sort_price(order);
+#ifdef LIQUIBOOK_HAS_MOVE
+template <class OrderPtr>
+inline bool
+OrderBook<OrderPtr>::add(OrderPtr&& order, OrderConditions conditions)
+{
+  // Increment transacion ID
+  ++trans_id_;  
 
-    Tracker inbound(order, conditions);
-    matched = add_order(inbound, order_price);
-    if (matched) {
-      // Note the filled qty in the callback
-      accept_cb.match_qty = inbound.filled_qty();
-    }
-    // Cancel any unfilled IOC order
-    if (inbound.immediate_or_cancel() && !inbound.filled()) {
-      callbacks_.push_back(TypedCallback::cancel(order, trans_id_));
+  bool matched = false;
+
+  // If the order is invalid, exit
+  if (!is_valid(order, conditions)) {
+    // reject created by is_valid
+  } else {
+    callbacks_.push_back(TypedCallback::accept(order, trans_id_));
+    // Callbacks may be reallocated while matching, so note the position
+    Tracker inbound(std::move(order), conditions);
+    matched = add_inbound(inbound, callbacks_.size() - 1);
+  }
+  return matched;
+}
+#endif
+
+template <class OrderPtr>
+inline bool
+OrderBook<OrderPtr>::add_inbound(Tracker& inbound, size_t accept_cb_index)
+{
+  Price order_price = sort_price(inbound.ptr());
+
+  // Hold a stop order until triggered
+  if (inbound.conditions() & oc_stop) {
+    Price stop_price = inbound.ptr()->stop_price();
+    if (!stop_triggered(stop_price, inbound.is_buy())) {
+      if (inbound.is_buy()) {
+        buy_stops_.insert(typename BuyStops::value_type(
+            stop_price, LIQUIBOOK_MOVE(inbound)));
+      } else {
+        sell_stops_.insert(typename SellStops::value_type(
+            stop_price, LIQUIBOOK_MOVE(inbound)));
+      }
+      return false;
     }
   }
+  bool matched = add_order(inbound, order_price);
+  if (matched) {
+    // Note the filled qty in the callback
+    callbacks_[accept_cb_index].match_qty = inbound.filled_qty();
+  }
+  // Cancel any unfilled IOC order.  It never rests, so the callback takes
+  // its pointer.
+  if (inbound.immediate_or_cancel() && !inbound.filled()) {
+    callbacks_.push_back(TypedCallback::cancel(LIQUIBOOK_MOVE(inbound.ptr()),
+                                               trans_id_));
+  }
+  // The trades may have triggered stop orders
+  if (matched) {
+    trigger_stops();
+  }
   return matched;
 }
 
@@ -321,8 +720,22 @@ OrderBook<OrderPtr>::cancel(const OrderPtr& order)
     find_bid(order, bid);
     if (bid != bids_.end()) {
       // Remove from container for cancel
+      update_level(bid->first, -1, -(int32_t)bid->second.visible_qty(),
+                   true);
       bids_.erase(bid);
       found = true;
+    // Else it may be a stop order not yet triggered
+    } else if (!buy_stops_.empty()) {
+      Price stop_price = order->stop_price();
+      typename BuyStops::iterator stop;
+      for (stop = buy_stops_.find(stop_price);
+           stop != buy_stops_.end() && stop->first == stop_price; ++stop) {
+        if (stop->second.ptr() == order) {
+          buy_stops_.erase(stop);
+          found = true;
+          break;
+        }
+      }
     }
   // Else the cancel is a sell order
   } else {
@@ -330,8 +743,22 @@ OrderBook<OrderPtr>::cancel(const OrderPtr& order)
     find_ask(order, ask);
     if (ask != asks_.end()) {
       // Remove from container for cancel
+      update_level(ask->first, -1, -(int32_t)ask->second.visible_qty(),
+                   false);
       asks_.erase(ask);
       found = true;
+    // Else it may be a stop order not yet triggered
+    } else if (!sell_stops_.empty()) {
+      Price stop_price = order->stop_price();
+      typename SellStops::iterator stop;
+      for (stop = sell_stops_.find(stop_price);
+           stop != sell_stops_.end() && stop->first == stop_price; ++stop) {
+        if (stop->second.ptr() == order) {
+          sell_stops_.erase(stop);
+          found = true;
+          break;
+        }
+      }
     }
   } 
   // If the cancel was found, issue callback
@@ -358,8 +785,6 @@ OrderBook<OrderPtr>::replace(
   bool price_change = new_price && (new_price != order->price());
 
   Price price = (new_price == PRICE_UNCHANGED) ? order->price() : new_price;
-  // TODO can we use value in tracker?
-  Quantity new_order_qty = order->order_qty() + size_delta;
 
   // If the order to replace is a buy order
   if (order->is_buy()) {
@@ -370,19 +795,27 @@ OrderBook<OrderPtr>::replace(
       found = true;
       // If this is a valid replace
       if (is_valid_replace(bid->second, size_delta, new_price)) {
+        Quantity new_order_qty = bid->second.order_qty() + size_delta;
         // Accept the replace
         callbacks_.push_back(
             TypedCallback::replace(order, new_order_qty, price, trans_id_));
-        Quantity new_open_qty = bid->second.open_qty() + size_delta;
+        Quantity old_open_qty = bid->second.open_qty();
+        Quantity old_visible_qty = bid->second.visible_qty();
+        Quantity new_open_qty = old_open_qty + size_delta;
         bid->second.change_qty(size_delta);  // Update my copy
+        bid->second.change_price(price);
         // If the size change will close the order
         if (!new_open_qty) {
           callbacks_.push_back(TypedCallback::cancel(order, trans_id_));
+          update_level(bid->first, -1, -(int32_t)old_visible_qty, true);
           bids_.erase(bid); // Remove order
         // Else rematch the new order - there could be a price change
         // or size change - that could cause all or none match
         } else {
           matched = add_order(bid->second, price); // Add order
+          // Remove old quantity after adding new, so an unchanged price
+          // level is never emptied
+          update_level(bid->first, -1, -(int32_t)old_visible_qty, true);
           bids_.erase(bid); // Remove order
         }
       }
@@ -396,30 +829,48 @@ OrderBook<OrderPtr>::replace(
       found = true;
       // If this is a valid replace
       if (is_valid_replace(ask->second, size_delta, new_price)) {
+        Quantity new_order_qty = ask->second.order_qty() + size_delta;
         // Accept the replace
         callbacks_.push_back(
             TypedCallback::replace(order, new_order_qty, price, trans_id_));
-        Quantity new_open_qty = ask->second.open_qty() + size_delta;
+        Quantity old_open_qty = ask->second.open_qty();
+        Quantity old_visible_qty = ask->second.visible_qty();
+        Quantity new_open_qty = old_open_qty + size_delta;
         ask->second.change_qty(size_delta);  // Update my copy
+        ask->second.change_price(price);
         // If the size change will close the order
         if (!new_open_qty) {
           callbacks_.push_back(TypedCallback::cancel(order, trans_id_));
+          update_level(ask->first, -1, -(int32_t)old_visible_qty, false);
           asks_.erase(ask); // Remove order
         // Else rematch the new order if there is a price change or the order
-        // is all or none (for which a size change could cause it to match)
-        } else if (price_change || ask->second.all_or_none()) {
+        // is all or none (for which a size change could cause it to match),
+        // or is an iceberg (which shows its display quantity anew)
+        } else if (price_change || ask->second.all_or_none() ||
+                   ask->second.iceberg()) {
           matched = add_order(ask->second, price); // Add order
+          // Remove old quantity after adding new, so an unchanged price
+          // level is never emptied
+          update_level(ask->first, -1, -(int32_t)old_visible_qty, false);
           asks_.erase(ask); // Remove order
+        // Else the order keeps its place, only the level quantity changes
+        } else {
+          update_level(ask->first, 0, size_delta, false);
         }
       }
     } 
+  }
 
-    if (!found) {
-      callbacks_.push_back(
-          TypedCallback::replace_reject(order, "not found", trans_id_));
-    }
+  // A stop order not yet triggered is not found, so cannot be replaced
+  if (!found) {
+    callbacks_.push_back(
+        TypedCallback::replace_reject(order, "not found", trans_id_));
   }
 
+  // The trades may have triggered stop orders
+  if (matched) {
+    trigger_stops();
+  }
   return matched;
 }
 
@@ -445,7 +896,7 @@ OrderBook<OrderPtr>::match_order(Tracker& inbound,
       // If the inbound order is an all or none order
       if (inbound.all_or_none()) {
         // Track how much of the inbound order has been matched
-        matched_qty += bid->second.ptr()->open_qty();
+        matched_qty += bid->second.visible_qty();
         // If we have matched enough quantity to fill the inbound order
         if (matched_qty >= inbound_qty) {
           matched =  true;
@@ -455,11 +906,15 @@ OrderBook<OrderPtr>::match_order(Tracker& inbound,
           for (dbc = deferred_bid_crosses_.begin(); 
                dbc != deferred_bid_crosses_.end(); ++dbc) {
             // Adjust tracking values for cross
-            cross_orders(inbound, (*dbc)->second);
+            bool replenished = cross_orders(inbound, (*dbc)->second,
+                                            (*dbc)->first, true);
 
             // If the existing order was filled, remove it
             if ((*dbc)->second.filled()) {
               bids.erase(*dbc);
+            // Else if an iceberg order showed more, requeue it
+            } else if (replenished) {
+              requeue(bids, *dbc);
             }
           }
         // Else we have to defer crossing this order
@@ -473,11 +928,15 @@ OrderBook<OrderPtr>::match_order(Tracker& inbound,
 
       if (matched) {
         // Adjust tracking values for cross
-        cross_orders(inbound, bid->second);
+        bool replenished = cross_orders(inbound, bid->second, bid->first,
+                                        true);
 
         // If the existing order was filled, remove it
         if (bid->second.filled()) {
           bids.erase(bid++);
+        // Else if an iceberg order showed more, requeue it
+        } else if (replenished) {
+          bid = requeue(bids, bid);
         } else {
           ++bid;
         }
@@ -520,7 +979,7 @@ OrderBook<OrderPtr>::match_order(Tracker& inbound,
       // If the inbound order is an all or none order
       if (inbound.all_or_none()) {
         // Track how much of the inbound order has been matched
-        matched_qty += ask->second.ptr()->open_qty();
+        matched_qty += ask->second.visible_qty();
         // If we have matched enough quantity to fill the inbound order
         if (matched_qty >= inbound_qty) {
           matched =  true;
@@ -530,11 +989,15 @@ OrderBook<OrderPtr>::match_order(Tracker& inbound,
           for (dac = deferred_ask_crosses_.begin(); 
                dac != deferred_ask_crosses_.end(); ++dac) {
             // Adjust tracking values for cross
-            cross_orders(inbound, (*dac)->second);
+            bool replenished = cross_orders(inbound, (*dac)->second,
+                                            (*dac)->first, false);
 
             // If the existing order was filled, remove it
             if ((*dac)->second.filled()) {
               asks.erase(*dac);
+            // Else if an iceberg order showed more, requeue it
+            } else if (replenished) {
+              requeue(asks, *dac);
             }
           }
         // Else we have to defer crossing this order
@@ -548,11 +1011,15 @@ OrderBook<OrderPtr>::match_order(Tracker& inbound,
 
       if (matched) {
         // Adjust tracking values for cross
-        cross_orders(inbound, ask->second);
+        bool replenished = cross_orders(inbound, ask->second, ask->first,
+                                        false);
 
         // If the existing order was filled, remove it
         if (ask->second.filled()) {
           asks.erase(ask++);
+        // Else if an iceberg order showed more, requeue it
+        } else if (replenished) {
+          ask = requeue(asks, ask);
         } else {
           ++ask;
         }
@@ -573,25 +1040,140 @@ OrderBook<OrderPtr>::match_order(Tracker& inbound,
 }
 
 template <class OrderPtr>
-inline void
+inline bool
 OrderBook<OrderPtr>::cross_orders(Tracker& inbound_tracker, 
-                                  Tracker& current_tracker)
+                                  Tracker& current_tracker,
+                                  Price current_price,
+                                  bool current_is_bid)
 {
+  // Only the quantity shown by the current order is filled
   Quantity fill_qty = std::min(inbound_tracker.open_qty(), 
-                               current_tracker.open_qty());
-  Price cross_price = current_tracker.ptr()->price();
+                               current_tracker.visible_qty());
+  Price cross_price = current_tracker.price();
   // If current order is a market order, cross at inbound price
   if (MARKET_ORDER_PRICE == cross_price) {
-    cross_price = inbound_tracker.ptr()->price();
+    cross_price = inbound_tracker.price();
   }
   
+  // Stop orders are triggered by the trade price
+  if (MARKET_ORDER_PRICE != cross_price) {
+    market_price_ = cross_price;
+  }
+
   inbound_tracker.fill(fill_qty);
   current_tracker.fill(fill_qty);
-  callbacks_.push_back(TypedCallback::fill(inbound_tracker.ptr(),
-                                           current_tracker.ptr(),
-                                           fill_qty,
-                                           cross_price,
-                                           trans_id_));
+  // An iceberg order shows more once all it showed is filled
+  Quantity shown_qty = 0;
+  if (!current_tracker.visible_qty() && current_tracker.hidden_qty()) {
+    current_tracker.display();
+    shown_qty = current_tracker.visible_qty();
+  }
+  // Only the current order rests in the book, the inbound is not yet added
+  update_level(current_price, 
+               current_tracker.filled() ? -1 : 0, 
+               (int32_t)shown_qty - (int32_t)fill_qty,
+               current_is_bid);
+  // A filled current order leaves the book, so the callback takes its pointer
+  if (current_tracker.filled()) {
+    callbacks_.push_back(TypedCallback::fill(
+        inbound_tracker.ptr(), LIQUIBOOK_MOVE(current_tracker.ptr()),
+        fill_qty, cross_price, trans_id_));
+  } else {
+    callbacks_.push_back(TypedCallback::fill(inbound_tracker.ptr(),
+                                             current_tracker.ptr(),
+                                             fill_qty,
+                                             cross_price,
+                                             trans_id_));
+  }
+  return shown_qty != 0;
+}
+
+template <class OrderPtr>
+inline void
+OrderBook<OrderPtr>::trigger_stops()
+{
+  // Stops are sorted by trigger price, so only those triggered are visited.
+  // An order triggered may trade, moving the market price to trigger more.
+  while (true) {
+    typename BuyStops::iterator buy = buy_stops_.begin();
+    typename SellStops::iterator sell = sell_stops_.begin();
+    bool is_buy;
+    if (buy != buy_stops_.end() && stop_triggered(buy->first, true)) {
+      is_buy = true;
+    } else if (sell != sell_stops_.end() &&
+               stop_triggered(sell->first, false)) {
+      is_buy = false;
+    } else {
+      break;
+    }
+    Tracker inbound(LIQUIBOOK_MOVE(is_buy ? buy->second : sell->second));
+    if (is_buy) {
+      buy_stops_.erase(buy);
+    } else {
+      sell_stops_.erase(sell);
+    }
+    // The order is added as it would have been without the stop
+    add_order(inbound, sort_price(inbound.ptr()));
+    // Cancel any unfilled IOC order
+    if (inbound.immediate_or_cancel() && !inbound.filled()) {
+      callbacks_.push_back(TypedCallback::cancel(
+          LIQUIBOOK_MOVE(inbound.ptr()), trans_id_));
+    }
+  }
+}
+
+template <class OrderPtr>
+inline bool
+OrderBook<OrderPtr>::populate_bid_depth_level_after(
+  const Price& price,
+  DepthLevel& level) const
+{
+  typename BidLevels::const_iterator bid = bid_levels_.upper_bound(price);
+  if (bid != bid_levels_.end()) {
+    level = bid->second;
+    return true;
+  }
+  level.init(INVALID_LEVEL_PRICE, false);
+  return false;
+}
+
+template <class OrderPtr>
+inline bool
+OrderBook<OrderPtr>::populate_ask_depth_level_after(
+  const Price& price,
+  DepthLevel& level) const
+{
+  typename AskLevels::const_iterator ask = ask_levels_.upper_bound(price);
+  if (ask != ask_levels_.end()) {
+    level = ask->second;
+    return true;
+  }
+  level.init(INVALID_LEVEL_PRICE, false);
+  return false;
+}
+
+template <class OrderPtr>
+template <int SIZE>
+inline void
+OrderBook<OrderPtr>::populate_depth(Depth<SIZE>& depth) const
+{
+  depth.restore(bid_levels_.begin(), bid_levels_.end(),
+                ask_levels_.begin(), ask_levels_.end());
+}
+
+template <class OrderPtr>
+inline void
+OrderBook<OrderPtr>::on_level_change(const DepthLevel& , 
+                                     int32_t ,
+                                     int32_t ,
+                                     bool )
+{
+}
+
+template <class OrderPtr>
+inline void
+OrderBook<OrderPtr>::on_restore()
+{
 }
 
 template <class OrderPtr>
@@ -605,6 +1187,13 @@ OrderBook<OrderPtr>::perform_callbacks()
   callbacks_.erase(callbacks_.begin(), callbacks_.end());
 }
 
+template <class OrderPtr>
+inline void
+OrderBook<OrderPtr>::discard_callbacks()
+{
+  callbacks_.clear();
+}
+
 template <class OrderPtr>
 inline void
 OrderBook<OrderPtr>::perform_callback(TypedCallback& cb)
@@ -664,13 +1253,90 @@ OrderBook<OrderPtr>::log() const
   }
 }
 
+template <class OrderPtr>
+inline void
+OrderBook<OrderPtr>::restore_order(const Tracker& tracker)
+{
+  Price price = tracker.price();
+  // Insert after any orders at the price, keeping priority
+  if (tracker.is_buy()) {
+    if (MARKET_ORDER_PRICE == price) {
+      price = MARKET_ORDER_BID_SORT_PRICE;
+    }
+    bids_.insert(typename Bids::value_type(price, tracker));
+  } else {
+    if (MARKET_ORDER_PRICE == price) {
+      price = MARKET_ORDER_ASK_SORT_PRICE;
+    }
+    asks_.insert(typename Asks::value_type(price, tracker));
+  }
+}
+
+template <class OrderPtr>
+inline void
+OrderBook<OrderPtr>::restore_stop(const Tracker& tracker, Price stop_price)
+{
+  if (tracker.is_buy()) {
+    buy_stops_.insert(typename BuyStops::value_type(stop_price, tracker));
+  } else {
+    sell_stops_.insert(typename SellStops::value_type(stop_price, tracker));
+  }
+}
+
+template <class OrderPtr>
+inline void
+OrderBook<OrderPtr>::restore_level(const DepthLevel& level, bool is_bid)
+{
+  if (is_bid) {
+    bid_levels_.insert(std::make_pair(level.price(), level));
+  } else {
+    ask_levels_.insert(std::make_pair(level.price(), level));
+  }
+}
+
+template <class OrderPtr>
+inline void
+OrderBook<OrderPtr>::restored(TransId trans_id, Price market_price)
+{
+  trans_id_ = trans_id;
+  market_price_ = market_price;
+  on_restore();
+}
+
+template <class OrderPtr>
+inline void
+OrderBook<OrderPtr>::apply_level_change(
+  Price price,
+  int32_t count_delta,
+  int32_t qty_delta,
+  bool is_bid)
+{
+  ++trans_id_;
+  update_level(price, count_delta, qty_delta, is_bid);
+}
+
 template <class OrderPtr>
 inline bool
-OrderBook<OrderPtr>::is_valid(const OrderPtr& order, OrderConditions )
+OrderBook<OrderPtr>::is_valid(const OrderPtr& order,
+                              OrderConditions conditions)
 {
   if (order->order_qty() == 0) {
     callbacks_.push_back(TypedCallback::reject(order, "size must be positive", trans_id_));
     return false;
+  } else if ((conditions & oc_stop) && !order->stop_price()) {
+    callbacks_.push_back(
+        TypedCallback::reject(order, "stop price must be positive", trans_id_));
+    return false;
+  } else if ((conditions & oc_iceberg) && !order->display_qty()) {
+    callbacks_.push_back(
+        TypedCallback::reject(order, "display qty must be positive",
+                              trans_id_));
+    return false;
+  } else if ((conditions & oc_iceberg) && (conditions & oc_all_or_none)) {
+    callbacks_.push_back(
+        TypedCallback::reject(order, "iceberg cannot be all or none",
+                              trans_id_));
+    return false;
   } else {
     return true;
   }
@@ -710,6 +1376,7 @@ OrderBook<OrderPtr>::find_bid(
       break;
     // Else if this bid's price is too low to match the search price
     } else if (result->first < search_price) {
+      result = bids_.end();
       break; // No more possible
     }
   }
@@ -729,6 +1396,7 @@ OrderBook<OrderPtr>::find_ask(
       break;
     // Else if this ask's price is too high to match the search price
     } else if (result->first > search_price) {
+      result = asks_.end();
       break; // No more possible
     }
   }
@@ -746,15 +1414,25 @@ OrderBook<OrderPtr>::sort_price(const OrderPtr& order)
   return result_price;
 }
 
+template <class OrderPtr>
+inline bool
+OrderBook<OrderPtr>::stop_triggered(Price stop_price, bool is_buy) const
+{
+  // Nothing is triggered before the first trade
+  if (!market_price_) {
+    return false;
+  }
+  return is_buy ? market_price_ >= stop_price : market_price_ <= stop_price;
+}
+
 template <class OrderPtr>
 inline bool
 OrderBook<OrderPtr>::add_order(Tracker& inbound, Price order_price)
 {
   bool matched = false;
-  OrderPtr& order = inbound.ptr();
 
   // Try to match with current orders
-  if (order->is_buy()) {
+  if (inbound.is_buy()) {
     matched = match_order(inbound, order_price, asks_);
   } else {
     matched = match_order(inbound, order_price, bids_);
@@ -762,19 +1440,96 @@ OrderBook<OrderPtr>::add_order(Tracker& inbound, Price order_price)
 
   // If order has remaining open quantity and is not immediate or cancel
   if (inbound.open_qty() && !inbound.immediate_or_cancel()) {
+    // An iceberg order rests showing only its display quantity
+    inbound.display();
+    // The tracker is moved into the book, leaving only its quantities 
+    // and conditions for the caller
+    Quantity visible_qty = inbound.visible_qty();
     // If this is a buy order
-    if (order->is_buy()) {
+    if (inbound.is_buy()) {
       // Insert into bids
-      bids_.insert(std::make_pair(order_price, inbound));
+      bids_.insert(typename Bids::value_type(order_price, 
+                                             LIQUIBOOK_MOVE(inbound)));
+      update_level(order_price, 1, visible_qty, true);
     // Else this is a sell order
     } else {
       // Insert into asks
-      asks_.insert(std::make_pair(order_price, inbound));
+      asks_.insert(typename Asks::value_type(order_price, 
+                                             LIQUIBOOK_MOVE(inbound)));
+      update_level(order_price, 1, visible_qty, false);
     }
   }
   return matched;
 }
 
+template <class OrderPtr>
+template <class Orders>
+inline typename Orders::iterator
+OrderBook<OrderPtr>::requeue(Orders& orders, typename Orders::iterator order)
+{
+  // If already last at its price, the order need not move, and is matched
+  // again in place
+  if (orders.last_of_price(order)) {
+    return order;
+  }
+  // Relink the order at the back of the queue of its price
+  return orders.move_to_back(order);
+}
+
+template <class OrderPtr>
+inline void
+OrderBook<OrderPtr>::update_level(
+  Price price, 
+  int32_t count_delta, 
+  int32_t qty_delta, 
+  bool is_bid)
+{
+  // Market orders are not aggregated
+  if (price == MARKET_ORDER_BID_SORT_PRICE || 
+      price == MARKET_ORDER_ASK_SORT_PRICE) {
+    return;
+  }
+  if (is_bid) {
+    update_level(bid_levels_, price, count_delta, qty_delta, true);
+  } else {
+    update_level(ask_levels_, price, count_delta, qty_delta, false);
+  }
+}
+
+template <class OrderPtr>
+template <class Levels>
+inline void
+OrderBook<OrderPtr>::update_level(
+  Levels& levels,
+  Price price, 
+  int32_t count_delta, 
+  int32_t qty_delta, 
+  bool is_bid)
+{
+  typename Levels::iterator level = levels.lower_bound(price);
+  // If there is no level at this price, insert one
+  if (level == levels.end() || level->first != price) {
+    level = levels.insert(level, std::make_pair(price, DepthLevel()));
+    level->second.init(price, false);
+  }
+  bool emptied = false;
+  if (count_delta > 0) {
+    level->second.add_order(Quantity(qty_delta));
+  } else if (count_delta < 0) {
+    emptied = level->second.close_order(Quantity(-qty_delta));
+  } else if (qty_delta > 0) {
+    level->second.increase_qty(Quantity(qty_delta));
+  } else {
+    level->second.decrease_qty(Quantity(-qty_delta));
+  }
+  level->second.last_change(trans_id_);
+  on_level_change(level->second, count_delta, qty_delta, is_bid);
+  // Remove the level once the last order has left it
+  if (emptied) {
+    levels.erase(level);
+  }
+}
+
 template <class OrderPtr>
 inline bool
 OrderBook<OrderPtr>::matches(
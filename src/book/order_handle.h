@@ -0,0 +1,134 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef order_handle_h
+#define order_handle_h
+
+#include "types.h"
+#include <stddef.h>
+
+namespace liquibook { namespace book {
+
+/// @brief value of a handle to no order
+const uint32_t INVALID_ORDER_HANDLE(0xFFFFFFFF);
+
+/// @brief a 32 bit handle to an order kept in a store, for use as the
+///   OrderPtr of an OrderBook in place of a pointer.  Halves the size of
+///   the order reference kept by each OrderTracker, so more resting orders
+///   fit each cache line.  The store is a class supplying:
+///     typedef <order class> OrderType;
+///     static OrderType& order(uint32_t index);
+template <class OrderStore>
+class OrderHandle {
+  typedef uint32_t OrderHandle::*unspecified_bool_type;
+public:
+  typedef typename OrderStore::OrderType OrderType;
+
+  /// @brief construct a handle to no order
+  OrderHandle();
+
+  /// @brief construct a handle to an order in the store
+  /// @param index the index of the order in the store
+  explicit OrderHandle(uint32_t index);
+
+  /// @brief get the index of the order in the store
+  uint32_t index() const;
+
+  /// @brief does this handle refer to an order?
+  bool valid() const;
+
+  /// @brief test a handle like a pointer, true if it refers to an order
+  operator unspecified_bool_type() const;
+
+  /// @brief access the order
+  OrderType* operator->() const;
+
+  /// @brief access the order
+  OrderType& operator*() const;
+
+  /// @brief do the handles refer to the same order?
+  bool operator==(const OrderHandle& rhs) const;
+
+  /// @brief do the handles refer to different orders?
+  bool operator!=(const OrderHandle& rhs) const;
+
+  /// @brief order handles, for ordered containers
+  bool operator<(const OrderHandle& rhs) const;
+
+private:
+  uint32_t index_;
+};
+
+template <class OrderStore>
+inline
+OrderHandle<OrderStore>::OrderHandle()
+: index_(INVALID_ORDER_HANDLE)
+{
+}
+
+template <class OrderStore>
+inline
+OrderHandle<OrderStore>::OrderHandle(uint32_t index)
+: index_(index)
+{
+}
+
+template <class OrderStore>
+inline uint32_t
+OrderHandle<OrderStore>::index() const
+{
+  return index_;
+}
+
+template <class OrderStore>
+inline bool
+OrderHandle<OrderStore>::valid() const
+{
+  return index_ != INVALID_ORDER_HANDLE;
+}
+
+template <class OrderStore>
+inline
+OrderHandle<OrderStore>::operator unspecified_bool_type() const
+{
+  return valid() ? &OrderHandle::index_ : NULL;
+}
+
+template <class OrderStore>
+inline typename OrderHandle<OrderStore>::OrderType*
+OrderHandle<OrderStore>::operator->() const
+{
+  return &OrderStore::order(index_);
+}
+
+template <class OrderStore>
+inline typename OrderHandle<OrderStore>::OrderType&
+OrderHandle<OrderStore>::operator*() const
+{
+  return OrderStore::order(index_);
+}
+
+template <class OrderStore>
+inline bool
+OrderHandle<OrderStore>::operator==(const OrderHandle& rhs) const
+{
+  return index_ == rhs.index_;
+}
+
+template <class OrderStore>
+inline bool
+OrderHandle<OrderStore>::operator!=(const OrderHandle& rhs) const
+{
+  return index_ != rhs.index_;
+}
+
+template <class OrderStore>
+inline bool
+OrderHandle<OrderStore>::operator<(const OrderHandle& rhs) const
+{
+  return index_ < rhs.index_;
+}
+
+} }
+
+#endif
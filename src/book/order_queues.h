@@ -0,0 +1,384 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef order_queues_h
+#define order_queues_h
+
+#include "types.h"
+#include <cstddef>
+#include <iterator>
+#include <list>
+#include <map>
+#include <utility>
+
+namespace liquibook { namespace book {
+
+/// @brief the orders of one side of a book, in priority order: a queue of
+///        the orders of each price, in time priority, with the queues in
+///        price priority.  Iterates like a multimap of price to order, but
+///        an order is moved to the back of its queue in constant time, by
+///        relinking its node, as when an iceberg order shows more of its
+///        quantity.  Iterators of other orders remain valid as orders are
+///        inserted, erased and moved.
+template <class Tracker, class Compare>
+class OrderQueues {
+public:
+  typedef Price key_type;
+  typedef Tracker mapped_type;
+  typedef std::pair<const Price, Tracker> value_type;
+  typedef std::size_t size_type;
+
+private:
+  typedef std::list<value_type> Queue;
+  typedef std::map<Price, Queue, Compare> Queues;
+
+  /// @brief iterator over every order of every queue
+  template <class Value, class QueueIter, class OrderIter>
+  class Iter {
+  public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef std::pair<const Price, Tracker> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Value* pointer;
+    typedef Value& reference;
+
+    Iter() : queue_(), order_(), end_() {}
+    Iter(QueueIter queue, OrderIter order, QueueIter end)
+    : queue_(queue), order_(order), end_(end) {}
+    /// @brief convert an iterator to a const_iterator
+    template <class V, class Q, class O>
+    Iter(const Iter<V, Q, O>& rhs)
+    : queue_(rhs.queue_), order_(rhs.order_), end_(rhs.end_) {}
+
+    reference operator*() const { return *order_; }
+    pointer operator->() const { return &*order_; }
+
+    Iter& operator++()
+    {
+      if (++order_ == queue_->second.end()) {
+        ++queue_;
+        order_ = (queue_ == end_) ? OrderIter() : queue_->second.begin();
+      }
+      return *this;
+    }
+    Iter operator++(int) { Iter result(*this); ++*this; return result; }
+
+    Iter& operator--()
+    {
+      if (queue_ == end_ || order_ == queue_->second.begin()) {
+        --queue_;
+        order_ = queue_->second.end();
+      }
+      --order_;
+      return *this;
+    }
+    Iter operator--(int) { Iter result(*this); --*this; return result; }
+
+    /// @brief the end iterator has no order, so only the queues compare
+    template <class V, class Q, class O>
+    bool operator==(const Iter<V, Q, O>& rhs) const
+    {
+      return queue_ == rhs.queue_ && (queue_ == end_ || order_ == rhs.order_);
+    }
+    template <class V, class Q, class O>
+    bool operator!=(const Iter<V, Q, O>& rhs) const
+    {
+      return !(*this == rhs);
+    }
+
+  private:
+    template <class V, class Q, class O> friend class Iter;
+    friend class OrderQueues;
+    QueueIter queue_;
+    OrderIter order_;
+    QueueIter end_;
+  };
+
+public:
+  typedef Iter<value_type,
+               typename Queues::iterator,
+               typename Queue::iterator> iterator;
+  typedef Iter<const value_type,
+               typename Queues::const_iterator,
+               typename Queue::const_iterator> const_iterator;
+  typedef std::reverse_iterator<iterator> reverse_iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+  /// @brief construct empty
+  OrderQueues();
+
+  /// @brief get the number of orders
+  size_type size() const;
+
+  /// @brief are there no orders?
+  bool empty() const;
+
+  /// @brief insert an order behind the others of its price
+  /// @return the order inserted
+  iterator insert(const value_type& value);
+#ifdef LIQUIBOOK_HAS_MOVE
+  iterator insert(value_type&& value);
+#endif
+
+  /// @brief erase an order
+  /// @return the order after it
+  iterator erase(iterator order);
+
+  /// @brief move an order behind the others of its price, in constant time
+  /// @return the order which was after it
+  iterator move_to_back(iterator order);
+
+  /// @brief is an order the last of its price?
+  bool last_of_price(const_iterator order) const;
+
+  /// @brief find the first order of a price
+  /// @return the order, or end() if there are none of the price
+  iterator find(Price price);
+  const_iterator find(Price price) const;
+
+  /// @brief find the first order of a price, or of the next price after it
+  iterator lower_bound(Price price);
+  const_iterator lower_bound(Price price) const;
+
+  /// @brief find the first order of the next price after a price
+  iterator upper_bound(Price price);
+  const_iterator upper_bound(Price price) const;
+
+  iterator begin();
+  const_iterator begin() const;
+  iterator end();
+  const_iterator end() const;
+  reverse_iterator rbegin();
+  const_reverse_iterator rbegin() const;
+  reverse_iterator rend();
+  const_reverse_iterator rend() const;
+
+private:
+  /// @brief get the queue of a price, creating it if need be
+  Queue& queue(Price price, typename Queues::iterator& result);
+
+  /// @brief get the first order of a queue
+  iterator first(typename Queues::iterator price_queue);
+  const_iterator first(typename Queues::const_iterator price_queue) const;
+
+  Queues queues_;
+  size_type size_;
+};
+
+template <class Tracker, class Compare>
+OrderQueues<Tracker, Compare>::OrderQueues()
+: size_(0)
+{
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::size_type
+OrderQueues<Tracker, Compare>::size() const
+{
+  return size_;
+}
+
+template <class Tracker, class Compare>
+inline bool
+OrderQueues<Tracker, Compare>::empty() const
+{
+  return !size_;
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::Queue&
+OrderQueues<Tracker, Compare>::queue(
+  Price price,
+  typename Queues::iterator& result)
+{
+  result = queues_.lower_bound(price);
+  if (result == queues_.end() || queues_.key_comp()(price, result->first)) {
+    result = queues_.insert(result, typename Queues::value_type(price,
+                                                                Queue()));
+  }
+  return result->second;
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::iterator
+OrderQueues<Tracker, Compare>::insert(const value_type& value)
+{
+  typename Queues::iterator price_queue;
+  Queue& orders = queue(value.first, price_queue);
+  typename Queue::iterator order = orders.insert(orders.end(), value);
+  ++size_;
+  return iterator(price_queue, order, queues_.end());
+}
+
+#ifdef LIQUIBOOK_HAS_MOVE
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::iterator
+OrderQueues<Tracker, Compare>::insert(value_type&& value)
+{
+  typename Queues::iterator price_queue;
+  Queue& orders = queue(value.first, price_queue);
+  typename Queue::iterator order = orders.insert(orders.end(),
+                                                 std::move(value));
+  ++size_;
+  return iterator(price_queue, order, queues_.end());
+}
+#endif
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::iterator
+OrderQueues<Tracker, Compare>::erase(iterator order)
+{
+  iterator next = order;
+  ++next;
+  order.queue_->second.erase(order.order_);
+  // Only queues with orders are kept, so each is visited while iterating
+  if (order.queue_->second.empty()) {
+    queues_.erase(order.queue_);
+  }
+  --size_;
+  return next;
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::iterator
+OrderQueues<Tracker, Compare>::move_to_back(iterator order)
+{
+  iterator next = order;
+  ++next;
+  Queue& orders = order.queue_->second;
+  orders.splice(orders.end(), orders, order.order_);
+  return next;
+}
+
+template <class Tracker, class Compare>
+inline bool
+OrderQueues<Tracker, Compare>::last_of_price(const_iterator order) const
+{
+  typename Queue::const_iterator next = order.order_;
+  return ++next == order.queue_->second.end();
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::iterator
+OrderQueues<Tracker, Compare>::find(Price price)
+{
+  return first(queues_.find(price));
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::const_iterator
+OrderQueues<Tracker, Compare>::find(Price price) const
+{
+  return first(queues_.find(price));
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::iterator
+OrderQueues<Tracker, Compare>::lower_bound(Price price)
+{
+  return first(queues_.lower_bound(price));
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::const_iterator
+OrderQueues<Tracker, Compare>::lower_bound(Price price) const
+{
+  return first(queues_.lower_bound(price));
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::iterator
+OrderQueues<Tracker, Compare>::upper_bound(Price price)
+{
+  return first(queues_.upper_bound(price));
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::const_iterator
+OrderQueues<Tracker, Compare>::upper_bound(Price price) const
+{
+  return first(queues_.upper_bound(price));
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::iterator
+OrderQueues<Tracker, Compare>::begin()
+{
+  return first(queues_.begin());
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::const_iterator
+OrderQueues<Tracker, Compare>::begin() const
+{
+  return first(queues_.begin());
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::iterator
+OrderQueues<Tracker, Compare>::end()
+{
+  return iterator(queues_.end(), typename Queue::iterator(), queues_.end());
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::const_iterator
+OrderQueues<Tracker, Compare>::end() const
+{
+  return const_iterator(queues_.end(), typename Queue::const_iterator(),
+                        queues_.end());
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::iterator
+OrderQueues<Tracker, Compare>::first(typename Queues::iterator price_queue)
+{
+  if (price_queue == queues_.end()) {
+    return end();
+  }
+  return iterator(price_queue, price_queue->second.begin(), queues_.end());
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::const_iterator
+OrderQueues<Tracker, Compare>::first(
+  typename Queues::const_iterator price_queue) const
+{
+  if (price_queue == queues_.end()) {
+    return end();
+  }
+  return const_iterator(price_queue, price_queue->second.begin(),
+                        queues_.end());
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::reverse_iterator
+OrderQueues<Tracker, Compare>::rbegin()
+{
+  return reverse_iterator(end());
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::const_reverse_iterator
+OrderQueues<Tracker, Compare>::rbegin() const
+{
+  return const_reverse_iterator(end());
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::reverse_iterator
+OrderQueues<Tracker, Compare>::rend()
+{
+  return reverse_iterator(begin());
+}
+
+template <class Tracker, class Compare>
+inline typename OrderQueues<Tracker, Compare>::const_reverse_iterator
+OrderQueues<Tracker, Compare>::rend() const
+{
+  return const_reverse_iterator(begin());
+}
+
+} }
+
+#endif
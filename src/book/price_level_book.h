@@ -0,0 +1,139 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef price_level_book_h
+#define price_level_book_h
+
+#include "depth.h"
+
+namespace liquibook { namespace book {
+
+/// @brief book of a market-by-price (level based) feed, whose orders are
+///        not known.  Each update sets or deletes a whole level of its
+///        depth, in a transaction of its own, so the depth is published
+///        with the same levels and change ids as that of an order book,
+///        while the book keeps no orders and does no matching.  Levels
+///        beyond the depth size are kept as excess by the depth itself.
+template <int SIZE=5>
+class PriceLevelBook {
+public:
+  typedef Depth<SIZE> TypedDepth;
+
+  /// @brief construct
+  PriceLevelBook();
+
+  /// @brief set a level, adding it if new
+  /// @param price the price of the level
+  /// @param order_count the number of orders at the level, or 1 if the
+  ///        feed does not give counts.  0 deletes the level.
+  /// @param qty the aggregate quantity at the level.  0 deletes the level.
+  /// @param is_bid indicator of bid or ask
+  /// @return true if the update deleted a level
+  bool set_level(Price price, uint32_t order_count, Quantity qty,
+                 bool is_bid);
+
+  /// @brief delete a level
+  /// @param price the price of the level
+  /// @param is_bid indicator of bid or ask
+  /// @return true if the level was known
+  bool delete_level(Price price, bool is_bid);
+
+  /// @brief replace every level, as from a snapshot of the feed, in one
+  ///        transaction.  Each visible level is marked changed.
+  /// @param bid the best bid level, as a (Price, DepthLevel) pair
+  /// @param bid_end one past the last bid level
+  /// @param ask the best ask level, as a (Price, DepthLevel) pair
+  /// @param ask_end one past the last ask level
+  template <class BidIterator, class AskIterator>
+  void restore(BidIterator bid, BidIterator bid_end,
+               AskIterator ask, AskIterator ask_end);
+
+  /// @brief delete every level, in one transaction
+  void clear();
+
+  /// @brief access the depth
+  TypedDepth& depth();
+
+  /// @brief access the depth
+  const TypedDepth& depth() const;
+
+  /// @brief get the ID of the last transaction
+  TransId trans_id() const;
+
+private:
+  TypedDepth depth_;
+  TransId trans_id_;
+};
+
+template <int SIZE>
+PriceLevelBook<SIZE>::PriceLevelBook()
+: trans_id_(0)
+{
+}
+
+template <int SIZE>
+inline bool
+PriceLevelBook<SIZE>::set_level(
+  Price price,
+  uint32_t order_count,
+  Quantity qty,
+  bool is_bid)
+{
+  ++trans_id_;
+  return depth_.set_level(price, qty ? order_count : 0, qty, is_bid);
+}
+
+template <int SIZE>
+inline bool
+PriceLevelBook<SIZE>::delete_level(Price price, bool is_bid)
+{
+  ++trans_id_;
+  return depth_.set_level(price, 0, 0, is_bid);
+}
+
+template <int SIZE>
+template <class BidIterator, class AskIterator>
+inline void
+PriceLevelBook<SIZE>::restore(
+  BidIterator bid,
+  BidIterator bid_end,
+  AskIterator ask,
+  AskIterator ask_end)
+{
+  ++trans_id_;
+  depth_.restore(bid, bid_end, ask, ask_end);
+}
+
+template <int SIZE>
+inline void
+PriceLevelBook<SIZE>::clear()
+{
+  BidLevelMap bids;
+  AskLevelMap asks;
+  restore(bids.begin(), bids.end(), asks.begin(), asks.end());
+}
+
+template <int SIZE>
+inline typename PriceLevelBook<SIZE>::TypedDepth&
+PriceLevelBook<SIZE>::depth()
+{
+  return depth_;
+}
+
+template <int SIZE>
+inline const typename PriceLevelBook<SIZE>::TypedDepth&
+PriceLevelBook<SIZE>::depth() const
+{
+  return depth_;
+}
+
+template <int SIZE>
+inline TransId
+PriceLevelBook<SIZE>::trans_id() const
+{
+  return trans_id_;
+}
+
+} }
+
+#endif
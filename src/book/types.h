@@ -5,6 +5,17 @@
 #define types_h
 
 #include <stdint.h>
+#include <utility>
+
+// Move order pointers where the compiler allows, so that a smart pointer
+// order is not copied (updating its reference count) as it passes through
+// the book
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1600)
+# define LIQUIBOOK_MOVE(value) std::move(value)
+# define LIQUIBOOK_HAS_MOVE
+#else
+# define LIQUIBOOK_MOVE(value) (value)
+#endif
 
 namespace liquibook { namespace book {
   // Types used in Liquibook
@@ -15,10 +26,13 @@ namespace liquibook { namespace book {
   typedef uint32_t ChangeId;
   typedef uint32_t TransId;
   typedef uint32_t OrderConditions;
+  typedef uint32_t SymbolId;
 
   enum OrderCondition {
     oc_all_or_none = 1,
-    oc_immediate_or_cancel = oc_all_or_none * 2
+    oc_immediate_or_cancel = oc_all_or_none * 2,
+    oc_stop = oc_immediate_or_cancel * 2,
+    oc_iceberg = oc_stop * 2
   };
 
   // Constants used in liquibook
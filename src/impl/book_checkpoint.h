@@ -0,0 +1,348 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef book_checkpoint_h
+#define book_checkpoint_h
+
+#include "book/order_book.h"
+#include "book/types.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace liquibook { namespace impl {
+
+/// @brief a resting order, as checkpointed
+struct CheckpointOrder {
+  uint32_t order_id;
+  book::Price price;
+  book::Quantity order_qty;
+  book::Quantity open_qty;
+  book::Quantity display_qty;         // of an iceberg order
+  book::Quantity hidden_qty;          // of an iceberg order
+  book::Price stop_price;             // of a stop order not yet triggered
+  book::OrderConditions conditions;
+  uint8_t is_buy;
+  uint8_t reserved[3];
+};
+
+/// @brief an aggregated limit price level, as checkpointed
+struct CheckpointLevel {
+  book::Price price;
+  uint32_t order_count;
+  book::Quantity aggregate_qty;
+  book::ChangeId last_change;
+};
+
+/// @brief a book, as checkpointed, followed by its symbol, its bid then ask
+///        levels, its bid then ask orders in priority order, and its buy
+///        then sell stop orders in trigger order
+struct CheckpointBook {
+  book::TransId trans_id;
+  book::Price market_price;           // of the last trade, triggering stops
+  uint32_t symbol_length;
+  uint32_t bid_level_count;
+  uint32_t ask_level_count;
+  uint32_t bid_count;
+  uint32_t ask_count;
+  uint32_t buy_stop_count;
+  uint32_t sell_stop_count;
+};
+
+/// @brief header of a checkpoint file, followed by its books
+struct CheckpointHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t book_count;
+  uint32_t reserved;
+
+  static const uint32_t MAGIC = 0x4C424350;  // "LBCP"
+  static const uint32_t VERSION = 3;
+};
+
+/// @brief binary checkpoint of the books of a BookManager: each resting
+///        order's tracker in priority order, each stop order waiting to be
+///        triggered, each aggregated level, and the transaction id and
+///        market price of each book.  Restoring loads the orders and
+///        levels directly, without matching, and the books rebuild their
+///        depths from the levels.  Replaying a command journal from the
+///        transaction ids checkpointed then brings the books up to date.
+///
+///        Orders are identified by a class with the member function:
+///          uint32_t operator()(const OrderPtr& order);
+///        and are recreated on restore by a factory with the member function:
+///          OrderPtr operator()(const CheckpointOrder& order);
+///        The factory gives an iceberg order its display quantity, which
+///        the book reads from the order when the iceberg shows more.
+template <class OrderPtr, class Manager>
+class BookCheckpoint {
+public:
+  typedef typename Manager::Book Book;
+  typedef typename Book::Tracker Tracker;
+
+  /// @brief write a checkpoint of every book.  Written to a temporary file
+  ///        then renamed, so an existing checkpoint is replaced whole.
+  /// @param path the path of the checkpoint file
+  /// @param books the books to checkpoint
+  /// @param order_ids the identifier of orders
+  template <class OrderIds>
+  static void save(const std::string& path,
+                   const Manager& books,
+                   OrderIds& order_ids);
+
+  /// @brief restore the books of a checkpoint
+  /// @param path the path of the checkpoint file
+  /// @param books the manager to add the books to, which must have none
+  /// @param factory the factory recreating orders
+  template <class OrderFactory>
+  static void load(const std::string& path,
+                   Manager& books,
+                   OrderFactory& factory);
+
+private:
+  template <class Levels>
+  static void write_levels(FILE* file, const Levels& levels);
+
+  /// @param stops true if the orders are keyed by their stop price
+  template <class Orders, class OrderIds>
+  static void write_orders(FILE* file,
+                           const Orders& orders,
+                           OrderIds& order_ids,
+                           bool stops = false);
+
+  static void write(FILE* file, const void* data, size_t size);
+  static void read(FILE* file, void* data, size_t size);
+  static void fail(const char* what, const std::string& path);
+};
+
+template <class OrderPtr, class Manager>
+template <class OrderIds>
+void
+BookCheckpoint<OrderPtr, Manager>::save(
+  const std::string& path,
+  const Manager& books,
+  OrderIds& order_ids)
+{
+  std::string temp_path = path + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (!file) {
+    fail("BookCheckpoint open failed", temp_path);
+  }
+  try {
+    CheckpointHeader header = CheckpointHeader();
+    header.magic = CheckpointHeader::MAGIC;
+    header.version = CheckpointHeader::VERSION;
+    header.book_count = uint32_t(books.size());
+    write(file, &header, sizeof(header));
+    for (book::SymbolId symbol_id = 0; symbol_id < books.size(); ++symbol_id) {
+      const Book& order_book = books.book(symbol_id);
+      const std::string& symbol = books.symbol(symbol_id);
+      CheckpointBook checkpoint_book;
+      checkpoint_book.trans_id = order_book.trans_id();
+      checkpoint_book.market_price = order_book.market_price();
+      checkpoint_book.symbol_length = uint32_t(symbol.size());
+      checkpoint_book.bid_level_count =
+          uint32_t(order_book.bid_levels().size());
+      checkpoint_book.ask_level_count =
+          uint32_t(order_book.ask_levels().size());
+      checkpoint_book.bid_count = uint32_t(order_book.bids().size());
+      checkpoint_book.ask_count = uint32_t(order_book.asks().size());
+      checkpoint_book.buy_stop_count =
+          uint32_t(order_book.buy_stops().size());
+      checkpoint_book.sell_stop_count =
+          uint32_t(order_book.sell_stops().size());
+      write(file, &checkpoint_book, sizeof(checkpoint_book));
+      write(file, symbol.data(), symbol.size());
+      write_levels(file, order_book.bid_levels());
+      write_levels(file, order_book.ask_levels());
+      write_orders(file, order_book.bids(), order_ids);
+      write_orders(file, order_book.asks(), order_ids);
+      write_orders(file, order_book.buy_stops(), order_ids, true);
+      write_orders(file, order_book.sell_stops(), order_ids, true);
+    }
+    if (fflush(file) != 0 || fsync(fileno(file)) != 0) {
+      fail("BookCheckpoint write failed", temp_path);
+    }
+  } catch (...) {
+    fclose(file);
+    remove(temp_path.c_str());
+    throw;
+  }
+  fclose(file);
+  if (rename(temp_path.c_str(), path.c_str()) != 0) {
+    fail("BookCheckpoint rename failed", path);
+  }
+}
+
+template <class OrderPtr, class Manager>
+template <class OrderFactory>
+void
+BookCheckpoint<OrderPtr, Manager>::load(
+  const std::string& path,
+  Manager& books,
+  OrderFactory& factory)
+{
+  if (books.size()) {
+    throw std::runtime_error("BookCheckpoint load to a manager with books");
+  }
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    fail("BookCheckpoint open failed", path);
+  }
+  try {
+    CheckpointHeader header;
+    read(file, &header, sizeof(header));
+    if (header.magic != CheckpointHeader::MAGIC) {
+      throw std::runtime_error("BookCheckpoint file is not a checkpoint");
+    }
+    if (header.version != CheckpointHeader::VERSION) {
+      throw std::runtime_error("BookCheckpoint file version not supported");
+    }
+    std::vector<CheckpointLevel> levels;
+    std::vector<CheckpointOrder> orders;
+    for (uint32_t index = 0; index < header.book_count; ++index) {
+      CheckpointBook checkpoint_book;
+      read(file, &checkpoint_book, sizeof(checkpoint_book));
+      std::string symbol(checkpoint_book.symbol_length, '\0');
+      if (!symbol.empty()) {
+        read(file, &symbol[0], symbol.size());
+      }
+      Book& order_book = books.book(books.add_book(symbol));
+
+      // Read each side's levels, then each side's orders, in one read
+      size_t bid_level_count = checkpoint_book.bid_level_count;
+      levels.resize(bid_level_count + checkpoint_book.ask_level_count);
+      if (!levels.empty()) {
+        read(file, &levels[0], levels.size() * sizeof(CheckpointLevel));
+      }
+      for (size_t level_index = 0; level_index < levels.size();
+           ++level_index) {
+        const CheckpointLevel& checkpoint_level = levels[level_index];
+        book::DepthLevel level;
+        level.init(checkpoint_level.price, false);
+        level.set(checkpoint_level.order_count,
+                  checkpoint_level.aggregate_qty);
+        level.last_change(checkpoint_level.last_change);
+        order_book.restore_level(level, level_index < bid_level_count);
+      }
+      // Then the resting orders, followed by the stop orders
+      size_t resting_count = checkpoint_book.bid_count +
+                             checkpoint_book.ask_count;
+      orders.resize(resting_count + checkpoint_book.buy_stop_count +
+                    checkpoint_book.sell_stop_count);
+      if (!orders.empty()) {
+        read(file, &orders[0], orders.size() * sizeof(CheckpointOrder));
+      }
+      for (size_t order_index = 0; order_index < orders.size();
+           ++order_index) {
+        const CheckpointOrder& order = orders[order_index];
+        Tracker tracker(factory(order),
+                        order.is_buy != 0,
+                        order.price,
+                        order.order_qty,
+                        order.open_qty,
+                        order.conditions,
+                        order.hidden_qty);
+        if (order_index < resting_count) {
+          order_book.restore_order(tracker);
+        } else {
+          order_book.restore_stop(tracker, order.stop_price);
+        }
+      }
+      order_book.restored(checkpoint_book.trans_id,
+                          checkpoint_book.market_price);
+    }
+  } catch (...) {
+    fclose(file);
+    throw;
+  }
+  fclose(file);
+}
+
+template <class OrderPtr, class Manager>
+template <class Levels>
+void
+BookCheckpoint<OrderPtr, Manager>::write_levels(
+  FILE* file,
+  const Levels& levels)
+{
+  typename Levels::const_iterator level;
+  for (level = levels.begin(); level != levels.end(); ++level) {
+    CheckpointLevel checkpoint_level;
+    checkpoint_level.price = level->second.price();
+    checkpoint_level.order_count = level->second.order_count();
+    checkpoint_level.aggregate_qty = level->second.aggregate_qty();
+    checkpoint_level.last_change = level->second.last_change();
+    write(file, &checkpoint_level, sizeof(checkpoint_level));
+  }
+}
+
+template <class OrderPtr, class Manager>
+template <class Orders, class OrderIds>
+void
+BookCheckpoint<OrderPtr, Manager>::write_orders(
+  FILE* file,
+  const Orders& orders,
+  OrderIds& order_ids,
+  bool stops)
+{
+  // Orders of a price are kept in priority order
+  typename Orders::const_iterator order;
+  for (order = orders.begin(); order != orders.end(); ++order) {
+    const Tracker& tracker = order->second;
+    CheckpointOrder checkpoint_order = CheckpointOrder();
+    checkpoint_order.order_id = order_ids(tracker.ptr());
+    checkpoint_order.price = tracker.price();
+    checkpoint_order.order_qty = tracker.order_qty();
+    checkpoint_order.open_qty = tracker.open_qty();
+    checkpoint_order.display_qty = tracker.display_qty();
+    checkpoint_order.hidden_qty = tracker.hidden_qty();
+    checkpoint_order.stop_price = stops ? order->first : 0;
+    checkpoint_order.conditions = tracker.conditions();
+    checkpoint_order.is_buy = tracker.is_buy();
+    write(file, &checkpoint_order, sizeof(checkpoint_order));
+  }
+}
+
+template <class OrderPtr, class Manager>
+inline void
+BookCheckpoint<OrderPtr, Manager>::write(
+  FILE* file,
+  const void* data,
+  size_t size)
+{
+  if (size && fwrite(data, size, 1, file) != 1) {
+    throw std::runtime_error(std::string("BookCheckpoint write failed: ") +
+                             strerror(errno));
+  }
+}
+
+template <class OrderPtr, class Manager>
+inline void
+BookCheckpoint<OrderPtr, Manager>::read(
+  FILE* file,
+  void* data,
+  size_t size)
+{
+  if (fread(data, size, 1, file) != 1) {
+    throw std::runtime_error("BookCheckpoint file truncated");
+  }
+}
+
+template <class OrderPtr, class Manager>
+void
+BookCheckpoint<OrderPtr, Manager>::fail(
+  const char* what,
+  const std::string& path)
+{
+  throw std::runtime_error(std::string(what) + ": " + path + ": " +
+                           strerror(errno));
+}
+
+} }
+
+#endif
@@ -0,0 +1,416 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef command_journal_h
+#define command_journal_h
+
+#include "shm_ring.h"
+#include "book/types.h"
+#include <atomic>
+#include <stddef.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+namespace liquibook { namespace impl {
+
+/// @brief a command to an order book, as journaled.  Fixed size plain data,
+///        so records are written to the journal in place.
+struct JournalRecord {
+  enum Type {
+    jr_empty,    // not yet written - the end of the journal
+    jr_add,
+    jr_cancel,
+    jr_replace
+  };
+
+  /// @brief create an add record
+  static JournalRecord add(book::TransId trans_id,
+                           book::SymbolId symbol_id,
+                           uint32_t order_id,
+                           bool is_buy,
+                           book::Price price,
+                           book::Quantity qty,
+                           book::OrderConditions conditions = 0,
+                           book::Price stop_price = 0,
+                           book::Quantity display_qty = 0);
+  /// @brief create a cancel record
+  static JournalRecord cancel(book::TransId trans_id,
+                              book::SymbolId symbol_id,
+                              uint32_t order_id);
+  /// @brief create a replace record
+  static JournalRecord replace(book::TransId trans_id,
+                               book::SymbolId symbol_id,
+                               uint32_t order_id,
+                               int32_t size_delta,
+                               book::Price new_price);
+
+  uint8_t type;                       // written last, atomically
+  uint8_t is_buy;                     // add
+  uint16_t reserved;
+  book::TransId trans_id;             // of the book, once applied
+  book::SymbolId symbol_id;
+  uint32_t order_id;
+  book::Price price;                  // add
+  book::Quantity qty;                 // add
+  book::OrderConditions conditions;   // add
+  book::Price stop_price;             // add, of a stop order
+  book::Quantity display_qty;         // add, of an iceberg order
+  int32_t size_delta;                 // replace
+  book::Price new_price;              // replace
+};
+
+/// @brief header of a journal file, followed by its records
+struct JournalHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t capacity;                  // records
+  char pad[64 - 4 * sizeof(uint32_t)];
+
+  static const uint32_t MAGIC = 0x4C424A4E;  // "LBJN"
+  static const uint32_t VERSION = 3;
+};
+
+/// @brief append-only journal of the commands to order books, in a file
+///        mapped into memory and sized up front.  Appending a command is a
+///        copy into the mapping; the file is synced once per group of
+///        commands, or on commit(), so the cost of syncing is shared by the
+///        group.  Commands are journaled before being applied, each with
+///        the transaction id its book assigns to it.  POSIX only.
+class CommandJournal {
+public:
+  /// @brief open a journal, creating it if it does not exist, to append to
+  ///        the records already written
+  /// @param path the path of the journal file
+  /// @param capacity the number of records of a new journal
+  /// @param group_size the number of records appended between syncs, or 0
+  ///        to sync only on commit()
+  CommandJournal(const std::string& path,
+                 size_t capacity,
+                 size_t group_size = 256);
+
+  /// @brief sync the records not yet synced
+  ~CommandJournal();
+
+  /// @brief append a record, syncing if it completes a group
+  void append(const JournalRecord& record);
+
+  /// @brief sync the records appended since the last sync
+  void commit();
+
+  /// @brief get the number of records written
+  size_t size() const;
+
+  /// @brief get the number of records the journal holds
+  size_t capacity() const;
+
+  /// @brief get the number of records appended, but not yet synced
+  size_t uncommitted() const;
+
+  /// @brief get a record written
+  const JournalRecord& record(size_t index) const;
+
+  /// @brief get the records of a journal mapping, validating its header
+  /// @param memory the mapping of the journal file
+  /// @param capacity the number of records of the journal (out)
+  static JournalRecord* records(SharedMemory& memory, size_t& capacity);
+
+  /// @brief get the size of a journal file
+  static size_t footprint(size_t capacity);
+
+  /// @brief access the type of a record in the mapping atomically.  The
+  ///        type is written last, with release, so a reader loading it
+  ///        with acquire sees the rest of the record.
+  static std::atomic<uint8_t>& type_of(JournalRecord& record);
+  static const std::atomic<uint8_t>& type_of(const JournalRecord& record);
+
+private:
+  // Not copyable
+  CommandJournal(const CommandJournal&);
+  CommandJournal& operator=(const CommandJournal&);
+
+  /// @brief map the journal file, creating it if it does not exist
+  static SharedMemory* open(const std::string& path, size_t capacity);
+
+  SharedMemory* memory_;
+  JournalRecord* records_;
+  size_t capacity_;
+  size_t group_size_;
+  size_t size_;
+  size_t committed_;
+};
+
+/// @brief reader of a journal, from its first record.  May follow a journal
+///        as it is appended to by another process.  POSIX only.
+class JournalReader {
+public:
+  /// @brief open a journal
+  /// @param path the path of the journal file
+  explicit JournalReader(const std::string& path);
+
+  /// @brief take the next record
+  /// @return the record, or NULL if it is yet to be written
+  const JournalRecord* next();
+
+  /// @brief get the number of records taken
+  size_t position() const;
+
+  /// @brief get the number of records the journal holds
+  size_t capacity() const;
+
+private:
+  SharedMemory memory_;
+  const JournalRecord* records_;
+  size_t capacity_;
+  size_t position_;
+};
+
+inline JournalRecord
+JournalRecord::add(
+  book::TransId trans_id,
+  book::SymbolId symbol_id,
+  uint32_t order_id,
+  bool is_buy,
+  book::Price price,
+  book::Quantity qty,
+  book::OrderConditions conditions,
+  book::Price stop_price,
+  book::Quantity display_qty)
+{
+  JournalRecord record = JournalRecord();
+  record.type = jr_add;
+  record.trans_id = trans_id;
+  record.symbol_id = symbol_id;
+  record.order_id = order_id;
+  record.is_buy = is_buy;
+  record.price = price;
+  record.qty = qty;
+  record.conditions = conditions;
+  record.stop_price = stop_price;
+  record.display_qty = display_qty;
+  return record;
+}
+
+inline JournalRecord
+JournalRecord::cancel(
+  book::TransId trans_id,
+  book::SymbolId symbol_id,
+  uint32_t order_id)
+{
+  JournalRecord record = JournalRecord();
+  record.type = jr_cancel;
+  record.trans_id = trans_id;
+  record.symbol_id = symbol_id;
+  record.order_id = order_id;
+  return record;
+}
+
+inline JournalRecord
+JournalRecord::replace(
+  book::TransId trans_id,
+  book::SymbolId symbol_id,
+  uint32_t order_id,
+  int32_t size_delta,
+  book::Price new_price)
+{
+  JournalRecord record = JournalRecord();
+  record.type = jr_replace;
+  record.trans_id = trans_id;
+  record.symbol_id = symbol_id;
+  record.order_id = order_id;
+  record.size_delta = size_delta;
+  record.new_price = new_price;
+  return record;
+}
+
+inline
+CommandJournal::CommandJournal(
+  const std::string& path,
+  size_t capacity,
+  size_t group_size)
+: memory_(open(path, capacity)),
+  records_(NULL),
+  capacity_(0),
+  group_size_(group_size),
+  size_(0),
+  committed_(0)
+{
+  try {
+    records_ = records(*memory_, capacity_);
+  } catch (...) {
+    delete memory_;
+    throw;
+  }
+  // Append after the records already written
+  while (size_ < capacity_ &&
+         type_of(records_[size_]).load(std::memory_order_acquire) !=
+             JournalRecord::jr_empty) {
+    ++size_;
+  }
+  committed_ = size_;
+}
+
+inline
+CommandJournal::~CommandJournal()
+{
+  try {
+    commit();
+  } catch (...) {
+  }
+  delete memory_;
+}
+
+inline void
+CommandJournal::append(const JournalRecord& record)
+{
+  if (size_ == capacity_) {
+    throw std::runtime_error("CommandJournal full");
+  }
+  JournalRecord& slot = records_[size_];
+  // Copy all but the type, which stays empty, then publish the record by
+  // writing its type, so a reader of the mapping never sees part of it
+  const size_t offset = offsetof(JournalRecord, is_buy);
+  memcpy(reinterpret_cast<char*>(&slot) + offset,
+         reinterpret_cast<const char*>(&record) + offset,
+         sizeof(JournalRecord) - offset);
+  type_of(slot).store(record.type, std::memory_order_release);
+  ++size_;
+  if (group_size_ && size_ - committed_ >= group_size_) {
+    commit();
+  }
+}
+
+inline void
+CommandJournal::commit()
+{
+  if (size_ > committed_) {
+    memory_->sync(sizeof(JournalHeader) + committed_ * sizeof(JournalRecord),
+                  (size_ - committed_) * sizeof(JournalRecord));
+    committed_ = size_;
+  }
+}
+
+inline size_t
+CommandJournal::size() const
+{
+  return size_;
+}
+
+inline size_t
+CommandJournal::capacity() const
+{
+  return capacity_;
+}
+
+inline size_t
+CommandJournal::uncommitted() const
+{
+  return size_ - committed_;
+}
+
+inline const JournalRecord&
+CommandJournal::record(size_t index) const
+{
+  return records_[index];
+}
+
+inline JournalRecord*
+CommandJournal::records(SharedMemory& memory, size_t& capacity)
+{
+  const JournalHeader* header =
+      reinterpret_cast<const JournalHeader*>(memory.address());
+  if (memory.size() < sizeof(JournalHeader) ||
+      header->magic != JournalHeader::MAGIC) {
+    throw std::runtime_error("CommandJournal file is not a journal");
+  }
+  if (header->version != JournalHeader::VERSION ||
+      header->record_size != sizeof(JournalRecord)) {
+    throw std::runtime_error("CommandJournal file version not supported");
+  }
+  if (memory.size() < footprint(header->capacity)) {
+    throw std::runtime_error("CommandJournal file truncated");
+  }
+  capacity = header->capacity;
+  return reinterpret_cast<JournalRecord*>(memory.address() +
+                                          sizeof(JournalHeader));
+}
+
+inline size_t
+CommandJournal::footprint(size_t capacity)
+{
+  return sizeof(JournalHeader) + capacity * sizeof(JournalRecord);
+}
+
+// The type of a record is accessed in place as an atomic
+static_assert(sizeof(std::atomic<uint8_t>) == sizeof(uint8_t) &&
+              ATOMIC_CHAR_LOCK_FREE == 2,
+              "JournalRecord type requires lock free byte atomics");
+
+inline std::atomic<uint8_t>&
+CommandJournal::type_of(JournalRecord& record)
+{
+  return *reinterpret_cast<std::atomic<uint8_t>*>(&record.type);
+}
+
+inline const std::atomic<uint8_t>&
+CommandJournal::type_of(const JournalRecord& record)
+{
+  return *reinterpret_cast<const std::atomic<uint8_t>*>(&record.type);
+}
+
+inline SharedMemory*
+CommandJournal::open(const std::string& path, size_t capacity)
+{
+  if (::access(path.c_str(), F_OK) == 0) {
+    return new SharedMemory(path);
+  }
+  // Create the file zero filled, so each record is empty until written
+  SharedMemory* memory = new SharedMemory(path, footprint(capacity));
+  JournalHeader* header = reinterpret_cast<JournalHeader*>(memory->address());
+  header->version = JournalHeader::VERSION;
+  header->record_size = sizeof(JournalRecord);
+  header->capacity = uint32_t(capacity);
+  header->magic = JournalHeader::MAGIC;
+  memory->sync(0, sizeof(JournalHeader));
+  return memory;
+}
+
+inline
+JournalReader::JournalReader(const std::string& path)
+: memory_(path),
+  records_(NULL),
+  capacity_(0),
+  position_(0)
+{
+  records_ = CommandJournal::records(memory_, capacity_);
+}
+
+inline const JournalRecord*
+JournalReader::next()
+{
+  // The type is written last, so the rest is read after it
+  if (position_ == capacity_ ||
+      CommandJournal::type_of(records_[position_]).load(
+          std::memory_order_acquire) == JournalRecord::jr_empty) {
+    return NULL;
+  }
+  return &records_[position_++];
+}
+
+inline size_t
+JournalReader::position() const
+{
+  return position_;
+}
+
+inline size_t
+JournalReader::capacity() const
+{
+  return capacity_;
+}
+
+} }
+
+#endif
@@ -0,0 +1,584 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef event_log_h
+#define event_log_h
+
+#include "run_loop.h"
+#include "spsc_queue.h"
+#include "book/callback.h"
+#include "book/types.h"
+#include <atomic>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace liquibook { namespace impl {
+
+/// @brief an order callback of a book, as logged
+struct LoggedEvent {
+  enum Type {
+    le_accept = 1,
+    le_reject,
+    le_fill,
+    le_cancel,
+    le_cancel_reject,
+    le_replace,
+    le_replace_reject
+  };
+  uint8_t type;
+  book::SymbolId symbol_id;
+  book::TransId trans_id;
+  uint32_t order_id;
+  uint32_t matched_order_id;  // fill
+  book::Quantity qty;         // fill qty, or replace new order qty
+  book::Price price;          // fill price, or replace new price
+  const char* reason;         // rejects, a string literal
+};
+
+/// @brief header of an event log file, followed by its encoded events
+struct EventLogHeader {
+  uint32_t magic;
+  uint32_t version;
+
+  static const uint32_t MAGIC = 0x4C42454C;  // "LBEL"
+  static const uint32_t VERSION = 1;
+};
+
+/// @brief encoding of logged events.  Each event is its type byte, then
+///        varints: its symbol id, its transaction id and order id as
+///        zigzag deltas from the previous event's, then by type the
+///        matched order id as a delta from the order id, the quantity, and
+///        the price as a delta from the previous price, or the length and
+///        text of a reject reason.  A typical fill takes 7 or 8 bytes.
+class EventCodec {
+public:
+  /// @brief most bytes an event encodes to
+  enum { MAX_ENCODED_SIZE = 1 + 5 * 6 + 1 + 255 };
+
+  EventCodec();
+
+  /// @brief encode an event
+  /// @param event the event to encode
+  /// @param out the buffer to encode to, of at least MAX_ENCODED_SIZE
+  /// @return the number of bytes encoded
+  size_t encode(const LoggedEvent& event, char* out);
+
+  /// @brief decode an event
+  /// @param in the encoded event
+  /// @param size the bytes available
+  /// @param event the event decoded (out).  Its reason refers to reason.
+  /// @param reason the reason of a reject (out)
+  /// @return the number of bytes decoded, or 0 if the event is incomplete
+  size_t decode(const char* in,
+                size_t size,
+                LoggedEvent& event,
+                std::string& reason);
+
+private:
+  static char* put(char* out, uint32_t value);
+  static char* put_delta(char* out, uint32_t value, uint32_t previous);
+  static bool get(const char*& in, const char* end, uint32_t& value);
+  static bool get_delta(const char*& in,
+                        const char* end,
+                        uint32_t previous,
+                        uint32_t& value);
+
+  uint32_t trans_id_;
+  uint32_t order_id_;
+  uint32_t price_;
+};
+
+/// @brief writer of an event log on a background thread.  Events are
+///        queued by the matching thread, then encoded and written by the
+///        writer's thread, so logging costs the matching thread a queue
+///        push.  Written to the file in blocks, as the writer goes idle or
+///        its buffer fills.  Requires C++11.
+class EventLogWriter {
+public:
+  /// @brief construct, creating or truncating the log, and start writing
+  /// @param path the path of the log file
+  /// @param queue_capacity the events queued before the producer waits
+  /// @param cpu the cpu to pin the writer's thread to, or -1 for none
+  explicit EventLogWriter(const std::string& path,
+                          size_t queue_capacity = 65536,
+                          int cpu = -1);
+
+  /// @brief destroy, stopping the writer
+  ~EventLogWriter();
+
+  /// @brief queue an event - producer thread only.  Waits for the writer
+  ///        rather than drop an event.
+  void log(const LoggedEvent& event);
+
+  /// @brief write every event queued, then stop the writer's thread
+  void stop();
+
+  /// @brief get the number of events queued - producer thread only
+  size_t logged() const;
+
+  /// @brief get the number of bytes written to the file, once stopped
+  size_t bytes_written() const;
+
+  /// @brief get the error which stopped the writer writing, or an empty
+  ///        string if none.  Events logged after an error are discarded.
+  std::string error() const;
+
+  /// @brief encode a batch of queued events, or write those encoded once
+  ///        there are none - writer thread only
+  /// @return the number of events encoded, or 1 if a block was written
+  size_t poll();
+
+private:
+  // Not copyable
+  EventLogWriter(const EventLogWriter&);
+  EventLogWriter& operator=(const EventLogWriter&);
+
+  /// @brief write the encoded events, noting the error if the write fails
+  void write_buffer();
+
+  /// @brief note the error of a failed write, if the first
+  void fail(const char* what);
+
+  enum {
+    BUFFER_SIZE = 65536,
+    BATCH_SIZE = 256
+  };
+  FILE* file_;
+  SpscQueue<LoggedEvent> events_;
+  EventCodec codec_;
+  std::vector<char> buffer_;
+  size_t buffered_;
+  size_t logged_;
+  size_t bytes_written_;
+  std::string error_;
+  std::atomic<bool> failed_;  // once error_ is set
+  RunLoop loop_;
+  std::thread writer_;
+};
+
+/// @brief reader of an event log
+class EventLogReader {
+public:
+  /// @brief construct, reading the log
+  /// @param path the path of the log file
+  explicit EventLogReader(const std::string& path);
+
+  /// @brief read the next event
+  /// @param event the event read (out).  Its reason remains valid until
+  ///        the next event is read.
+  /// @return false at the end of the log
+  bool next(LoggedEvent& event);
+
+private:
+  std::vector<char> data_;
+  size_t position_;
+  EventCodec codec_;
+  std::string reason_;
+};
+
+/// @brief book logging its callbacks to an event log before performing
+///        them.  Orders are identified by a class with the member function:
+///          uint32_t operator()(const OrderPtr& order);
+template <class OrderPtr, class TypedOrderBook, class OrderIds>
+class EventLogBook : public TypedOrderBook {
+public:
+  typedef typename TypedOrderBook::TypedCallback TypedCallback;
+
+  EventLogBook()
+  : log_(NULL),
+    symbol_id_(0)
+  {
+  }
+
+  /// @brief set where callbacks are logged
+  /// @param log the event log
+  /// @param symbol_id the id of the book's symbol
+  void attach(EventLogWriter* log, book::SymbolId symbol_id)
+  {
+    log_ = log;
+    symbol_id_ = symbol_id;
+  }
+
+  /// @brief access the identifier of orders
+  OrderIds& order_ids() { return order_ids_; }
+
+  /// @brief log a callback, then perform it
+  virtual void perform_callback(TypedCallback& cb);
+
+private:
+  EventLogWriter* log_;
+  book::SymbolId symbol_id_;
+  OrderIds order_ids_;
+};
+
+inline
+EventCodec::EventCodec()
+: trans_id_(0),
+  order_id_(0),
+  price_(0)
+{
+}
+
+inline size_t
+EventCodec::encode(const LoggedEvent& event, char* out)
+{
+  char* start = out;
+  *out++ = char(event.type);
+  out = put(out, event.symbol_id);
+  out = put_delta(out, event.trans_id, trans_id_);
+  out = put_delta(out, event.order_id, order_id_);
+  trans_id_ = event.trans_id;
+  order_id_ = event.order_id;
+  switch (event.type) {
+    case LoggedEvent::le_fill:
+      out = put_delta(out, event.matched_order_id, event.order_id);
+      // Fall through
+    case LoggedEvent::le_replace:
+      out = put(out, event.qty);
+      out = put_delta(out, event.price, price_);
+      price_ = event.price;
+      break;
+    case LoggedEvent::le_reject:
+    case LoggedEvent::le_cancel_reject:
+    case LoggedEvent::le_replace_reject: {
+      size_t length = event.reason ? strlen(event.reason) : 0;
+      if (length > 255) {
+        length = 255;
+      }
+      *out++ = char(length);
+      if (length) {
+        memcpy(out, event.reason, length);
+        out += length;
+      }
+      break;
+    }
+  }
+  return out - start;
+}
+
+inline size_t
+EventCodec::decode(
+  const char* in,
+  size_t size,
+  LoggedEvent& event,
+  std::string& reason)
+{
+  const char* start = in;
+  const char* end = in + size;
+  if (in == end) {
+    return 0;
+  }
+  event = LoggedEvent();
+  event.type = uint8_t(*in++);
+  if (!get(in, end, event.symbol_id) ||
+      !get_delta(in, end, trans_id_, event.trans_id) ||
+      !get_delta(in, end, order_id_, event.order_id)) {
+    return 0;
+  }
+  switch (event.type) {
+    case LoggedEvent::le_accept:
+    case LoggedEvent::le_cancel:
+      break;
+    case LoggedEvent::le_fill:
+      if (!get_delta(in, end, event.order_id, event.matched_order_id)) {
+        return 0;
+      }
+      // Fall through
+    case LoggedEvent::le_replace:
+      if (!get(in, end, event.qty) ||
+          !get_delta(in, end, price_, event.price)) {
+        return 0;
+      }
+      price_ = event.price;
+      break;
+    case LoggedEvent::le_reject:
+    case LoggedEvent::le_cancel_reject:
+    case LoggedEvent::le_replace_reject: {
+      if (in == end || size_t(end - in) < size_t(1) + size_t(uint8_t(*in))) {
+        return 0;
+      }
+      size_t length = uint8_t(*in++);
+      reason.assign(in, length);
+      in += length;
+      event.reason = reason.c_str();
+      break;
+    }
+    default:
+      throw std::runtime_error("EventCodec event type not known");
+  }
+  trans_id_ = event.trans_id;
+  order_id_ = event.order_id;
+  return in - start;
+}
+
+inline char*
+EventCodec::put(char* out, uint32_t value)
+{
+  while (value >= 0x80) {
+    *out++ = char(value | 0x80);
+    value >>= 7;
+  }
+  *out++ = char(value);
+  return out;
+}
+
+inline char*
+EventCodec::put_delta(char* out, uint32_t value, uint32_t previous)
+{
+  // Zigzag, so small deltas either way encode small
+  int32_t delta = int32_t(value - previous);
+  return put(out, (uint32_t(delta) << 1) ^ uint32_t(delta >> 31));
+}
+
+inline bool
+EventCodec::get(const char*& in, const char* end, uint32_t& value)
+{
+  value = 0;
+  for (int shift = 0; shift < 35 && in != end; shift += 7) {
+    uint8_t byte = uint8_t(*in++);
+    value |= uint32_t(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline bool
+EventCodec::get_delta(
+  const char*& in,
+  const char* end,
+  uint32_t previous,
+  uint32_t& value)
+{
+  uint32_t zigzag;
+  if (!get(in, end, zigzag)) {
+    return false;
+  }
+  value = previous + ((zigzag >> 1) ^ (0 - (zigzag & 1)));
+  return true;
+}
+
+inline
+EventLogWriter::EventLogWriter(
+  const std::string& path,
+  size_t queue_capacity,
+  int cpu)
+: file_(fopen(path.c_str(), "wb")),
+  events_(queue_capacity),
+  buffer_(BUFFER_SIZE),
+  buffered_(0),
+  logged_(0),
+  bytes_written_(0),
+  failed_(false),
+  loop_(cpu, RunLoop::im_backoff)
+{
+  if (!file_) {
+    throw std::runtime_error("EventLogWriter open failed: " + path + ": " +
+                             strerror(errno));
+  }
+  EventLogHeader header;
+  header.magic = EventLogHeader::MAGIC;
+  header.version = EventLogHeader::VERSION;
+  memcpy(&buffer_[0], &header, sizeof(header));
+  buffered_ = sizeof(header);
+  writer_ = std::thread(&RunLoop::run<EventLogWriter>, &loop_,
+                        std::ref(*this));
+}
+
+inline
+EventLogWriter::~EventLogWriter()
+{
+  stop();
+  fclose(file_);
+}
+
+inline void
+EventLogWriter::log(const LoggedEvent& event)
+{
+  while (!events_.push(event)) {
+    std::this_thread::yield();
+  }
+  ++logged_;
+}
+
+inline void
+EventLogWriter::stop()
+{
+  if (writer_.joinable()) {
+    loop_.stop();
+    writer_.join();
+    fflush(file_);
+  }
+}
+
+inline size_t
+EventLogWriter::logged() const
+{
+  return logged_;
+}
+
+inline size_t
+EventLogWriter::bytes_written() const
+{
+  return bytes_written_;
+}
+
+inline std::string
+EventLogWriter::error() const
+{
+  if (failed_.load(std::memory_order_acquire)) {
+    return error_;
+  }
+  return std::string();
+}
+
+inline size_t
+EventLogWriter::poll()
+{
+  LoggedEvent event;
+  size_t encoded = 0;
+  while (encoded < BATCH_SIZE && events_.pop(event)) {
+    // Once failed, keep taking events so the producer never waits
+    if (failed_.load(std::memory_order_relaxed)) {
+      continue;
+    }
+    if (buffered_ + EventCodec::MAX_ENCODED_SIZE > buffer_.size()) {
+      write_buffer();
+    }
+    buffered_ += codec_.encode(event, &buffer_[buffered_]);
+    ++encoded;
+  }
+  // Write once idle, so a quiet log is not left in the buffer
+  if (!encoded && buffered_) {
+    write_buffer();
+    if (fflush(file_) != 0) {
+      fail("EventLogWriter flush failed: ");
+    }
+    return 1;
+  }
+  return encoded;
+}
+
+inline void
+EventLogWriter::write_buffer()
+{
+  if (fwrite(&buffer_[0], 1, buffered_, file_) != buffered_) {
+    fail("EventLogWriter write failed: ");
+  } else {
+    bytes_written_ += buffered_;
+  }
+  buffered_ = 0;
+}
+
+inline void
+EventLogWriter::fail(const char* what)
+{
+  // Thrown on the writer's thread, an error would end the process
+  if (!failed_.load(std::memory_order_relaxed)) {
+    error_ = std::string(what) + strerror(errno);
+    failed_.store(true, std::memory_order_release);
+  }
+}
+
+inline
+EventLogReader::EventLogReader(const std::string& path)
+: position_(sizeof(EventLogHeader))
+{
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) {
+    throw std::runtime_error("EventLogReader open failed: " + path + ": " +
+                             strerror(errno));
+  }
+  char block[65536];
+  size_t size;
+  while ((size = fread(block, 1, sizeof(block), file)) > 0) {
+    data_.insert(data_.end(), block, block + size);
+  }
+  fclose(file);
+  EventLogHeader header;
+  if (data_.size() < sizeof(header)) {
+    throw std::runtime_error("EventLogReader file is not an event log");
+  }
+  memcpy(&header, &data_[0], sizeof(header));
+  if (header.magic != EventLogHeader::MAGIC) {
+    throw std::runtime_error("EventLogReader file is not an event log");
+  }
+  if (header.version != EventLogHeader::VERSION) {
+    throw std::runtime_error("EventLogReader file version not supported");
+  }
+}
+
+inline bool
+EventLogReader::next(LoggedEvent& event)
+{
+  if (position_ == data_.size()) {
+    return false;
+  }
+  size_t size = codec_.decode(&data_[position_], data_.size() - position_,
+                              event, reason_);
+  if (!size) {
+    throw std::runtime_error("EventLogReader event truncated");
+  }
+  position_ += size;
+  return true;
+}
+
+template <class OrderPtr, class TypedOrderBook, class OrderIds>
+void
+EventLogBook<OrderPtr, TypedOrderBook, OrderIds>::perform_callback(
+  TypedCallback& cb)
+{
+  if (log_ && cb.order) {
+    LoggedEvent event = LoggedEvent();
+    event.symbol_id = symbol_id_;
+    event.trans_id = cb.trans_id;
+    event.order_id = order_ids_(cb.order);
+    switch (cb.type) {
+      case TypedCallback::cb_order_accept:
+        event.type = LoggedEvent::le_accept;
+        break;
+      case TypedCallback::cb_order_reject:
+        event.type = LoggedEvent::le_reject;
+        event.reason = cb.reject_reason;
+        break;
+      case TypedCallback::cb_order_fill:
+        event.type = LoggedEvent::le_fill;
+        event.matched_order_id = order_ids_(cb.matched_order);
+        event.qty = cb.fill_qty;
+        event.price = cb.fill_price;
+        break;
+      case TypedCallback::cb_order_cancel:
+        event.type = LoggedEvent::le_cancel;
+        break;
+      case TypedCallback::cb_order_cancel_reject:
+        event.type = LoggedEvent::le_cancel_reject;
+        event.reason = cb.reject_reason;
+        break;
+      case TypedCallback::cb_order_replace:
+        event.type = LoggedEvent::le_replace;
+        event.qty = cb.new_order_qty;
+        event.price = cb.new_price;
+        break;
+      case TypedCallback::cb_order_replace_reject:
+        event.type = LoggedEvent::le_replace_reject;
+        event.reason = cb.reject_reason;
+        break;
+      default:
+        break;
+    }
+    if (event.type) {
+      log_->log(event);
+    }
+  }
+  TypedOrderBook::perform_callback(cb);
+}
+
+} }
+
+#endif
@@ -0,0 +1,634 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef itch_feed_h
+#define itch_feed_h
+
+#include "simple_order_book.h"
+#include "book/book_manager.h"
+#include "book/types.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace liquibook { namespace impl {
+
+/// @brief a file mapped read only into memory, for sequential parsing.
+///        POSIX only.
+class MappedFile {
+public:
+  /// @brief map a file, as a whole
+  /// @param path the path of the file
+  explicit MappedFile(const std::string& path);
+
+  /// @brief unmap the file
+  ~MappedFile();
+
+  /// @brief get the address of the mapping
+  const char* data() const;
+
+  /// @brief get the size of the file
+  size_t size() const;
+
+private:
+  // Not copyable
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const char* data_;
+  size_t size_;
+};
+
+/// @brief fields of the ITCH 5.0 messages handled, by offset within the
+///        message.  Integers are big endian, prices have 4 implied decimals.
+struct ItchMessage {
+  enum Type {
+    im_stock_directory = 'R',
+    im_add = 'A',
+    im_add_attributed = 'F',
+    im_executed = 'E',
+    im_executed_with_price = 'C',
+    im_cancel = 'X',
+    im_delete = 'D',
+    im_replace = 'U'
+  };
+  enum Offset {
+    TYPE = 0,
+    STOCK_LOCATE = 1,
+    ORDER_REF = 11,          // all order messages
+    STOCK = 11,              // stock directory
+    ADD_SIDE = 19,
+    ADD_SHARES = 20,
+    ADD_STOCK = 24,
+    ADD_PRICE = 32,
+    EXECUTED_SHARES = 19,    // executed, executed with price
+    CANCELLED_SHARES = 19,
+    REPLACE_NEW_ORDER_REF = 19,
+    REPLACE_SHARES = 27,
+    REPLACE_PRICE = 31
+  };
+  enum Size {
+    STOCK_SIZE = 8,
+    STOCK_DIRECTORY_SIZE = 39,
+    ADD_SIZE = 36,
+    ADD_ATTRIBUTED_SIZE = 40,
+    EXECUTED_SIZE = 31,
+    EXECUTED_WITH_PRICE_SIZE = 36,
+    CANCEL_SIZE = 23,
+    DELETE_SIZE = 19,
+    REPLACE_SIZE = 35
+  };
+};
+
+/// @brief an order of a market-by-order feed, open in a book
+struct FeedOrder {
+  book::SymbolId symbol_id;
+  book::Price price;
+  book::Quantity qty;
+  bool is_buy;
+};
+
+/// @brief open orders of a feed by order reference number.  An open
+///        addressing table of the orders themselves, probed linearly and
+///        compacted on erase, so a lookup touches a slot or two rather than
+///        the bucket and node of a node based map.  Grows at half full.
+class FeedOrderTable {
+public:
+  /// @brief construct
+  /// @param capacity the orders held before growing, rounded up to a power
+  ///        of 2
+  explicit FeedOrderTable(size_t capacity);
+
+  /// @brief add an order
+  /// @return false if an order of the reference number is open
+  bool insert(uint64_t order_ref, const FeedOrder& order);
+
+  /// @brief find an order
+  /// @return the order, or NULL if not open.  Valid until the next insert
+  ///         or erase.
+  FeedOrder* find(uint64_t order_ref);
+
+  /// @brief remove an order found
+  void erase(FeedOrder* order);
+
+  /// @brief get the number of orders open
+  size_t size() const;
+
+private:
+  struct Slot {
+    uint64_t order_ref;  // EMPTY if none
+    FeedOrder order;
+  };
+
+  size_t home(uint64_t order_ref) const;
+  void grow();
+
+  static const uint64_t EMPTY = ~uint64_t(0);
+  std::vector<Slot> slots_;
+  size_t mask_;
+  int shift_;
+  size_t size_;
+};
+
+/// @brief handler of an ITCH 5.0 market-by-order feed, maintaining a book
+///        of each stock from the orders added, executed, cancelled,
+///        deleted and replaced.  Orders are matched by the venue, so the
+///        books' aggregated levels and depths are changed directly, with no
+///        matching and no order objects.  Each level change is a
+///        transaction of the stock's book, for depth publishing.
+///
+///        Messages are parsed in place, as framed in a capture file: each
+///        preceded by its length, a 2 byte big endian integer.  Messages of
+///        other types are skipped.  Requires C++11, and POSIX to read a file.
+template <class TypedOrderBook = SimpleOrderBook<5> >
+class ItchFeedHandler {
+public:
+  typedef book::BookManager<SimpleOrder*, TypedOrderBook> Books;
+
+  /// @brief construct
+  /// @param expected_orders the orders expected to be open at once
+  explicit ItchFeedHandler(size_t expected_orders = 1 << 20);
+
+  /// @brief process every message of a capture file
+  /// @param path the path of the capture
+  /// @return the number of messages processed
+  size_t process_file(const std::string& path);
+
+  /// @brief process framed messages
+  /// @param data the messages, each preceded by its length
+  /// @param size the size of the messages, which must end with a whole one
+  /// @return the number of messages processed
+  size_t process(const char* data, size_t size);
+
+  /// @brief process a single message, without its length
+  /// @param message the message
+  /// @param length the length of the message
+  void process_message(const char* message, size_t length);
+
+  /// @brief access the book of each stock, by symbol
+  Books& books();
+
+  /// @brief find the book of a stock
+  /// @param symbol the symbol of the stock
+  /// @return the book, or NULL if the stock has had no messages
+  TypedOrderBook* find_book(const std::string& symbol);
+
+  /// @brief get the number of orders open
+  size_t order_count() const;
+
+  /// @brief get the number of messages for orders not known, as for orders
+  ///        added before a capture started
+  size_t unknown_orders() const;
+
+  /// @brief read big endian integers
+  static uint16_t read16(const char* data);
+  static uint32_t read32(const char* data);
+  static uint64_t read64(const char* data);
+
+private:
+  /// @brief get the id of the book of a stock, adding the book if new
+  book::SymbolId symbol_id(uint16_t stock_locate, const char* stock);
+
+  void add(const char* message);
+  void reduce(const char* message, book::Quantity qty);
+  void remove(const char* message);
+  void replace(const char* message);
+
+  /// @brief find an order, noting it if not known
+  FeedOrder* find(const char* message);
+
+  static const book::SymbolId NO_SYMBOL = 0xFFFFFFFF;
+  Books books_;
+  std::vector<book::SymbolId> symbol_ids_;  // by stock locate
+  FeedOrderTable orders_;                   // by order reference number
+  size_t unknown_orders_;
+};
+
+inline
+MappedFile::MappedFile(const std::string& path)
+: data_(NULL),
+  size_(0)
+{
+  int fd = ::open(path.c_str(), O_RDONLY);
+  struct stat status;
+  if (fd < 0 || ::fstat(fd, &status) != 0) {
+    int error = errno;
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    throw std::runtime_error("MappedFile open failed: " + path + ": " +
+                             strerror(error));
+  }
+  size_ = size_t(status.st_size);
+  if (size_) {
+    void* address = ::mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+      int error = errno;
+      ::close(fd);
+      throw std::runtime_error("MappedFile map failed: " + path + ": " +
+                               strerror(error));
+    }
+    // Read ahead, as the file is parsed front to back
+    ::madvise(address, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char*>(address);
+  }
+  ::close(fd);
+}
+
+inline
+MappedFile::~MappedFile()
+{
+  if (data_) {
+    ::munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+inline const char*
+MappedFile::data() const
+{
+  return data_;
+}
+
+inline size_t
+MappedFile::size() const
+{
+  return size_;
+}
+
+inline
+FeedOrderTable::FeedOrderTable(size_t capacity)
+: mask_(0),
+  shift_(64),
+  size_(0)
+{
+  Slot empty;
+  empty.order_ref = EMPTY;
+  // Twice the capacity, as the table grows at half full
+  size_t slot_count = 2;
+  while (slot_count < capacity * 2) {
+    slot_count <<= 1;
+  }
+  slots_.assign(slot_count, empty);
+  mask_ = slot_count - 1;
+  while (slot_count >>= 1) {
+    --shift_;
+  }
+}
+
+inline bool
+FeedOrderTable::insert(uint64_t order_ref, const FeedOrder& order)
+{
+  if ((size_ + 1) * 2 > slots_.size()) {
+    grow();
+  }
+  size_t index = home(order_ref);
+  while (slots_[index].order_ref != EMPTY) {
+    if (slots_[index].order_ref == order_ref) {
+      return false;
+    }
+    index = (index + 1) & mask_;
+  }
+  slots_[index].order_ref = order_ref;
+  slots_[index].order = order;
+  ++size_;
+  return true;
+}
+
+inline FeedOrder*
+FeedOrderTable::find(uint64_t order_ref)
+{
+  size_t index = home(order_ref);
+  while (slots_[index].order_ref != order_ref) {
+    if (slots_[index].order_ref == EMPTY) {
+      return NULL;
+    }
+    index = (index + 1) & mask_;
+  }
+  return &slots_[index].order;
+}
+
+inline void
+FeedOrderTable::erase(FeedOrder* order)
+{
+  size_t hole = reinterpret_cast<Slot*>(
+      reinterpret_cast<char*>(order) - offsetof(Slot, order)) - &slots_[0];
+  // Shift back each later order of the run which may fill the hole, so
+  // every order stays reachable from its home slot
+  size_t index = hole;
+  while (true) {
+    index = (index + 1) & mask_;
+    if (slots_[index].order_ref == EMPTY) {
+      break;
+    }
+    size_t order_home = home(slots_[index].order_ref);
+    if (((index - order_home) & mask_) >= ((index - hole) & mask_)) {
+      slots_[hole] = slots_[index];
+      hole = index;
+    }
+  }
+  slots_[hole].order_ref = EMPTY;
+  --size_;
+}
+
+inline size_t
+FeedOrderTable::size() const
+{
+  return size_;
+}
+
+inline size_t
+FeedOrderTable::home(uint64_t order_ref) const
+{
+  // Fibonacci hashing, spreading the sequential reference numbers of a feed
+  return size_t((order_ref * 0x9E3779B97F4A7C15ULL) >> shift_);
+}
+
+inline void
+FeedOrderTable::grow()
+{
+  std::vector<Slot> slots;
+  slots.swap(slots_);
+  Slot empty;
+  empty.order_ref = EMPTY;
+  slots_.assign(slots.size() * 2, empty);
+  mask_ = slots_.size() - 1;
+  --shift_;
+  size_ = 0;
+  for (size_t index = 0; index < slots.size(); ++index) {
+    if (slots[index].order_ref != EMPTY) {
+      insert(slots[index].order_ref, slots[index].order);
+    }
+  }
+}
+
+template <class TypedOrderBook>
+const book::SymbolId ItchFeedHandler<TypedOrderBook>::NO_SYMBOL;
+
+template <class TypedOrderBook>
+ItchFeedHandler<TypedOrderBook>::ItchFeedHandler(size_t expected_orders)
+: symbol_ids_(65536, NO_SYMBOL),
+  orders_(expected_orders),
+  unknown_orders_(0)
+{
+}
+
+template <class TypedOrderBook>
+size_t
+ItchFeedHandler<TypedOrderBook>::process_file(const std::string& path)
+{
+  MappedFile file(path);
+  return process(file.data(), file.size());
+}
+
+template <class TypedOrderBook>
+size_t
+ItchFeedHandler<TypedOrderBook>::process(const char* data, size_t size)
+{
+  const char* end = data + size;
+  size_t count = 0;
+  while (data != end) {
+    if (end - data < 2) {
+      throw std::runtime_error("ItchFeedHandler message length truncated");
+    }
+    size_t length = read16(data);
+    data += 2;
+    if (size_t(end - data) < length) {
+      throw std::runtime_error("ItchFeedHandler message truncated");
+    }
+    process_message(data, length);
+    data += length;
+    ++count;
+  }
+  return count;
+}
+
+template <class TypedOrderBook>
+inline void
+ItchFeedHandler<TypedOrderBook>::process_message(
+  const char* message,
+  size_t length)
+{
+  if (!length) {
+    return;
+  }
+  switch (message[ItchMessage::TYPE]) {
+    case ItchMessage::im_add:
+      if (length >= ItchMessage::ADD_SIZE) {
+        add(message);
+      }
+      break;
+    case ItchMessage::im_add_attributed:
+      if (length >= ItchMessage::ADD_ATTRIBUTED_SIZE) {
+        add(message);
+      }
+      break;
+    case ItchMessage::im_executed:
+      if (length >= ItchMessage::EXECUTED_SIZE) {
+        reduce(message, read32(message + ItchMessage::EXECUTED_SHARES));
+      }
+      break;
+    case ItchMessage::im_executed_with_price:
+      if (length >= ItchMessage::EXECUTED_WITH_PRICE_SIZE) {
+        reduce(message, read32(message + ItchMessage::EXECUTED_SHARES));
+      }
+      break;
+    case ItchMessage::im_cancel:
+      if (length >= ItchMessage::CANCEL_SIZE) {
+        reduce(message, read32(message + ItchMessage::CANCELLED_SHARES));
+      }
+      break;
+    case ItchMessage::im_delete:
+      if (length >= ItchMessage::DELETE_SIZE) {
+        remove(message);
+      }
+      break;
+    case ItchMessage::im_replace:
+      if (length >= ItchMessage::REPLACE_SIZE) {
+        replace(message);
+      }
+      break;
+    case ItchMessage::im_stock_directory:
+      if (length >= ItchMessage::STOCK_DIRECTORY_SIZE) {
+        symbol_id(read16(message + ItchMessage::STOCK_LOCATE),
+                  message + ItchMessage::STOCK);
+      }
+      break;
+    default:
+      // Not affecting the books
+      break;
+  }
+}
+
+template <class TypedOrderBook>
+inline typename ItchFeedHandler<TypedOrderBook>::Books&
+ItchFeedHandler<TypedOrderBook>::books()
+{
+  return books_;
+}
+
+template <class TypedOrderBook>
+TypedOrderBook*
+ItchFeedHandler<TypedOrderBook>::find_book(const std::string& symbol)
+{
+  book::SymbolId symbol_id;
+  if (books_.find_symbol(symbol, symbol_id)) {
+    return &books_.book(symbol_id);
+  }
+  return NULL;
+}
+
+template <class TypedOrderBook>
+inline size_t
+ItchFeedHandler<TypedOrderBook>::order_count() const
+{
+  return orders_.size();
+}
+
+template <class TypedOrderBook>
+inline size_t
+ItchFeedHandler<TypedOrderBook>::unknown_orders() const
+{
+  return unknown_orders_;
+}
+
+template <class TypedOrderBook>
+inline uint16_t
+ItchFeedHandler<TypedOrderBook>::read16(const char* data)
+{
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  return uint16_t((bytes[0] << 8) | bytes[1]);
+}
+
+// Shifts of bytes, which compilers reduce to a load and byte swap
+template <class TypedOrderBook>
+inline uint32_t
+ItchFeedHandler<TypedOrderBook>::read32(const char* data)
+{
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) |
+         (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+}
+
+template <class TypedOrderBook>
+inline uint64_t
+ItchFeedHandler<TypedOrderBook>::read64(const char* data)
+{
+  return (uint64_t(read32(data)) << 32) | read32(data + 4);
+}
+
+template <class TypedOrderBook>
+inline book::SymbolId
+ItchFeedHandler<TypedOrderBook>::symbol_id(
+  uint16_t stock_locate,
+  const char* stock)
+{
+  book::SymbolId& symbol_id = symbol_ids_[stock_locate];
+  if (symbol_id == NO_SYMBOL) {
+    // Symbols are padded with spaces
+    size_t length = ItchMessage::STOCK_SIZE;
+    while (length && stock[length - 1] == ' ') {
+      --length;
+    }
+    std::string symbol(stock, length);
+    if (!books_.find_symbol(symbol, symbol_id)) {
+      symbol_id = books_.add_book(symbol);
+    }
+  }
+  return symbol_id;
+}
+
+template <class TypedOrderBook>
+inline void
+ItchFeedHandler<TypedOrderBook>::add(const char* message)
+{
+  FeedOrder order;
+  order.symbol_id = symbol_id(read16(message + ItchMessage::STOCK_LOCATE),
+                              message + ItchMessage::ADD_STOCK);
+  order.price = read32(message + ItchMessage::ADD_PRICE);
+  order.qty = read32(message + ItchMessage::ADD_SHARES);
+  order.is_buy = message[ItchMessage::ADD_SIDE] == 'B';
+  if (orders_.insert(read64(message + ItchMessage::ORDER_REF), order)) {
+    books_.book(order.symbol_id).apply_level_change(
+        order.price, 1, int32_t(order.qty), order.is_buy);
+  }
+}
+
+template <class TypedOrderBook>
+inline void
+ItchFeedHandler<TypedOrderBook>::reduce(
+  const char* message,
+  book::Quantity qty)
+{
+  FeedOrder* order = find(message);
+  if (!order) {
+    return;
+  }
+  TypedOrderBook& book = books_.book(order->symbol_id);
+  // Once reduced to nothing, the order leaves the book
+  if (qty >= order->qty) {
+    book.apply_level_change(order->price, -1, -int32_t(order->qty),
+                            order->is_buy);
+    orders_.erase(order);
+  } else {
+    book.apply_level_change(order->price, 0, -int32_t(qty), order->is_buy);
+    order->qty -= qty;
+  }
+}
+
+template <class TypedOrderBook>
+inline void
+ItchFeedHandler<TypedOrderBook>::remove(const char* message)
+{
+  FeedOrder* order = find(message);
+  if (order) {
+    books_.book(order->symbol_id).apply_level_change(
+        order->price, -1, -int32_t(order->qty), order->is_buy);
+    orders_.erase(order);
+  }
+}
+
+template <class TypedOrderBook>
+inline void
+ItchFeedHandler<TypedOrderBook>::replace(const char* message)
+{
+  FeedOrder* order = find(message);
+  if (!order) {
+    return;
+  }
+  // The replacement takes the side and stock of the order, and loses its
+  // priority
+  FeedOrder replacement = *order;
+  replacement.price = read32(message + ItchMessage::REPLACE_PRICE);
+  replacement.qty = read32(message + ItchMessage::REPLACE_SHARES);
+  TypedOrderBook& book = books_.book(order->symbol_id);
+  book.apply_level_change(order->price, -1, -int32_t(order->qty),
+                          order->is_buy);
+  orders_.erase(order);
+  if (orders_.insert(read64(message + ItchMessage::REPLACE_NEW_ORDER_REF),
+                     replacement)) {
+    book.apply_level_change(replacement.price, 1, int32_t(replacement.qty),
+                            replacement.is_buy);
+  }
+}
+
+template <class TypedOrderBook>
+inline FeedOrder*
+ItchFeedHandler<TypedOrderBook>::find(const char* message)
+{
+  FeedOrder* order = orders_.find(read64(message + ItchMessage::ORDER_REF));
+  if (!order) {
+    ++unknown_orders_;
+  }
+  return order;
+}
+
+} }
+
+#endif
@@ -0,0 +1,208 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef journal_replay_h
+#define journal_replay_h
+
+#include "command_journal.h"
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace liquibook { namespace impl {
+
+/// @brief rebuilder of order books from a journal of their commands.  Each
+///        record is applied to the book of its symbol, then the book's
+///        transaction id is verified against the one journaled, so a replay
+///        diverging from the original run is detected at the first record
+///        to differ.  Requires C++11.
+///
+///        Orders are created by a factory, a class with the member function:
+///          OrderPtr operator()(const JournalRecord& add);
+///        and are found by their journaled order id for cancels and replaces.
+///        The factory owns the orders it creates, and gives each the stop
+///        price and display quantity of its record, as a stop or iceberg
+///        order added without them is rejected.
+///
+///        To replay from a checkpoint, restore the books, then note each
+///        order restored.  Records each book has already applied, up to its
+///        transaction id, are skipped.
+///
+///        For speed, callbacks may be suppressed, in which case they are
+///        discarded rather than performed.  Those of replaces are still
+///        performed, as an order must know its new price to be found in the
+///        book again.
+template <class OrderPtr, class Manager, class OrderFactory>
+class JournalReplay {
+public:
+  /// @brief construct
+  /// @param books the books to replay to, one for each symbol id journaled
+  /// @param factory the factory creating the orders added
+  /// @param perform_callbacks false to suppress callbacks
+  JournalReplay(Manager& books,
+                OrderFactory& factory,
+                bool perform_callbacks = true);
+
+  /// @brief note an order of a book restored from a checkpoint
+  /// @param order_id the journaled id of the order
+  /// @param order the order
+  void restore_order(uint32_t order_id, const OrderPtr& order);
+
+  /// @brief apply a record to the book of its symbol, unless already applied
+  void apply(const JournalRecord& record);
+
+  /// @brief apply each record of a journal not yet applied
+  /// @return the number of records applied
+  size_t replay(JournalReader& reader);
+
+  /// @brief get the number of records applied, not counting those skipped
+  size_t applied() const;
+
+  /// @brief find an order added
+  /// @param order_id the journaled id of the order
+  /// @param order the order (out)
+  /// @return true if the order was found
+  bool find_order(uint32_t order_id, OrderPtr& order) const;
+
+private:
+  // Not copyable
+  JournalReplay(const JournalReplay&);
+  JournalReplay& operator=(const JournalReplay&);
+
+  /// @brief find the order of a cancel or replace
+  const OrderPtr& order(const JournalRecord& record) const;
+
+  /// @brief throw an error, noting the record
+  void fail(const char* what, const JournalRecord& record) const;
+
+  typedef std::unordered_map<uint32_t, OrderPtr> Orders;
+  Manager& books_;
+  OrderFactory& factory_;
+  bool perform_callbacks_;
+  size_t applied_;
+  Orders orders_;  // by journaled order id
+};
+
+template <class OrderPtr, class Manager, class OrderFactory>
+JournalReplay<OrderPtr, Manager, OrderFactory>::JournalReplay(
+  Manager& books,
+  OrderFactory& factory,
+  bool perform_callbacks)
+: books_(books),
+  factory_(factory),
+  perform_callbacks_(perform_callbacks),
+  applied_(0)
+{
+}
+
+template <class OrderPtr, class Manager, class OrderFactory>
+inline void
+JournalReplay<OrderPtr, Manager, OrderFactory>::restore_order(
+  uint32_t order_id,
+  const OrderPtr& order)
+{
+  orders_[order_id] = order;
+}
+
+template <class OrderPtr, class Manager, class OrderFactory>
+inline void
+JournalReplay<OrderPtr, Manager, OrderFactory>::apply(
+  const JournalRecord& record)
+{
+  if (record.symbol_id >= books_.size()) {
+    fail("JournalReplay symbol id not known", record);
+  }
+  typename Manager::Book& book = books_.book(record.symbol_id);
+  // If the book already applied the record, as before its checkpoint
+  if (record.trans_id <= book.trans_id()) {
+    return;
+  }
+  switch (record.type) {
+    case JournalRecord::jr_add: {
+      OrderPtr order = factory_(record);
+      orders_[record.order_id] = order;
+      book.add(order, record.conditions);
+      break;
+    }
+    case JournalRecord::jr_cancel:
+      book.cancel(order(record));
+      break;
+    case JournalRecord::jr_replace:
+      book.replace(order(record), record.size_delta, record.new_price);
+      break;
+    default:
+      fail("JournalReplay record type not known", record);
+  }
+  if (perform_callbacks_ || record.type == JournalRecord::jr_replace) {
+    book.perform_callbacks();
+  } else {
+    book.discard_callbacks();
+  }
+  if (book.trans_id() != record.trans_id) {
+    fail("JournalReplay transaction id mismatch", record);
+  }
+  ++applied_;
+}
+
+template <class OrderPtr, class Manager, class OrderFactory>
+size_t
+JournalReplay<OrderPtr, Manager, OrderFactory>::replay(JournalReader& reader)
+{
+  size_t applied = applied_;
+  const JournalRecord* record;
+  while ((record = reader.next()) != NULL) {
+    apply(*record);
+  }
+  return applied_ - applied;
+}
+
+template <class OrderPtr, class Manager, class OrderFactory>
+inline size_t
+JournalReplay<OrderPtr, Manager, OrderFactory>::applied() const
+{
+  return applied_;
+}
+
+template <class OrderPtr, class Manager, class OrderFactory>
+bool
+JournalReplay<OrderPtr, Manager, OrderFactory>::find_order(
+  uint32_t order_id,
+  OrderPtr& order) const
+{
+  typename Orders::const_iterator found = orders_.find(order_id);
+  if (found != orders_.end()) {
+    order = found->second;
+    return true;
+  }
+  return false;
+}
+
+template <class OrderPtr, class Manager, class OrderFactory>
+inline const OrderPtr&
+JournalReplay<OrderPtr, Manager, OrderFactory>::order(
+  const JournalRecord& record) const
+{
+  typename Orders::const_iterator found = orders_.find(record.order_id);
+  if (found == orders_.end()) {
+    fail("JournalReplay order id not known", record);
+  }
+  return found->second;
+}
+
+template <class OrderPtr, class Manager, class OrderFactory>
+void
+JournalReplay<OrderPtr, Manager, OrderFactory>::fail(
+  const char* what,
+  const JournalRecord& record) const
+{
+  std::ostringstream message;
+  message << what << " at record " << applied_
+          << " (symbol id " << record.symbol_id
+          << ", order id " << record.order_id
+          << ", trans id " << record.trans_id << ")";
+  throw std::runtime_error(message.str());
+}
+
+} }
+
+#endif
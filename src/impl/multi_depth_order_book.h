@@ -0,0 +1,76 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef multi_depth_order_book_h
+#define multi_depth_order_book_h
+
+#include "simple_order_book.h"
+
+namespace liquibook { namespace impl {
+
+/// @brief Implementation of order book child class serving several depth
+///        views from the book's single aggregation of price levels: best 
+///        bid and offer, SIZE levels, and every level through bid_levels() 
+///        and ask_levels().  Each view tracks its own publication.
+template <int SIZE = 5>
+class MultiDepthOrderBook : public SimpleOrderBook<SIZE> {
+public:
+  typedef book::Depth<1> BboDepth;
+
+  BboDepth& bbo();
+  const BboDepth& bbo() const;
+
+protected:
+  virtual void on_level_change(const book::DepthLevel& level, 
+                               int32_t count_delta,
+                               int32_t qty_delta,
+                               bool is_bid);
+  virtual void on_restore();
+
+private:
+  BboDepth bbo_;
+};
+
+template <int SIZE>
+inline void
+MultiDepthOrderBook<SIZE>::on_level_change(const book::DepthLevel& level, 
+                                           int32_t count_delta,
+                                           int32_t qty_delta,
+                                           bool is_bid)
+{
+  // Update SIZE levels
+  SimpleOrderBook<SIZE>::on_level_change(level, count_delta, qty_delta, 
+                                         is_bid);
+  // Update BBO, also restoring from the book's levels
+  if (is_bid) {
+    bbo_.update_level(level, this->bid_levels());
+  } else {
+    bbo_.update_level(level, this->ask_levels());
+  }
+}
+
+template <int SIZE>
+inline void
+MultiDepthOrderBook<SIZE>::on_restore()
+{
+  SimpleOrderBook<SIZE>::on_restore();
+  this->populate_depth(bbo_);
+}
+
+template <int SIZE>
+inline typename MultiDepthOrderBook<SIZE>::BboDepth&
+MultiDepthOrderBook<SIZE>::bbo()
+{
+  return bbo_;
+}
+
+template <int SIZE>
+inline const typename MultiDepthOrderBook<SIZE>::BboDepth&
+MultiDepthOrderBook<SIZE>::bbo() const
+{
+  return bbo_;
+}
+
+} }
+
+#endif
@@ -0,0 +1,273 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef run_loop_h
+#define run_loop_h
+
+#include "spsc_queue.h"
+#include "book/types.h"
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdexcept>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+    defined(_M_IX86)
+# include <emmintrin.h>
+# define LIQUIBOOK_CPU_PAUSE() _mm_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+# define LIQUIBOOK_CPU_PAUSE() __asm__ __volatile__("yield")
+#else
+# define LIQUIBOOK_CPU_PAUSE() std::this_thread::yield()
+#endif
+#ifdef __linux__
+# include <pthread.h>
+# include <sched.h>
+#endif
+
+namespace liquibook { namespace impl {
+
+/// @brief a command to an order book, queued to the thread driving it
+template <class OrderPtr>
+struct EngineCommand {
+  enum Type {
+    ec_add,
+    ec_cancel,
+    ec_replace
+  };
+  Type type;
+  book::SymbolId symbol_id;
+  OrderPtr order;
+  OrderConditions conditions;  // add
+  int32_t size_delta;          // replace
+  Price new_price;             // replace
+};
+
+/// @brief busy-polling run loop for a matching thread.  Pins the thread to
+///        a cpu, then polls until stopped, with a configurable wait when
+///        idle.  Requires C++11.
+class RunLoop {
+public:
+  /// @brief what to do when a poll finds no work
+  enum IdleMode {
+    im_spin,     // retry immediately - lowest latency, burns the core
+    im_pause,    // cpu pause instruction, easing the sibling hyperthread
+    im_backoff   // pause, then yield, then sleep, the longer the idle
+  };
+
+  /// @brief construct
+  /// @param cpu the cpu to pin the running thread to, or -1 for none.
+  ///        Throws if out of the range of cpus which may be pinned to.
+  /// @param idle_mode what to do when a poll finds no work
+  explicit RunLoop(int cpu = -1, IdleMode idle_mode = im_pause);
+
+  /// @brief poll until stopped, on the calling thread.  The poller is
+  ///        a class with a member function returning the work done:
+  ///          size_t poll();
+  ///        Once stopped, returns when a poll finds no work.
+  template <class Poller>
+  void run(Poller& poller);
+
+  /// @brief stop running - from any thread
+  void stop();
+
+  /// @brief has the loop been stopped?
+  bool stopped() const;
+
+  /// @brief was the running thread pinned to the loop's cpu?  False until
+  ///        running, or if pinning failed, in which case the loop runs
+  ///        unpinned.
+  bool pinned() const;
+
+  /// @brief pin the calling thread to a cpu (Linux only)
+  /// @return true if pinned, false if failed or the cpu is out of range
+  static bool pin(int cpu);
+
+  /// @brief is a cpu in the range which may be pinned to?
+  static bool valid_cpu(int cpu);
+
+private:
+  /// @brief wait after a number of consecutive idle polls
+  void idle(size_t idle_polls);
+
+  // Idle polls in backoff before yielding, and before sleeping
+  enum {
+    BACKOFF_PAUSE_POLLS = 1024,
+    BACKOFF_YIELD_POLLS = BACKOFF_PAUSE_POLLS + 64
+  };
+
+  int cpu_;
+  IdleMode idle_mode_;
+  std::atomic<bool> stopped_;
+  std::atomic<bool> pinned_;
+};
+
+/// @brief poller driving the books of a BookManager from a command queue.
+///        Commands are applied in batches, after each of which the books'
+///        callbacks are performed.
+template <class OrderPtr, class Manager>
+class BookPoller {
+public:
+  typedef EngineCommand<OrderPtr> Command;
+
+  /// @brief construct
+  /// @param commands the queue of commands, by id within the manager
+  /// @param books the books to apply commands to
+  /// @param batch_size the most commands applied per poll
+  BookPoller(SpscQueue<Command>& commands,
+             Manager& books,
+             size_t batch_size = 64);
+
+  /// @brief apply a batch of commands
+  /// @return the number of commands applied
+  size_t poll();
+
+private:
+  SpscQueue<Command>& commands_;
+  Manager& books_;
+  size_t batch_size_;
+};
+
+inline
+RunLoop::RunLoop(int cpu, IdleMode idle_mode)
+: cpu_(cpu),
+  idle_mode_(idle_mode),
+  stopped_(false),
+  pinned_(false)
+{
+  if (cpu != -1 && !valid_cpu(cpu)) {
+    throw std::runtime_error("RunLoop cpu out of range");
+  }
+}
+
+template <class Poller>
+void
+RunLoop::run(Poller& poller)
+{
+  // Failing to pin is reported through pinned(), as throwing would end
+  // the process from the running thread
+  if (cpu_ >= 0) {
+    pinned_.store(pin(cpu_), std::memory_order_release);
+  }
+  size_t idle_polls = 0;
+  while (true) {
+    if (poller.poll()) {
+      idle_polls = 0;
+    // Else idle - exit if stopped, as there is no work left
+    } else if (stopped_.load(std::memory_order_acquire)) {
+      break;
+    } else {
+      idle(++idle_polls);
+    }
+  }
+}
+
+inline void
+RunLoop::stop()
+{
+  stopped_.store(true, std::memory_order_release);
+}
+
+inline bool
+RunLoop::stopped() const
+{
+  return stopped_.load(std::memory_order_acquire);
+}
+
+inline bool
+RunLoop::pinned() const
+{
+  return pinned_.load(std::memory_order_acquire);
+}
+
+inline bool
+RunLoop::pin(int cpu)
+{
+  if (!valid_cpu(cpu)) {
+    return false;
+  }
+#ifdef __linux__
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
+
+inline bool
+RunLoop::valid_cpu(int cpu)
+{
+#ifdef __linux__
+  // CPU_SET is undefined beyond the set
+  return cpu >= 0 && cpu < CPU_SETSIZE;
+#else
+  return cpu >= 0;
+#endif
+}
+
+inline void
+RunLoop::idle(size_t idle_polls)
+{
+  switch (idle_mode_) {
+    case im_spin:
+      break;
+    case im_pause:
+      LIQUIBOOK_CPU_PAUSE();
+      break;
+    case im_backoff:
+      if (idle_polls < BACKOFF_PAUSE_POLLS) {
+        LIQUIBOOK_CPU_PAUSE();
+      } else if (idle_polls < BACKOFF_YIELD_POLLS) {
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+      break;
+  }
+}
+
+template <class OrderPtr, class Manager>
+BookPoller<OrderPtr, Manager>::BookPoller(
+  SpscQueue<Command>& commands,
+  Manager& books,
+  size_t batch_size)
+: commands_(commands),
+  books_(books),
+  batch_size_(batch_size)
+{
+}
+
+template <class OrderPtr, class Manager>
+inline size_t
+BookPoller<OrderPtr, Manager>::poll()
+{
+  Command command;
+  size_t applied = 0;
+  while (applied < batch_size_ && commands_.pop(command)) {
+    switch (command.type) {
+      case Command::ec_add:
+        books_.add(command.symbol_id, std::move(command.order),
+                   command.conditions);
+        break;
+      case Command::ec_cancel:
+        books_.cancel(command.symbol_id, command.order);
+        break;
+      case Command::ec_replace:
+        books_.replace(command.symbol_id, command.order,
+                       command.size_delta, command.new_price);
+        break;
+    }
+    ++applied;
+  }
+  if (applied) {
+    books_.perform_callbacks();
+  }
+  return applied;
+}
+
+} }
+
+#endif
@@ -0,0 +1,401 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef sharded_engine_h
+#define sharded_engine_h
+
+#include "run_loop.h"
+#include "spsc_queue.h"
+#include "book/book_manager.h"
+#include "book/callback.h"
+#include <atomic>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace liquibook { namespace impl {
+
+using book::SymbolId;
+
+/// @brief a callback of a book of a ShardedEngine
+template <class OrderPtr>
+struct EngineResult {
+  SymbolId symbol_id;  // engine wide id
+  book::Callback<OrderPtr> callback;
+};
+
+/// @brief book of a shard, which queues its callbacks to be performed by
+///        the engine's consumer rather than performing them itself
+template <class OrderPtr, class TypedOrderBook>
+class ShardBook : public TypedOrderBook {
+public:
+  typedef typename TypedOrderBook::TypedCallback TypedCallback;
+  typedef EngineResult<OrderPtr> Result;
+
+  ShardBook()
+  : results_(NULL),
+    loop_(NULL),
+    dropped_(NULL),
+    symbol_id_(0)
+  {
+  }
+
+  /// @brief set where callbacks are queued
+  /// @param results the outbound queue of the shard
+  /// @param loop the run loop of the shard
+  /// @param dropped the count of callbacks the shard dropped
+  /// @param symbol_id the engine wide id of the book's symbol
+  void attach(SpscQueue<Result>* results,
+              const RunLoop* loop,
+              std::atomic<size_t>* dropped,
+              SymbolId symbol_id)
+  {
+    results_ = results;
+    loop_ = loop;
+    dropped_ = dropped;
+    symbol_id_ = symbol_id;
+  }
+
+  /// @brief queue a callback to the shard's outbound queue.  Waits while
+  ///        the queue is full, unless the shard is stopping, when the
+  ///        consumer may no longer be polling, and the callback is dropped.
+  virtual void perform_callback(TypedCallback& cb);
+
+private:
+  SpscQueue<Result>* results_;
+  const RunLoop* loop_;
+  std::atomic<size_t>* dropped_;
+  SymbolId symbol_id_;
+};
+
+/// @brief matching engine partitioning books across worker threads.  Each
+///        worker owns its books exclusively, so books need no locking.  One
+///        producer thread submits commands, queued to the shard of the
+///        symbol, and one consumer thread polls the callbacks of each shard.
+///        Books must be added before the engine is started.  Requires C++11.
+template <class OrderPtr, class TypedOrderBook = book::OrderBook<OrderPtr> >
+class ShardedEngine {
+public:
+  typedef EngineCommand<OrderPtr> Command;
+  typedef EngineResult<OrderPtr> Result;
+  typedef ShardBook<OrderPtr, TypedOrderBook> Book;
+
+  /// @brief construct
+  /// @param shard_count the number of worker threads
+  /// @param queue_capacity the capacity of each inbound and outbound queue
+  /// @param cpus the cpu to pin each worker to, or none to leave unpinned
+  /// @param idle_mode what each worker does when it finds no commands
+  ShardedEngine(size_t shard_count,
+                size_t queue_capacity = 65536,
+                const std::vector<int>& cpus = std::vector<int>(),
+                RunLoop::IdleMode idle_mode = RunLoop::im_pause);
+
+  /// @brief destroy, stopping the workers
+  ~ShardedEngine();
+
+  /// @brief add a book for a symbol, to a shard chosen round robin
+  /// @param symbol the symbol of the security, which must be new
+  /// @return the engine wide id of the symbol
+  SymbolId add_book(const std::string& symbol);
+
+  /// @brief find the engine wide id of a symbol
+  /// @param symbol the symbol to find
+  /// @param symbol_id the id of the symbol (out)
+  /// @return true if the symbol was found
+  bool find_symbol(const std::string& symbol, SymbolId& symbol_id) const;
+
+  /// @brief get the number of shards
+  size_t shard_count() const;
+
+  /// @brief get the shard owning the book of a symbol
+  size_t shard_of(SymbolId symbol_id) const;
+
+  /// @brief start the workers
+  void start();
+
+  /// @brief stop the workers, once their inbound queues are drained.  The
+  ///        callbacks of the commands drained are dropped if a results
+  ///        queue is full, so stopping never waits on the consumer.
+  void stop();
+
+  /// @brief submit an add - producer thread only
+  /// @return false if the shard's inbound queue is full
+  bool add(SymbolId symbol_id,
+           const OrderPtr& order,
+           OrderConditions conditions = 0);
+
+  /// @brief submit a cancel - producer thread only
+  /// @return false if the shard's inbound queue is full
+  bool cancel(SymbolId symbol_id, const OrderPtr& order);
+
+  /// @brief submit a replace - producer thread only
+  /// @return false if the shard's inbound queue is full
+  bool replace(SymbolId symbol_id,
+               const OrderPtr& order,
+               int32_t size_delta = SIZE_UNCHANGED,
+               Price new_price = PRICE_UNCHANGED);
+
+  /// @brief take the next callback of a shard - consumer thread only
+  /// @param shard the shard to poll
+  /// @param result the callback (out)
+  /// @return false if there is none
+  bool poll(size_t shard, Result& result);
+
+  /// @brief get the number of callbacks of a shard dropped while stopping,
+  ///        as its results queue was full
+  size_t dropped(size_t shard) const;
+
+  /// @brief was the worker of a shard pinned to its cpu, once started?
+  bool pinned(size_t shard) const;
+
+private:
+  // Not copyable
+  ShardedEngine(const ShardedEngine&);
+  ShardedEngine& operator=(const ShardedEngine&);
+
+  typedef book::BookManager<OrderPtr, Book> Books;
+
+  struct Shard {
+    Shard(size_t queue_capacity, int cpu, RunLoop::IdleMode idle_mode)
+    : commands(queue_capacity),
+      results(queue_capacity),
+      poller(commands, books),
+      loop(cpu, idle_mode),
+      dropped(0)
+    {
+    }
+    Books books;
+    SpscQueue<Command> commands;
+    SpscQueue<Result> results;
+    BookPoller<OrderPtr, Books> poller;
+    RunLoop loop;
+    std::atomic<size_t> dropped;
+    std::thread worker;
+  };
+
+  struct Location {
+    size_t shard;
+    SymbolId symbol_id;  // id within the shard
+  };
+
+  /// @brief queue a command to the shard of a symbol
+  bool submit(SymbolId symbol_id, Command& command);
+
+  /// @brief run a shard's worker until stopped
+  static void run(Shard* shard);
+
+  std::vector<Shard*> shards_;
+  std::vector<Location> locations_;  // indexed by engine wide symbol id
+  std::map<std::string, SymbolId> symbol_ids_;
+  bool started_;
+};
+
+template <class OrderPtr, class TypedOrderBook>
+void
+ShardBook<OrderPtr, TypedOrderBook>::perform_callback(TypedCallback& cb)
+{
+  Result result;
+  result.symbol_id = symbol_id_;
+  result.callback = cb;
+  // Wait for the consumer rather than drop a callback, unless stopping
+  while (!results_->push(result)) {
+    if (loop_->stopped()) {
+      dropped_->fetch_add(1, std::memory_order_relaxed);
+      break;
+    }
+    std::this_thread::yield();
+  }
+}
+
+template <class OrderPtr, class TypedOrderBook>
+ShardedEngine<OrderPtr, TypedOrderBook>::ShardedEngine(
+  size_t shard_count,
+  size_t queue_capacity,
+  const std::vector<int>& cpus,
+  RunLoop::IdleMode idle_mode)
+: started_(false)
+{
+  if (!shard_count) {
+    throw std::runtime_error("ShardedEngine needs at least one shard");
+  }
+  for (size_t index = 0; index < shard_count; ++index) {
+    int cpu = index < cpus.size() ? cpus[index] : -1;
+    shards_.push_back(new Shard(queue_capacity, cpu, idle_mode));
+  }
+}
+
+template <class OrderPtr, class TypedOrderBook>
+ShardedEngine<OrderPtr, TypedOrderBook>::~ShardedEngine()
+{
+  stop();
+  for (size_t index = 0; index < shards_.size(); ++index) {
+    delete shards_[index];
+  }
+}
+
+template <class OrderPtr, class TypedOrderBook>
+SymbolId
+ShardedEngine<OrderPtr, TypedOrderBook>::add_book(const std::string& symbol)
+{
+  if (started_) {
+    throw std::runtime_error("ShardedEngine books must be added before start");
+  }
+  SymbolId symbol_id = SymbolId(locations_.size());
+  if (!symbol_ids_.insert(std::make_pair(symbol, symbol_id)).second) {
+    throw std::runtime_error("ShardedEngine symbol already has a book");
+  }
+  Location location;
+  location.shard = symbol_id % shards_.size();
+  Shard& shard = *shards_[location.shard];
+  location.symbol_id = shard.books.add_book(symbol);
+  shard.books.book(location.symbol_id).attach(&shard.results, &shard.loop,
+                                              &shard.dropped, symbol_id);
+  locations_.push_back(location);
+  return symbol_id;
+}
+
+template <class OrderPtr, class TypedOrderBook>
+bool
+ShardedEngine<OrderPtr, TypedOrderBook>::find_symbol(
+  const std::string& symbol,
+  SymbolId& symbol_id) const
+{
+  std::map<std::string, SymbolId>::const_iterator found = 
+      symbol_ids_.find(symbol);
+  if (found != symbol_ids_.end()) {
+    symbol_id = found->second;
+    return true;
+  }
+  return false;
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline size_t
+ShardedEngine<OrderPtr, TypedOrderBook>::shard_count() const
+{
+  return shards_.size();
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline size_t
+ShardedEngine<OrderPtr, TypedOrderBook>::shard_of(SymbolId symbol_id) const
+{
+  return locations_[symbol_id].shard;
+}
+
+template <class OrderPtr, class TypedOrderBook>
+void
+ShardedEngine<OrderPtr, TypedOrderBook>::start()
+{
+  if (started_) {
+    return;
+  }
+  started_ = true;
+  for (size_t index = 0; index < shards_.size(); ++index) {
+    shards_[index]->worker = std::thread(&ShardedEngine::run, shards_[index]);
+  }
+}
+
+template <class OrderPtr, class TypedOrderBook>
+void
+ShardedEngine<OrderPtr, TypedOrderBook>::stop()
+{
+  for (size_t index = 0; index < shards_.size(); ++index) {
+    shards_[index]->loop.stop();
+  }
+  for (size_t index = 0; index < shards_.size(); ++index) {
+    if (shards_[index]->worker.joinable()) {
+      shards_[index]->worker.join();
+    }
+  }
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline bool
+ShardedEngine<OrderPtr, TypedOrderBook>::add(
+  SymbolId symbol_id,
+  const OrderPtr& order,
+  OrderConditions conditions)
+{
+  Command command;
+  command.type = Command::ec_add;
+  command.order = order;
+  command.conditions = conditions;
+  return submit(symbol_id, command);
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline bool
+ShardedEngine<OrderPtr, TypedOrderBook>::cancel(
+  SymbolId symbol_id,
+  const OrderPtr& order)
+{
+  Command command;
+  command.type = Command::ec_cancel;
+  command.order = order;
+  return submit(symbol_id, command);
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline bool
+ShardedEngine<OrderPtr, TypedOrderBook>::replace(
+  SymbolId symbol_id,
+  const OrderPtr& order,
+  int32_t size_delta,
+  Price new_price)
+{
+  Command command;
+  command.type = Command::ec_replace;
+  command.order = order;
+  command.size_delta = size_delta;
+  command.new_price = new_price;
+  return submit(symbol_id, command);
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline bool
+ShardedEngine<OrderPtr, TypedOrderBook>::poll(size_t shard, Result& result)
+{
+  return shards_[shard]->results.pop(result);
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline size_t
+ShardedEngine<OrderPtr, TypedOrderBook>::dropped(size_t shard) const
+{
+  return shards_[shard]->dropped.load(std::memory_order_relaxed);
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline bool
+ShardedEngine<OrderPtr, TypedOrderBook>::pinned(size_t shard) const
+{
+  return shards_[shard]->loop.pinned();
+}
+
+template <class OrderPtr, class TypedOrderBook>
+inline bool
+ShardedEngine<OrderPtr, TypedOrderBook>::submit(
+  SymbolId symbol_id,
+  Command& command)
+{
+  if (symbol_id >= locations_.size()) {
+    throw std::runtime_error("ShardedEngine symbol id not known");
+  }
+  const Location& location = locations_[symbol_id];
+  command.symbol_id = location.symbol_id;
+  return shards_[location.shard]->commands.push(command);
+}
+
+template <class OrderPtr, class TypedOrderBook>
+void
+ShardedEngine<OrderPtr, TypedOrderBook>::run(Shard* shard)
+{
+  shard->loop.run(shard->poller);
+}
+
+} }
+
+#endif
@@ -0,0 +1,389 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef shm_order_entry_h
+#define shm_order_entry_h
+
+#include "shm_ring.h"
+#include "book/types.h"
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+namespace liquibook { namespace impl {
+
+/// @brief a command from a client process, as plain data
+struct ShmCommand {
+  enum Type {
+    sc_add,
+    sc_cancel,
+    sc_replace
+  };
+  uint32_t client_id;                 // set by ShmOrderClient on submit
+  uint32_t client_order_id;           // the client's id for the order
+  book::SymbolId symbol_id;
+  uint8_t type;
+  uint8_t is_buy;                     // add
+  uint16_t reserved;
+  book::Price price;                  // add
+  book::Quantity qty;                 // add
+  book::OrderConditions conditions;   // add
+  book::Price stop_price;             // add, of a stop order
+  book::Quantity display_qty;         // add, of an iceberg order
+  int32_t size_delta;                 // replace
+  book::Price new_price;              // replace
+};
+
+/// @brief a response to a client process, as plain data
+struct ShmResponse {
+  enum Type {
+    sr_accept,
+    sr_reject,
+    sr_fill,
+    sr_cancel,
+    sr_cancel_reject,
+    sr_replace,
+    sr_replace_reject
+  };
+  uint32_t client_order_id;
+  uint8_t type;
+  uint8_t reserved[3];
+  book::Quantity qty;                 // fill, replace
+  book::Price price;                  // fill, replace
+  book::TransId trans_id;
+};
+
+/// @brief layout of the order entry memory, followed by the slot of each
+///        client, the command ring, then the response ring of each client
+struct ShmOrderEntryHeader {
+  std::atomic<uint32_t> magic;  // set once initialized
+  uint32_t max_clients;
+  uint32_t command_capacity;
+  uint32_t response_capacity;
+  std::atomic<uint32_t> client_count;
+  char pad[64 - 5 * sizeof(uint32_t)];
+
+  static const uint32_t MAGIC = 0x4C424F45;  // "LBOE"
+};
+
+/// @brief matching process side of a shared memory order entry.  Creates
+///        the memory, polls the commands of every client and responds to
+///        each through its own ring.  Client processes submit commands with
+///        ShmOrderClient, with no system calls once attached.
+class ShmOrderEntry {
+public:
+  typedef ShmRing<ShmCommand> CommandRing;
+  typedef ShmRing<ShmResponse> ResponseRing;
+
+  /// @brief create the order entry memory, replacing any existing
+  /// @param path the path of the memory, e.g. /dev/shm/liquibook_entry
+  /// @param max_clients the number of clients which may attach
+  /// @param command_capacity the capacity of the command ring, a power of 2
+  /// @param response_capacity the capacity of each response ring, a power of 2
+  ShmOrderEntry(const std::string& path,
+                uint32_t max_clients,
+                uint32_t command_capacity = 65536,
+                uint32_t response_capacity = 65536);
+
+  /// @brief remove the memory.  Attached clients keep their mapping.
+  ~ShmOrderEntry();
+
+  /// @brief take the next command of any client
+  /// @param command the command (out)
+  /// @return false if there is none
+  bool poll(ShmCommand& command);
+
+  /// @brief respond to a client
+  /// @param client_id the client, from its command
+  /// @param response the response
+  /// @return false if the client's response ring is full
+  bool respond(uint32_t client_id, const ShmResponse& response);
+
+  /// @brief get the number of clients attached
+  uint32_t client_count() const;
+
+  /// @brief free the slots of clients whose process has exited without
+  ///        detaching, so that other clients may attach in their place
+  /// @return the number of slots freed
+  uint32_t reclaim();
+
+  /// @brief get the size of the memory for a configuration
+  static size_t footprint(uint32_t max_clients,
+                          uint32_t command_capacity,
+                          uint32_t response_capacity);
+
+  /// @brief get the slot of each client, holding the process id of the
+  ///        client attached, or 0 if free
+  static std::atomic<uint32_t>* client_slots(char* memory);
+
+  /// @brief get the address of the command ring
+  static char* command_ring_memory(char* memory,
+                                   const ShmOrderEntryHeader& header);
+
+  /// @brief get the address of a client's response ring
+  static char* response_ring_memory(char* memory,
+                                    const ShmOrderEntryHeader& header,
+                                    uint32_t client_id);
+
+private:
+  /// @brief get the size of the client slots, in whole cache lines
+  static size_t slots_footprint(uint32_t max_clients);
+
+  SharedMemory memory_;
+  ShmOrderEntryHeader* header_;
+  std::atomic<uint32_t>* slots_;
+  CommandRing commands_;
+  std::vector<ResponseRing> responses_;
+};
+
+/// @brief client process side of a shared memory order entry
+class ShmOrderClient {
+public:
+  /// @brief attach to order entry memory, taking the first free client id.
+  ///        Any responses left to a client which had the id are discarded.
+  /// @param path the path of the memory, as created by ShmOrderEntry
+  explicit ShmOrderClient(const std::string& path);
+
+  /// @brief detach, freeing the client id for another client
+  ~ShmOrderClient();
+
+  /// @brief get the id of this client
+  uint32_t client_id() const;
+
+  /// @brief submit a command
+  /// @param command the command, whose client id is set
+  /// @return false if the command ring is full
+  bool submit(ShmCommand& command);
+
+  /// @brief take the next response to this client
+  /// @param response the response (out)
+  /// @return false if there is none
+  bool poll(ShmResponse& response);
+
+private:
+  // Not copyable
+  ShmOrderClient(const ShmOrderClient&);
+  ShmOrderClient& operator=(const ShmOrderClient&);
+
+  /// @brief get the header of the memory, once validated
+  static ShmOrderEntryHeader* validate(SharedMemory& memory);
+
+  /// @brief take the first free client id
+  static uint32_t attach(SharedMemory& memory, ShmOrderEntryHeader* header);
+
+  SharedMemory memory_;
+  ShmOrderEntryHeader* header_;
+  uint32_t client_id_;
+  ShmOrderEntry::CommandRing commands_;
+  ShmOrderEntry::ResponseRing responses_;
+};
+
+inline
+ShmOrderEntry::ShmOrderEntry(
+  const std::string& path,
+  uint32_t max_clients,
+  uint32_t command_capacity,
+  uint32_t response_capacity)
+: memory_(path, footprint(max_clients, command_capacity, response_capacity)),
+  header_(new (memory_.address()) ShmOrderEntryHeader),
+  slots_(client_slots(memory_.address())),
+  commands_(memory_.address() + sizeof(ShmOrderEntryHeader) +
+                slots_footprint(max_clients),
+            command_capacity,
+            true)
+{
+  header_->max_clients = max_clients;
+  header_->command_capacity = command_capacity;
+  header_->response_capacity = response_capacity;
+  header_->client_count.store(0);
+  for (uint32_t client_id = 0; client_id < max_clients; ++client_id) {
+    new (&slots_[client_id]) std::atomic<uint32_t>(0);
+    responses_.push_back(ResponseRing(
+        response_ring_memory(memory_.address(), *header_, client_id),
+        response_capacity,
+        true));
+  }
+  // Clients may attach once initialized
+  header_->magic.store(ShmOrderEntryHeader::MAGIC, std::memory_order_release);
+}
+
+inline
+ShmOrderEntry::~ShmOrderEntry()
+{
+  memory_.remove();
+}
+
+inline bool
+ShmOrderEntry::poll(ShmCommand& command)
+{
+  return commands_.pop(command);
+}
+
+inline bool
+ShmOrderEntry::respond(uint32_t client_id, const ShmResponse& response)
+{
+  // The id comes from memory shared with clients, so is not trusted
+  if (client_id >= responses_.size()) {
+    throw std::runtime_error("ShmOrderEntry client id out of range");
+  }
+  return responses_[client_id].push(response);
+}
+
+inline uint32_t
+ShmOrderEntry::client_count() const
+{
+  return header_->client_count.load(std::memory_order_acquire);
+}
+
+inline uint32_t
+ShmOrderEntry::reclaim()
+{
+  uint32_t freed = 0;
+  for (uint32_t client_id = 0; client_id < header_->max_clients; ++client_id) {
+    uint32_t pid = slots_[client_id].load(std::memory_order_acquire);
+    // A process which exists, but may not be signalled, is alive
+    if (pid && kill(pid_t(pid), 0) != 0 && errno == ESRCH &&
+        slots_[client_id].compare_exchange_strong(pid, 0)) {
+      header_->client_count.fetch_sub(1);
+      ++freed;
+    }
+  }
+  return freed;
+}
+
+inline size_t
+ShmOrderEntry::footprint(
+  uint32_t max_clients,
+  uint32_t command_capacity,
+  uint32_t response_capacity)
+{
+  return sizeof(ShmOrderEntryHeader) +
+         slots_footprint(max_clients) +
+         CommandRing::footprint(command_capacity) +
+         ResponseRing::footprint(response_capacity) * max_clients;
+}
+
+inline size_t
+ShmOrderEntry::slots_footprint(uint32_t max_clients)
+{
+  size_t size = sizeof(std::atomic<uint32_t>) * max_clients;
+  return (size + 63) & ~size_t(63);
+}
+
+inline std::atomic<uint32_t>*
+ShmOrderEntry::client_slots(char* memory)
+{
+  return reinterpret_cast<std::atomic<uint32_t>*>(
+      memory + sizeof(ShmOrderEntryHeader));
+}
+
+inline char*
+ShmOrderEntry::command_ring_memory(
+  char* memory,
+  const ShmOrderEntryHeader& header)
+{
+  return memory + sizeof(ShmOrderEntryHeader) +
+         slots_footprint(header.max_clients);
+}
+
+inline char*
+ShmOrderEntry::response_ring_memory(
+  char* memory,
+  const ShmOrderEntryHeader& header,
+  uint32_t client_id)
+{
+  return command_ring_memory(memory, header) +
+         CommandRing::footprint(header.command_capacity) +
+         ResponseRing::footprint(header.response_capacity) * client_id;
+}
+
+inline
+ShmOrderClient::ShmOrderClient(const std::string& path)
+: memory_(path),
+  header_(validate(memory_)),
+  client_id_(attach(memory_, header_)),
+  commands_(ShmOrderEntry::command_ring_memory(memory_.address(), *header_),
+            header_->command_capacity,
+            false),
+  responses_(ShmOrderEntry::response_ring_memory(memory_.address(),
+                                                 *header_,
+                                                 client_id_),
+             header_->response_capacity,
+             false)
+{
+  ShmResponse stale;
+  while (responses_.pop(stale)) {
+  }
+}
+
+inline
+ShmOrderClient::~ShmOrderClient()
+{
+  ShmOrderEntry::client_slots(memory_.address())[client_id_].store(
+      0, std::memory_order_release);
+  header_->client_count.fetch_sub(1);
+}
+
+inline uint32_t
+ShmOrderClient::client_id() const
+{
+  return client_id_;
+}
+
+inline bool
+ShmOrderClient::submit(ShmCommand& command)
+{
+  command.client_id = client_id_;
+  return commands_.push(command);
+}
+
+inline bool
+ShmOrderClient::poll(ShmResponse& response)
+{
+  return responses_.pop(response);
+}
+
+inline ShmOrderEntryHeader*
+ShmOrderClient::validate(SharedMemory& memory)
+{
+  if (memory.size() < sizeof(ShmOrderEntryHeader)) {
+    throw std::runtime_error("ShmOrderClient memory too small");
+  }
+  ShmOrderEntryHeader* header =
+      reinterpret_cast<ShmOrderEntryHeader*>(memory.address());
+  if (header->magic.load(std::memory_order_acquire) !=
+      ShmOrderEntryHeader::MAGIC) {
+    throw std::runtime_error("ShmOrderClient memory not initialized");
+  }
+  if (memory.size() < ShmOrderEntry::footprint(header->max_clients,
+                                               header->command_capacity,
+                                               header->response_capacity)) {
+    throw std::runtime_error("ShmOrderClient memory too small");
+  }
+  return header;
+}
+
+inline uint32_t
+ShmOrderClient::attach(SharedMemory& memory, ShmOrderEntryHeader* header)
+{
+  std::atomic<uint32_t>* slots = 
+      ShmOrderEntry::client_slots(memory.address());
+  uint32_t pid = uint32_t(getpid());
+  for (uint32_t client_id = 0; client_id < header->max_clients; ++client_id) {
+    uint32_t free_slot = 0;
+    if (slots[client_id].compare_exchange_strong(free_slot, pid)) {
+      header->client_count.fetch_add(1);
+      return client_id;
+    }
+  }
+  throw std::runtime_error("ShmOrderClient no more clients may attach");
+}
+
+} }
+
+#endif
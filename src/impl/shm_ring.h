@@ -0,0 +1,293 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef shm_ring_h
+#define shm_ring_h
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdexcept>
+#include <string>
+#include <new>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace liquibook { namespace impl {
+
+/// @brief a file mapped into memory, such as one under /dev/shm, shared
+///        between processes.  POSIX only.
+class SharedMemory {
+public:
+  /// @brief create a file of a size, replacing any existing, and map it
+  /// @param path the path of the file, e.g. /dev/shm/liquibook
+  /// @param size the size of the file, zero filled
+  SharedMemory(const std::string& path, size_t size);
+
+  /// @brief map an existing file, as a whole
+  /// @param path the path of the file
+  explicit SharedMemory(const std::string& path);
+
+  /// @brief unmap the file
+  ~SharedMemory();
+
+  /// @brief get the address of the mapping
+  char* address() const;
+
+  /// @brief get the size of the mapping
+  size_t size() const;
+
+  /// @brief remove the file - existing mappings remain valid
+  void remove();
+
+  /// @brief write a range of the mapping through to the file's storage
+  /// @param offset the offset of the range
+  /// @param length the length of the range
+  void sync(size_t offset, size_t length);
+
+private:
+  // Not copyable
+  SharedMemory(const SharedMemory&);
+  SharedMemory& operator=(const SharedMemory&);
+
+  /// @brief map the open file
+  void map(int fd);
+
+  /// @brief throw an error, with the description of errno
+  void fail(const char* what, int fd);
+
+  std::string path_;
+  char* address_;
+  size_t size_;
+};
+
+/// @brief bounded multi-producer, single-consumer ring of plain values laid
+///        out in memory it does not own, such as SharedMemory, so producers
+///        in other processes can use it without system calls.  Each slot
+///        carries a sequence number, claimed by producers with a single
+///        compare and swap.  Requires C++11 atomics, which must be lock free.
+template <class T>
+class ShmRing {
+public:
+  /// @brief get the memory needed by a ring
+  /// @param capacity the number of values held, a power of 2
+  static size_t footprint(size_t capacity);
+
+  /// @brief construct over memory
+  /// @param memory the memory of the ring, of footprint(capacity) bytes,
+  ///        aligned to a cache line
+  /// @param capacity the number of values held, a power of 2
+  /// @param initialize true to initialize the ring (once, by its creator)
+  ShmRing(char* memory, size_t capacity, bool initialize);
+
+  /// @brief add a value - any producer
+  /// @return false if the ring is full
+  bool push(const T& value);
+
+  /// @brief remove the oldest value - the single consumer only
+  /// @param value the value removed (out)
+  /// @return false if the ring is empty
+  bool pop(T& value);
+
+  /// @brief get the number of values the ring holds
+  size_t capacity() const;
+
+private:
+  enum { CACHE_LINE_SIZE = 64 };
+
+  struct Header {
+    std::atomic<uint64_t> tail;  // next position to claim by producers
+    char pad0[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> head;  // next position to pop by the consumer
+    char pad1[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+  };
+
+  struct Slot {
+    std::atomic<uint64_t> sequence;
+    T value;
+  };
+
+  Header* header_;
+  Slot* slots_;
+  uint64_t mask_;
+};
+
+inline
+SharedMemory::SharedMemory(const std::string& path, size_t size)
+: path_(path),
+  address_(NULL),
+  size_(size)
+{
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    fail("SharedMemory open failed", fd);
+  }
+  if (::ftruncate(fd, off_t(size)) != 0) {
+    fail("SharedMemory resize failed", fd);
+  }
+  map(fd);
+}
+
+inline
+SharedMemory::SharedMemory(const std::string& path)
+: path_(path),
+  address_(NULL),
+  size_(0)
+{
+  int fd = ::open(path.c_str(), O_RDWR);
+  if (fd < 0) {
+    fail("SharedMemory open failed", fd);
+  }
+  struct stat status;
+  if (::fstat(fd, &status) != 0) {
+    fail("SharedMemory stat failed", fd);
+  }
+  size_ = size_t(status.st_size);
+  map(fd);
+}
+
+inline
+SharedMemory::~SharedMemory()
+{
+  ::munmap(address_, size_);
+}
+
+inline char*
+SharedMemory::address() const
+{
+  return address_;
+}
+
+inline size_t
+SharedMemory::size() const
+{
+  return size_;
+}
+
+inline void
+SharedMemory::remove()
+{
+  ::unlink(path_.c_str());
+}
+
+inline void
+SharedMemory::sync(size_t offset, size_t length)
+{
+  // The range synced must start on a page
+  size_t page_size = size_t(::sysconf(_SC_PAGESIZE));
+  size_t start = offset / page_size * page_size;
+  if (::msync(address_ + start, offset + length - start, MS_SYNC) != 0) {
+    fail("SharedMemory sync failed", -1);
+  }
+}
+
+inline void
+SharedMemory::map(int fd)
+{
+  void* address =
+      ::mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (address == MAP_FAILED) {
+    fail("SharedMemory map failed", fd);
+  }
+  ::close(fd);
+  address_ = static_cast<char*>(address);
+}
+
+inline void
+SharedMemory::fail(const char* what, int fd)
+{
+  std::string message = std::string(what) + ": " + path_ + ": " +
+                        strerror(errno);
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  throw std::runtime_error(message);
+}
+
+template <class T>
+inline size_t
+ShmRing<T>::footprint(size_t capacity)
+{
+  size_t size = sizeof(Header) + sizeof(Slot) * capacity;
+  // Round up, so rings can be laid out one after another
+  return (size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+template <class T>
+ShmRing<T>::ShmRing(char* memory, size_t capacity, bool initialize)
+: header_(reinterpret_cast<Header*>(memory)),
+  slots_(reinterpret_cast<Slot*>(memory + sizeof(Header))),
+  mask_(capacity - 1)
+{
+  if (!capacity || (capacity & mask_)) {
+    throw std::runtime_error("ShmRing capacity must be a power of 2");
+  }
+  if (initialize) {
+    new (&header_->tail) std::atomic<uint64_t>(0);
+    new (&header_->head) std::atomic<uint64_t>(0);
+    for (uint64_t position = 0; position < capacity; ++position) {
+      new (&slots_[position].sequence) std::atomic<uint64_t>(position);
+    }
+  }
+}
+
+template <class T>
+inline bool
+ShmRing<T>::push(const T& value)
+{
+  uint64_t position = header_->tail.load(std::memory_order_relaxed);
+  Slot* slot;
+  while (true) {
+    slot = &slots_[position & mask_];
+    uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    int64_t difference = int64_t(sequence - position);
+    // If the slot is free at this position, claim it
+    if (difference == 0) {
+      if (header_->tail.compare_exchange_weak(position, position + 1,
+                                              std::memory_order_relaxed)) {
+        break;
+      }
+    // Else if the slot is yet to be popped, the ring is full
+    } else if (difference < 0) {
+      return false;
+    // Else another producer claimed it, try again
+    } else {
+      position = header_->tail.load(std::memory_order_relaxed);
+    }
+  }
+  slot->value = value;
+  slot->sequence.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+template <class T>
+inline bool
+ShmRing<T>::pop(T& value)
+{
+  uint64_t position = header_->head.load(std::memory_order_relaxed);
+  Slot* slot = &slots_[position & mask_];
+  // If the slot at this position is not yet published, the ring is empty
+  if (slot->sequence.load(std::memory_order_acquire) != position + 1) {
+    return false;
+  }
+  value = slot->value;
+  // Free the slot for the producer a lap ahead
+  slot->sequence.store(position + mask_ + 1, std::memory_order_release);
+  header_->head.store(position + 1, std::memory_order_relaxed);
+  return true;
+}
+
+template <class T>
+inline size_t
+ShmRing<T>::capacity() const
+{
+  return size_t(mask_ + 1);
+}
+
+} }
+
+#endif
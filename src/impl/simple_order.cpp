@@ -15,13 +15,31 @@ SimpleOrder::SimpleOrder(bool is_buy,
 : state_(os_new),
   is_buy_(is_buy),
   price_(price),
+  stop_price_(0),
   order_qty_(qty),
+  display_qty_(0),
   filled_qty_(0),
   filled_cost_(0),
   order_id_(++last_order_id_)
 {
 }
 
+SimpleOrder::SimpleOrder(bool is_buy,
+                         Price price,
+                         Quantity qty,
+                         uint32_t order_id)
+: state_(os_new),
+  is_buy_(is_buy),
+  price_(price),
+  stop_price_(0),
+  order_qty_(qty),
+  display_qty_(0),
+  filled_qty_(0),
+  filled_cost_(0),
+  order_id_(order_id)
+{
+}
+
 const OrderState&
 SimpleOrder::state() const
 {
@@ -46,6 +64,30 @@ SimpleOrder::order_qty() const
   return order_qty_;
 }
 
+Price
+SimpleOrder::stop_price() const
+{
+  return stop_price_;
+}
+
+void
+SimpleOrder::set_stop_price(Price stop_price)
+{
+  stop_price_ = stop_price;
+}
+
+Quantity
+SimpleOrder::display_qty() const
+{
+  return display_qty_;
+}
+
+void
+SimpleOrder::set_display_qty(Quantity display_qty)
+{
+  display_qty_ = display_qty;
+}
+
 Quantity
 SimpleOrder::open_qty() const
 {
@@ -101,7 +143,9 @@ SimpleOrder::cancel()
 void
 SimpleOrder::replace(Quantity new_order_qty, Price new_price)
 {
-  if (os_accepted == state_) {
+  // An open order may not have been told of its accept, as when callbacks
+  // are discarded on replay
+  if (os_accepted == state_ || os_new == state_) {
     order_qty_ = new_order_qty;
     price_ = new_price;
   }
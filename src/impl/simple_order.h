@@ -26,6 +26,13 @@ public:
               Price price,
               Quantity qty);
 
+  /// @brief construct with an order id assigned elsewhere, such as by a
+  ///        SimpleOrderStore, rather than from the global sequence
+  SimpleOrder(bool is_buy,
+              Price price,
+              Quantity qty,
+              uint32_t order_id);
+
   /// @brief get the order's state
   const OrderState& state() const;
 
@@ -38,6 +45,20 @@ public:
   /// @brief get the quantity of this order
   virtual Quantity order_qty() const;
 
+  /// @brief get the price at which this order is triggered, if a stop order
+  virtual Price stop_price() const;
+
+  /// @brief set the price at which this order is triggered, before adding
+  ///        as a stop order
+  void set_stop_price(Price stop_price);
+
+  /// @brief get the quantity shown at a time, if an iceberg order
+  virtual Quantity display_qty() const;
+
+  /// @brief set the quantity shown at a time, before adding as an iceberg
+  ///        order
+  void set_display_qty(Quantity display_qty);
+
   /// @brief get the open quantity of this order
   virtual Quantity open_qty() const;
 
@@ -69,7 +90,9 @@ private:
   OrderState state_;
   bool is_buy_;
   Price    price_;
+  Price    stop_price_;
   Quantity order_qty_;
+  Quantity display_qty_;
   Quantity filled_qty_;
   Cost filled_cost_;
   static uint32_t last_order_id_;
@@ -12,8 +12,8 @@
 namespace liquibook { namespace impl {
 
 /// @brief Implementation of order book child class, for unit and performance 
-///        testing purposes.  Overrides perform_callback() method to track
-///        depth aggregated by price.
+///        testing purposes.  Overrides perform_callback() method to update
+///        orders, and on_level_change() to track depth aggregated by price.
 template <int SIZE = 5>
 class SimpleOrderBook : 
       public book::OrderBook<SimpleOrder*> {
@@ -27,6 +27,13 @@ public:
   SimpleDepth& depth();
   const SimpleDepth& depth() const;
 
+protected:
+  virtual void on_level_change(const book::DepthLevel& level, 
+                               int32_t count_delta,
+                               int32_t qty_delta,
+                               bool is_bid);
+  virtual void on_restore();
+
 private:
   FillId fill_id_;
   SimpleDepth depth_;
@@ -46,40 +53,9 @@ SimpleOrderBook<SIZE>::perform_callback(SimpleCallback& cb)
   switch(cb.type) {
     case SimpleCallback::cb_order_accept:
       cb.order->accept();
-      // If the order is a limit order
-      if (cb.order->is_limit()) {
-        // If the order is completely filled on acceptance, do not modify 
-        // depth unnecessarily
-        if (cb.match_qty == cb.order->order_qty()) {
-          // Don't tell depth about this order - it's going away immediately.
-          // Instead tell Depth about future fills to ignore
-          depth_.ignore_fill_qty(cb.match_qty, cb.order->is_buy());
-        } else {
-          // Add to bid or ask depth
-          depth_.add_order(cb.order->price(), 
-                           cb.order->order_qty(), 
-                           cb.order->is_buy());
-        }
-      }
       break;
 
     case SimpleCallback::cb_order_fill: {
-      // If the matched order is a limit order
-      if (cb.matched_order->is_limit()) {
-        // Inform the depth
-        depth_.fill_order(cb.matched_order->price(), 
-                          cb.matched_order->open_qty(),
-                          cb.fill_qty,
-                          cb.matched_order->is_buy());
-      }
-      // If the inbound order is a limit order
-      if (cb.order->is_limit()) {
-        // Inform the depth
-        depth_.fill_order(cb.order->price(), 
-                          cb.order->open_qty(),
-                          cb.fill_qty,
-                          cb.order->is_buy());
-      }
       // Increment fill ID once
       ++fill_id_;
       // Update the orders
@@ -89,37 +65,42 @@ SimpleOrderBook<SIZE>::perform_callback(SimpleCallback& cb)
       break;
     }
     case SimpleCallback::cb_order_cancel:
-      // If the order is a limit order
-      if (cb.order->is_limit()) {
-        // If the close erases a level
-        depth_.close_order(cb.order->price(), 
-                           cb.order->open_qty(), 
-                           cb.order->is_buy());
-      }
       cb.order->cancel();
       break;
 
     case SimpleCallback::cb_order_replace:
-    {
-      // Remember current values
-      Price current_price = cb.order->price();
-      Quantity current_qty = cb.order->open_qty();
-
       // Modify the order itself
       cb.order->replace(cb.new_order_qty, cb.new_price);
-
-      // Notify the depth
-      depth_.replace_order(current_price, cb.new_price, 
-                           current_qty, cb.order->open_qty(),
-                           cb.order->is_buy());
       break;
-    }
+
     default:
       // Nothing
       break;
   }
 }
 
+template <int SIZE>
+inline void
+SimpleOrderBook<SIZE>::on_level_change(const book::DepthLevel& level, 
+                                       int32_t ,
+                                       int32_t ,
+                                       bool is_bid)
+{
+  // Restore from the book's levels, so depth needs no excess levels
+  if (is_bid) {
+    depth_.update_level(level, bid_levels());
+  } else {
+    depth_.update_level(level, ask_levels());
+  }
+}
+
+template <int SIZE>
+inline void
+SimpleOrderBook<SIZE>::on_restore()
+{
+  this->populate_depth(depth_);
+}
+
 template <int SIZE>
 inline typename SimpleOrderBook<SIZE>::SimpleDepth&
 SimpleOrderBook<SIZE>::depth()
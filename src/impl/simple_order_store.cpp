@@ -0,0 +1,77 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#include "simple_order_store.h"
+
+#include <new>
+#include <stdexcept>
+
+namespace liquibook { namespace impl {
+
+SimpleOrderStore::SimpleOrderStore(size_t slab_size)
+: slab_size_(slab_size),
+  slab_used_(slab_size),  // No slab yet
+  outstanding_(0),
+  last_order_id_(0)
+{
+  if (!slab_size_) {
+    throw std::runtime_error("SimpleOrderStore slab size must be positive");
+  }
+}
+
+SimpleOrderStore::~SimpleOrderStore()
+{
+  Orders::iterator slab;
+  for (slab = slabs_.begin(); slab != slabs_.end(); ++slab) {
+    ::operator delete(*slab);
+  }
+}
+
+SimpleOrder*
+SimpleOrderStore::create(bool is_buy, Price price, Quantity qty)
+{
+  void* memory;
+  // If there is a recycled order, reuse it
+  if (!free_orders_.empty()) {
+    memory = free_orders_.back();
+    free_orders_.pop_back();
+  // Else take the next order of the last slab, allocating one if it is full
+  } else {
+    if (slab_used_ == slab_size_) {
+      slabs_.push_back(static_cast<SimpleOrder*>(
+          ::operator new(sizeof(SimpleOrder) * slab_size_)));
+      slab_used_ = 0;
+    }
+    memory = slabs_.back() + slab_used_++;
+  }
+  ++outstanding_;
+  return new (memory) SimpleOrder(is_buy, price, qty, ++last_order_id_);
+}
+
+void
+SimpleOrderStore::recycle(SimpleOrder* order)
+{
+  order->~SimpleOrder();
+  free_orders_.push_back(order);
+  --outstanding_;
+}
+
+size_t
+SimpleOrderStore::size() const
+{
+  return outstanding_;
+}
+
+size_t
+SimpleOrderStore::capacity() const
+{
+  return slabs_.size() * slab_size_;
+}
+
+uint32_t
+SimpleOrderStore::last_order_id() const
+{
+  return last_order_id_;
+}
+
+} }
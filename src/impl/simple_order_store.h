@@ -0,0 +1,62 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef simple_order_store_h
+#define simple_order_store_h
+
+#include "simple_order.h"
+#include <stddef.h>
+#include <vector>
+
+namespace liquibook { namespace impl {
+
+/// @brief allocator of SimpleOrders from contiguous slabs, rather than one
+///        by one from the heap.  Orders no longer referred to (by the book,
+///        or by callbacks yet to be performed) are recycled for reuse.  Each
+///        store assigns its own order ids, starting from 1.
+class SimpleOrderStore {
+public:
+  /// @brief construct
+  /// @param slab_size the number of orders in each slab
+  explicit SimpleOrderStore(size_t slab_size = 4096);
+
+  /// @brief release every slab.  Orders still outstanding are not destroyed,
+  ///        as SimpleOrder holds no resources.
+  ~SimpleOrderStore();
+
+  /// @brief create an order, reusing a recycled one if there is one
+  /// @param is_buy indicator of buy or sell
+  /// @param price the limit price of the order, or 0 if a market order
+  /// @param qty the quantity of the order
+  SimpleOrder* create(bool is_buy, Price price, Quantity qty);
+
+  /// @brief recycle an order, once no longer referred to
+  /// @param order the order, created by this store
+  void recycle(SimpleOrder* order);
+
+  /// @brief get the number of orders outstanding (created, not recycled)
+  size_t size() const;
+
+  /// @brief get the number of orders the slabs allocated so far can hold
+  size_t capacity() const;
+
+  /// @brief get the last order id assigned
+  uint32_t last_order_id() const;
+
+private:
+  // Not copyable
+  SimpleOrderStore(const SimpleOrderStore&);
+  SimpleOrderStore& operator=(const SimpleOrderStore&);
+
+  typedef std::vector<SimpleOrder*> Orders;
+  Orders slabs_;          // first order of each slab
+  Orders free_orders_;    // recycled orders
+  size_t slab_size_;
+  size_t slab_used_;      // orders taken from the last slab
+  size_t outstanding_;
+  uint32_t last_order_id_;
+};
+
+} }
+
+#endif
@@ -0,0 +1,134 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef spsc_queue_h
+#define spsc_queue_h
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+namespace liquibook { namespace impl {
+
+/// @brief bounded lock-free queue between one producer thread and one
+///        consumer thread.  Requires C++11 atomics.  The producer and
+///        consumer positions are kept on separate cache lines, each with a
+///        cached copy of the other's, so neither side touches the other's
+///        line until it appears full or empty.
+template <class T>
+class SpscQueue {
+public:
+  /// @brief construct
+  /// @param capacity the number of values held, rounded up to a power of 2
+  explicit SpscQueue(size_t capacity);
+
+  /// @brief add a value - producer thread only
+  /// @return false if the queue is full
+  bool push(const T& value);
+
+  /// @brief remove the oldest value - consumer thread only
+  /// @param value the value removed (out)
+  /// @return false if the queue is empty
+  bool pop(T& value);
+
+  /// @brief is the queue empty?  Approximate while the other side runs.
+  bool empty() const;
+
+  /// @brief get the number of values the queue holds
+  size_t capacity() const;
+
+private:
+  // Not copyable
+  SpscQueue(const SpscQueue&);
+  SpscQueue& operator=(const SpscQueue&);
+
+  static size_t round_up(size_t capacity);
+
+  enum { CACHE_LINE_SIZE = 64 };
+  std::vector<T> slots_;
+  const size_t mask_;
+  // Consumer's line
+  char pad0_[CACHE_LINE_SIZE];
+  std::atomic<size_t> head_;  // next to pop
+  size_t cached_tail_;
+  // Producer's line
+  char pad1_[CACHE_LINE_SIZE];
+  std::atomic<size_t> tail_;  // next to push
+  size_t cached_head_;
+  char pad2_[CACHE_LINE_SIZE];
+};
+
+template <class T>
+SpscQueue<T>::SpscQueue(size_t capacity)
+: slots_(round_up(capacity)),
+  mask_(slots_.size() - 1),
+  head_(0),
+  cached_tail_(0),
+  tail_(0),
+  cached_head_(0)
+{
+}
+
+template <class T>
+inline bool
+SpscQueue<T>::push(const T& value)
+{
+  size_t tail = tail_.load(std::memory_order_relaxed);
+  // If full as last known, refresh the consumer's position
+  if (tail - cached_head_ > mask_) {
+    cached_head_ = head_.load(std::memory_order_acquire);
+    if (tail - cached_head_ > mask_) {
+      return false;
+    }
+  }
+  slots_[tail & mask_] = value;
+  tail_.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+template <class T>
+inline bool
+SpscQueue<T>::pop(T& value)
+{
+  size_t head = head_.load(std::memory_order_relaxed);
+  // If empty as last known, refresh the producer's position
+  if (head == cached_tail_) {
+    cached_tail_ = tail_.load(std::memory_order_acquire);
+    if (head == cached_tail_) {
+      return false;
+    }
+  }
+  value = slots_[head & mask_];
+  head_.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+template <class T>
+inline bool
+SpscQueue<T>::empty() const
+{
+  return head_.load(std::memory_order_acquire) ==
+         tail_.load(std::memory_order_acquire);
+}
+
+template <class T>
+inline size_t
+SpscQueue<T>::capacity() const
+{
+  return slots_.size();
+}
+
+template <class T>
+size_t
+SpscQueue<T>::round_up(size_t capacity)
+{
+  size_t result = 1;
+  while (result < capacity) {
+    result <<= 1;
+  }
+  return result;
+}
+
+} }
+
+#endif
@@ -0,0 +1,284 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#ifndef standby_replica_h
+#define standby_replica_h
+
+#include "journal_replay.h"
+#include "shm_ring.h"
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace liquibook { namespace impl {
+
+/// @brief layout of the replication memory, followed by its ring
+struct ReplicationHeader {
+  std::atomic<uint32_t> magic;  // set once initialized
+  uint32_t capacity;
+  char pad[64 - 2 * sizeof(uint32_t)];
+
+  static const uint32_t MAGIC = 0x4C425250;  // "LBRP"
+};
+
+/// @brief primary side of a shared memory replication channel.  Creates the
+///        memory, then publishes each command as journaled, for a standby
+///        process to apply with a ReplicationSubscriber.
+class ReplicationPublisher {
+public:
+  typedef ShmRing<JournalRecord> RecordRing;
+
+  /// @brief create the replication memory, replacing any existing
+  /// @param path the path of the memory, e.g. /dev/shm/liquibook_standby
+  /// @param capacity the capacity of the ring, a power of 2
+  explicit ReplicationPublisher(const std::string& path,
+                                uint32_t capacity = 65536);
+
+  /// @brief remove the memory.  An attached standby keeps its mapping.
+  ~ReplicationPublisher();
+
+  /// @brief publish a command, waiting for the standby rather than drop it
+  /// @param record the command, with the transaction id it was applied at
+  void publish(const JournalRecord& record);
+
+  /// @brief publish a command unless the ring is full
+  /// @return false if the ring is full
+  bool try_publish(const JournalRecord& record);
+
+  /// @brief get the size of the memory for a capacity
+  static size_t footprint(uint32_t capacity);
+
+private:
+  SharedMemory memory_;
+  ReplicationHeader* header_;
+  RecordRing records_;
+};
+
+/// @brief standby side of a shared memory replication channel
+class ReplicationSubscriber {
+public:
+  /// @brief attach to replication memory
+  /// @param path the path of the memory, as created by ReplicationPublisher
+  explicit ReplicationSubscriber(const std::string& path);
+
+  /// @brief take the next command published
+  /// @return the command, or NULL if none is yet published.  Valid until
+  ///         the next is taken.
+  const JournalRecord* next();
+
+private:
+  /// @brief get the header of the memory, once validated
+  static ReplicationHeader* validate(SharedMemory& memory);
+
+  SharedMemory memory_;
+  ReplicationHeader* header_;
+  ReplicationPublisher::RecordRing records_;
+  JournalRecord record_;
+};
+
+/// @brief hot standby of a primary's books.  Applies the primary's commands
+///        as they are published, from a command journal the primary is
+///        writing (a JournalReader) or from shared memory (a
+///        ReplicationSubscriber), so its books stay in step with the
+///        primary's.  Each command is verified to reach the primary's
+///        transaction id.  Requires C++11.
+///
+///        The source is a class with the member function:
+///          const JournalRecord* next();
+///        returning NULL until the next command is available.  Orders are
+///        created by a factory, as for JournalReplay.
+///
+///        The replica is a poller, to be run by a RunLoop on the standby's
+///        thread.  Once the first command diverges it stops applying, and
+///        must not be promoted.  To fail over, stop the loop, then take
+///        over the books from their last transaction.
+template <class OrderPtr, class Manager, class OrderFactory, class Source>
+class StandbyReplica {
+public:
+  /// @brief construct
+  /// @param books the books to apply commands to, one per symbol id
+  /// @param factory the factory creating the orders added
+  /// @param source the source of the primary's commands
+  /// @param batch_size the most commands applied per poll
+  StandbyReplica(Manager& books,
+                 OrderFactory& factory,
+                 Source& source,
+                 size_t batch_size = 256);
+
+  /// @brief apply a batch of the commands published - standby thread only
+  /// @return the number of commands applied
+  size_t poll();
+
+  /// @brief get the number of commands taken from the source, including
+  ///        any a restored book had already applied - from any thread
+  size_t applied() const;
+
+  /// @brief has a command diverged from the primary? - from any thread
+  bool diverged() const;
+
+  /// @brief get the description of the command diverging, once diverged
+  const std::string& divergence() const;
+
+  /// @brief access the replay, as to note orders restored from a checkpoint
+  JournalReplay<OrderPtr, Manager, OrderFactory>& replay();
+
+private:
+  // Not copyable
+  StandbyReplica(const StandbyReplica&);
+  StandbyReplica& operator=(const StandbyReplica&);
+
+  // Callbacks are discarded, as the primary reported them
+  JournalReplay<OrderPtr, Manager, OrderFactory> replay_;
+  Source& source_;
+  size_t batch_size_;
+  std::atomic<size_t> applied_;
+  std::atomic<bool> diverged_;
+  std::string divergence_;
+};
+
+inline
+ReplicationPublisher::ReplicationPublisher(
+  const std::string& path,
+  uint32_t capacity)
+: memory_(path, footprint(capacity)),
+  header_(new (memory_.address()) ReplicationHeader),
+  records_(memory_.address() + sizeof(ReplicationHeader), capacity, true)
+{
+  header_->capacity = capacity;
+  // The standby may attach once initialized
+  header_->magic.store(ReplicationHeader::MAGIC, std::memory_order_release);
+}
+
+inline
+ReplicationPublisher::~ReplicationPublisher()
+{
+  memory_.remove();
+}
+
+inline void
+ReplicationPublisher::publish(const JournalRecord& record)
+{
+  while (!records_.push(record)) {
+    std::this_thread::yield();
+  }
+}
+
+inline bool
+ReplicationPublisher::try_publish(const JournalRecord& record)
+{
+  return records_.push(record);
+}
+
+inline size_t
+ReplicationPublisher::footprint(uint32_t capacity)
+{
+  return sizeof(ReplicationHeader) + RecordRing::footprint(capacity);
+}
+
+inline
+ReplicationSubscriber::ReplicationSubscriber(const std::string& path)
+: memory_(path),
+  header_(validate(memory_)),
+  records_(memory_.address() + sizeof(ReplicationHeader),
+           header_->capacity,
+           false)
+{
+}
+
+inline const JournalRecord*
+ReplicationSubscriber::next()
+{
+  return records_.pop(record_) ? &record_ : NULL;
+}
+
+inline ReplicationHeader*
+ReplicationSubscriber::validate(SharedMemory& memory)
+{
+  if (memory.size() < sizeof(ReplicationHeader)) {
+    throw std::runtime_error("ReplicationSubscriber memory too small");
+  }
+  ReplicationHeader* header =
+      reinterpret_cast<ReplicationHeader*>(memory.address());
+  if (header->magic.load(std::memory_order_acquire) !=
+      ReplicationHeader::MAGIC) {
+    throw std::runtime_error("ReplicationSubscriber memory not initialized");
+  }
+  if (memory.size() < ReplicationPublisher::footprint(header->capacity)) {
+    throw std::runtime_error("ReplicationSubscriber memory too small");
+  }
+  return header;
+}
+
+template <class OrderPtr, class Manager, class OrderFactory, class Source>
+StandbyReplica<OrderPtr, Manager, OrderFactory, Source>::StandbyReplica(
+  Manager& books,
+  OrderFactory& factory,
+  Source& source,
+  size_t batch_size)
+: replay_(books, factory, false),
+  source_(source),
+  batch_size_(batch_size),
+  applied_(0),
+  diverged_(false)
+{
+}
+
+template <class OrderPtr, class Manager, class OrderFactory, class Source>
+size_t
+StandbyReplica<OrderPtr, Manager, OrderFactory, Source>::poll()
+{
+  if (diverged_.load(std::memory_order_relaxed)) {
+    return 0;
+  }
+  size_t applied = 0;
+  const JournalRecord* record;
+  while (applied < batch_size_ && (record = source_.next()) != NULL) {
+    try {
+      replay_.apply(*record);
+    } catch (const std::exception& ex) {
+      divergence_ = ex.what();
+      diverged_.store(true, std::memory_order_release);
+      break;
+    }
+    ++applied;
+  }
+  if (applied) {
+    applied_.store(applied_.load(std::memory_order_relaxed) + applied,
+                   std::memory_order_release);
+  }
+  return applied;
+}
+
+template <class OrderPtr, class Manager, class OrderFactory, class Source>
+inline size_t
+StandbyReplica<OrderPtr, Manager, OrderFactory, Source>::applied() const
+{
+  return applied_.load(std::memory_order_acquire);
+}
+
+template <class OrderPtr, class Manager, class OrderFactory, class Source>
+inline bool
+StandbyReplica<OrderPtr, Manager, OrderFactory, Source>::diverged() const
+{
+  return diverged_.load(std::memory_order_acquire);
+}
+
+template <class OrderPtr, class Manager, class OrderFactory, class Source>
+inline const std::string&
+StandbyReplica<OrderPtr, Manager, OrderFactory, Source>::divergence() const
+{
+  return divergence_;
+}
+
+template <class OrderPtr, class Manager, class OrderFactory, class Source>
+inline JournalReplay<OrderPtr, Manager, OrderFactory>&
+StandbyReplica<OrderPtr, Manager, OrderFactory, Source>::replay()
+{
+  return replay_;
+}
+
+} }
+
+#endif
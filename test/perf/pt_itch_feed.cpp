@@ -0,0 +1,168 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#include "impl/itch_feed.h"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Builds books from an ITCH 5.0 capture, or one generated, and reports its
+// throughput:
+//   pt_itch_feed [capture]
+
+using namespace liquibook;
+
+typedef impl::ItchFeedHandler<impl::SimpleOrderBook<5> > FeedHandler;
+using impl::ItchMessage;
+
+// Append a message, with its length, leaving its fields to be set
+char* begin(std::string& data, char type, uint16_t locate, size_t length)
+{
+  data.push_back(char(length >> 8));
+  data.push_back(char(length));
+  data.append(length, '\0');
+  char* message = &data[data.size() - length];
+  message[ItchMessage::TYPE] = type;
+  message[ItchMessage::STOCK_LOCATE] = char(locate >> 8);
+  message[ItchMessage::STOCK_LOCATE + 1] = char(locate);
+  return message;
+}
+
+void put32(char* field, uint32_t value)
+{
+  for (int index = 0; index < 4; ++index) {
+    field[index] = char(value >> (24 - index * 8));
+  }
+}
+
+void put64(char* field, uint64_t value)
+{
+  put32(field, uint32_t(value >> 32));
+  put32(field + 4, uint32_t(value));
+}
+
+// Capture random adds, then executions, cancels, deletes and replaces of
+// open orders, so the books stay at a steady size
+void generate_capture(const std::string& path,
+                      uint32_t num_messages,
+                      uint16_t stock_count,
+                      size_t max_open)
+{
+  std::string data;
+  data.reserve(size_t(num_messages) * 40);
+  std::vector<uint64_t> open_refs;
+  std::vector<uint16_t> open_locates;
+  uint64_t next_ref = 1;
+  for (uint16_t locate = 1; locate <= stock_count; ++locate) {
+    char* message = begin(data, ItchMessage::im_stock_directory, locate,
+                          ItchMessage::STOCK_DIRECTORY_SIZE);
+    std::ostringstream stock;
+    stock << "S" << locate << "        ";
+    memcpy(message + ItchMessage::STOCK, stock.str().data(),
+           ItchMessage::STOCK_SIZE);
+  }
+  for (uint32_t i = 0; i < num_messages; ++i) {
+    if (i % 2 == 0 || open_refs.empty()) {
+      uint16_t locate = uint16_t(rand() % stock_count + 1);
+      bool is_buy = (rand() % 2) == 0;
+      char* message = begin(data, ItchMessage::im_add, locate,
+                            ItchMessage::ADD_SIZE);
+      put64(message + ItchMessage::ORDER_REF, next_ref);
+      message[ItchMessage::ADD_SIDE] = is_buy ? 'B' : 'S';
+      put32(message + ItchMessage::ADD_SHARES, (rand() % 10 + 1) * 100);
+      memset(message + ItchMessage::ADD_STOCK, ' ', ItchMessage::STOCK_SIZE);
+      put32(message + ItchMessage::ADD_PRICE,
+            (rand() % 20 + (is_buy ? 1880 : 1890)) * 100);
+      open_refs.push_back(next_ref++);
+      open_locates.push_back(locate);
+      continue;
+    }
+    size_t index = rand() % open_refs.size();
+    uint64_t ref = open_refs[index];
+    uint16_t locate = open_locates[index];
+    char* message;
+    // Once the books are full, delete as often as adding
+    switch (open_refs.size() < max_open ? rand() % 4 : 3) {
+      // Orders are of at least 100 shares, and reduced by less
+      case 0:
+        message = begin(data, ItchMessage::im_executed, locate,
+                        ItchMessage::EXECUTED_SIZE);
+        put32(message + ItchMessage::EXECUTED_SHARES, 1);
+        break;
+      case 1:
+        message = begin(data, ItchMessage::im_cancel, locate,
+                        ItchMessage::CANCEL_SIZE);
+        put32(message + ItchMessage::CANCELLED_SHARES, 1);
+        break;
+      case 2:
+        message = begin(data, ItchMessage::im_replace, locate,
+                        ItchMessage::REPLACE_SIZE);
+        put64(message + ItchMessage::REPLACE_NEW_ORDER_REF, next_ref);
+        put32(message + ItchMessage::REPLACE_SHARES, 500);
+        put32(message + ItchMessage::REPLACE_PRICE,
+              (rand() % 20 + 1880) * 100);
+        open_refs[index] = next_ref++;
+        break;
+      default:
+        message = begin(data, ItchMessage::im_delete, locate,
+                        ItchMessage::DELETE_SIZE);
+        open_refs[index] = open_refs.back();
+        open_refs.pop_back();
+        open_locates[index] = open_locates.back();
+        open_locates.pop_back();
+        break;
+    }
+    put64(message + ItchMessage::ORDER_REF, ref);
+  }
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file || fwrite(data.data(), 1, data.size(), file) != data.size()) {
+    throw std::runtime_error("capture write failed: " + path);
+  }
+  fclose(file);
+}
+
+int main(int argc, const char* argv[])
+{
+  std::string path;
+  if (argc > 1) {
+    path = argv[1];
+  } else {
+    std::ostringstream generated;
+    generated << "/tmp/pt_itch_feed_" << getpid();
+    path = generated.str();
+    uint32_t num_messages = 10000000;
+    std::cout << "capturing " << num_messages << " messages" << std::endl;
+    srand(num_messages);
+    generate_capture(path, num_messages, 16, 100000);
+  }
+
+  try {
+    std::cout << "processing capture";
+    FeedHandler feed;
+    clock_t start = clock();
+    size_t count = feed.process_file(path);
+    double secs = double(clock() - start) / CLOCKS_PER_SEC;
+    std::cout << " - complete!" << std::endl;
+    std::cout << "Processed " << count << " messages in " << secs
+              << " seconds";
+    if (secs > 0) {
+      std::cout << ", or " << uint32_t(count / secs) << " messages per sec";
+    }
+    std::cout << std::endl;
+    std::cout << feed.books().size() << " books, " << feed.order_count()
+              << " orders open, " << feed.unknown_orders()
+              << " messages for orders not known" << std::endl;
+  } catch (const std::exception& ex) {
+    std::cout << std::endl << "processing failed: " << ex.what() << std::endl;
+  }
+
+  if (argc <= 1) {
+    ::unlink(path.c_str());
+  }
+}
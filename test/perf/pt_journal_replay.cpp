@@ -0,0 +1,147 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#include "impl/journal_replay.h"
+#include "impl/simple_order_book.h"
+#include "impl/simple_order_store.h"
+#include "book/book_manager.h"
+#include "book/types.h"
+#include "../unit/ut_utils.h"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// Replays a command journal, or one generated, and reports its throughput:
+//   pt_journal_replay [journal]
+
+using namespace liquibook;
+using namespace liquibook::book;
+
+typedef impl::SimpleOrderBook<5> DepthOrderBook;
+typedef BookManager<impl::SimpleOrder*, DepthOrderBook> DepthBooks;
+
+typedef impl::JournalReplay<impl::SimpleOrder*, DepthBooks, StoreFactory>
+    DepthReplay;
+
+void add_books(DepthBooks& books, SymbolId symbol_count)
+{
+  for (SymbolId symbol_id = 0; symbol_id < symbol_count; ++symbol_id) {
+    std::ostringstream symbol;
+    symbol << "S" << symbol_id;
+    books.add_book(symbol.str());
+  }
+}
+
+// Journal random adds, and cancels of earlier adds, as a matching process
+void generate_journal(const std::string& path,
+                      uint32_t num_commands,
+                      SymbolId symbol_count)
+{
+  impl::CommandJournal journal(path, num_commands, 0);
+  DepthBooks books;
+  add_books(books, symbol_count);
+  impl::SimpleOrderStore store;
+  // Orders by order id, and the order ids of each symbol
+  std::vector<impl::SimpleOrder*> orders;
+  std::vector<std::vector<uint32_t> > symbol_orders(symbol_count);
+  orders.reserve(num_commands);
+
+  for (uint32_t i = 0; i < num_commands; ++i) {
+    SymbolId symbol_id = rand() % symbol_count;
+    DepthOrderBook& book = books.book(symbol_id);
+    std::vector<uint32_t>& order_ids = symbol_orders[symbol_id];
+    // Cancel an earlier order of this symbol, every other command, so the
+    // book stays at a steady size
+    if (i % 2 == 1 && !order_ids.empty()) {
+      size_t index = rand() % order_ids.size();
+      uint32_t order_id = order_ids[index];
+      order_ids[index] = order_ids.back();
+      order_ids.pop_back();
+      journal.append(impl::JournalRecord::cancel(book.trans_id() + 1,
+                                                 symbol_id, order_id));
+      books.cancel(symbol_id, orders[order_id]);
+    } else {
+      bool is_buy((i / 2 % 2) == 0);
+      uint32_t delta = is_buy ? 1880 : 1884;
+      Price price = (rand() % 10) + delta;
+      Quantity qty = ((rand() % 10) + 1) * 100;
+      uint32_t order_id = orders.size();
+      journal.append(impl::JournalRecord::add(book.trans_id() + 1, symbol_id,
+                                              order_id, is_buy, price, qty));
+      orders.push_back(store.create(is_buy, price, qty));
+      symbol_orders[symbol_id].push_back(order_id);
+      books.add(symbol_id, orders.back());
+    }
+    books.perform_callbacks();
+  }
+  journal.commit();
+}
+
+// Count the books of a journal, from the symbol ids journaled
+SymbolId count_symbols(const std::string& path)
+{
+  impl::JournalReader reader(path);
+  SymbolId symbol_count = 0;
+  const impl::JournalRecord* record;
+  while ((record = reader.next()) != NULL) {
+    if (record->symbol_id >= symbol_count) {
+      symbol_count = record->symbol_id + 1;
+    }
+  }
+  return symbol_count;
+}
+
+void replay_journal(const std::string& path,
+                    SymbolId symbol_count,
+                    bool perform_callbacks)
+{
+  std::cout << "replaying " << (perform_callbacks ? "with" : "without")
+            << " callbacks";
+  DepthBooks books;
+  add_books(books, symbol_count);
+  StoreFactory factory;
+  DepthReplay replay(books, factory, perform_callbacks);
+  impl::JournalReader reader(path);
+
+  clock_t start = clock();
+  size_t count = replay.replay(reader);
+  double secs = double(clock() - start) / CLOCKS_PER_SEC;
+  std::cout << " - complete!" << std::endl;
+  std::cout << "Replayed " << count << " commands in " << secs << " seconds";
+  if (secs > 0) {
+    std::cout << ", or " << uint32_t(count / secs) << " commands per sec";
+  }
+  std::cout << std::endl;
+}
+
+int main(int argc, const char* argv[])
+{
+  std::string path;
+  if (argc > 1) {
+    path = argv[1];
+  } else {
+    std::ostringstream generated;
+    generated << "/tmp/pt_journal_replay_" << getpid();
+    path = generated.str();
+    uint32_t num_commands = 1000000;
+    std::cout << "journaling " << num_commands << " commands" << std::endl;
+    srand(num_commands);
+    generate_journal(path, num_commands, 4);
+  }
+
+  try {
+    SymbolId symbol_count = count_symbols(path);
+    replay_journal(path, symbol_count, true);
+    replay_journal(path, symbol_count, false);
+  } catch (const std::exception& ex) {
+    std::cout << std::endl << "replay failed: " << ex.what() << std::endl;
+  }
+
+  if (argc <= 1) {
+    ::unlink(path.c_str());
+  }
+}
@@ -2,6 +2,7 @@
 // All rights reserved.
 // See the file license.txt for licensing information.
 #include "impl/simple_order_book.h"
+#include "impl/simple_order_store.h"
 #include "book/types.h"
 
 #include <iostream>
@@ -49,6 +50,27 @@ void check_top_of_book(TypedOrderBook& order_book)
   }
 }
 
+template <class TypedOrderBook>
+void check_depth(TypedOrderBook& order_book)
+{
+  // Rebuild depth from the book and compare to the incremental depth
+  typename TypedOrderBook::SimpleDepth rebuilt;
+  order_book.populate_depth(rebuilt);
+  const book::DepthLevel* level = order_book.depth().bids();
+  const book::DepthLevel* rebuilt_level = rebuilt.bids();
+  for ( ; level != order_book.depth().end(); ++level, ++rebuilt_level) {
+    if (level->price() != rebuilt_level->price()) {
+      throw std::runtime_error("depth price mismatch");
+    }
+    if (level->order_count() != rebuilt_level->order_count()) {
+      throw std::runtime_error("depth order_count mismatch");
+    }
+    if (level->aggregate_qty() != rebuilt_level->aggregate_qty()) {
+      throw std::runtime_error("depth aggregate_qty mismatch");
+    }
+  }
+}
+
 template <class TypedOrderBook, class TypedOrder>
 int run_test(TypedOrderBook& order_book, TypedOrder** orders, clock_t end) {
   int count = 0;
@@ -57,6 +79,7 @@ int run_test(TypedOrderBook& order_book, TypedOrder** orders, clock_t end) {
     order_book.add(*pp_order);
     order_book.perform_callbacks();
 // check_top_of_book(order_book);
+// check_depth(order_book);
 //std::cout << "Order Book" << std::endl;
 //order_book.log();
     ++pp_order;
@@ -72,6 +95,7 @@ template <class TypedOrderBook>
 bool build_and_run_test(uint32_t dur_sec, uint32_t num_to_try) {
   std::cout << "trying run of " << num_to_try << " orders";
   TypedOrderBook order_book;
+  impl::SimpleOrderStore store;
   impl::SimpleOrder** orders = new impl::SimpleOrder*[num_to_try + 1];
   
   for (uint32_t i = 0; i <= num_to_try; ++i) {
@@ -102,7 +126,7 @@ bool build_and_run_test(uint32_t dur_sec, uint32_t num_to_try) {
     Price price = (rand() % 10) + delta;
     
     Quantity qty = ((rand() % 10) + 1) * 100;
-    orders[i] = new impl::SimpleOrder(is_buy, price, qty);
+    orders[i] = store.create(is_buy, price, qty);
   }
   orders[num_to_try] = NULL; // Final null
   
@@ -110,9 +134,6 @@ bool build_and_run_test(uint32_t dur_sec, uint32_t num_to_try) {
   clock_t stop = start + (dur_sec * CLOCKS_PER_SEC);
 
   int count = run_test(order_book, orders, stop);
-  for (uint32_t i = 0; i <= num_to_try; ++i) {
-    delete orders[i];
-  }
   delete [] orders;
   if (count > 0) {
     std::cout << " - complete!" << std::endl;
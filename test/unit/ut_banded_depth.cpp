@@ -0,0 +1,116 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_BandedDepth
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+#include "book/banded_depth.h"
+
+namespace liquibook {
+
+using book::BandedDepth;
+using impl::SimpleOrder;
+
+/// @brief order book maintaining a banded depth from its level changes
+class BandedOrderBook : public SimpleOrderBook {
+public:
+  BandedOrderBook(Price band_width)
+  : banded_(band_width)
+  {
+  }
+
+  BandedDepth& banded() { return banded_; }
+
+protected:
+  virtual void on_level_change(const DepthLevel& level, 
+                               int32_t count_delta,
+                               int32_t qty_delta,
+                               bool is_bid)
+  {
+    SimpleOrderBook::on_level_change(level, count_delta, qty_delta, is_bid);
+    banded_.change_level(level.price(), count_delta, qty_delta, is_bid);
+  }
+
+private:
+  BandedDepth banded_;
+};
+
+BOOST_AUTO_TEST_CASE(TestBandPrice)
+{
+  BandedDepth banded(5);
+  BOOST_REQUIRE_EQUAL(1245, banded.band_price(1245));
+  BOOST_REQUIRE_EQUAL(1245, banded.band_price(1249));
+  BOOST_REQUIRE_EQUAL(1250, banded.band_price(1250));
+  BOOST_REQUIRE_EQUAL(12, BandedDepth::basis_point_band_width(12500, 10));
+  BOOST_REQUIRE_EQUAL(1, BandedDepth::basis_point_band_width(50, 10));
+  BOOST_REQUIRE_THROW(BandedDepth(0), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(TestBandsAggregate)
+{
+  BandedDepth banded(5);
+  banded.change_level(1249, 1, 100, true);
+  banded.change_level(1246, 1, 200, true);
+  banded.change_level(1244, 1, 300, true);
+  banded.change_level(1251, 2, 400, false);
+  BOOST_REQUIRE_EQUAL(2, banded.bids().size());
+  BOOST_REQUIRE_EQUAL(1, banded.asks().size());
+  book::BidLevelMap::const_iterator band;
+  band = banded.bids().begin();
+  BOOST_REQUIRE(verify_depth(band->second, 1245, 2, 300));
+  BOOST_REQUIRE(verify_depth((++band)->second, 1240, 1, 300));
+  BOOST_REQUIRE(verify_depth(banded.asks().begin()->second, 1250, 2, 400));
+  BOOST_REQUIRE(banded.changed());
+  banded.published();
+  BOOST_REQUIRE(!banded.changed());
+
+  // Emptied band is kept until published
+  banded.change_level(1244, -1, -300, true);
+  BOOST_REQUIRE(banded.changed());
+  BOOST_REQUIRE_EQUAL(2, banded.bids().size());
+  band = banded.bids().begin();
+  BOOST_REQUIRE(!band->second.changed_since(banded.last_published_change()));
+  BOOST_REQUIRE((++band)->second.changed_since(
+      banded.last_published_change()));
+  BOOST_REQUIRE(verify_depth(band->second, 1240, 0, 0));
+  banded.published();
+  BOOST_REQUIRE_EQUAL(1, banded.bids().size());
+}
+
+BOOST_AUTO_TEST_CASE(TestBandsFromOrderBook)
+{
+  BandedOrderBook order_book(5);
+  SimpleOrder ask1(false, 1252, 100);
+  SimpleOrder ask0(false, 1251, 200);
+  SimpleOrder bid2(true,  1252, 500);
+  SimpleOrder bid1(true,  1246, 100);
+  SimpleOrder bid0(true,  1249, 200);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &bid0, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid1, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask0, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask1, false));
+  BOOST_REQUIRE(verify_depth(order_book.banded().bids().begin()->second, 
+                             1245, 2, 300));
+  BOOST_REQUIRE(verify_depth(order_book.banded().asks().begin()->second, 
+                             1250, 2, 300));
+
+  // Match both asks, the remainder rests in the next band
+  BOOST_REQUIRE(add_and_verify(order_book, &bid2, true));
+  order_book.banded().published();
+  BOOST_REQUIRE(order_book.banded().asks().empty());
+  BOOST_REQUIRE_EQUAL(2, order_book.banded().bids().size());
+  BOOST_REQUIRE(verify_depth(order_book.banded().bids().begin()->second, 
+                             1250, 1, 200));
+
+  // Replace into another band
+  BOOST_REQUIRE(replace_and_verify(order_book, &bid1, 50, 1250));
+  BOOST_REQUIRE_EQUAL(2, order_book.banded().bids().size());
+  BOOST_REQUIRE(verify_depth(order_book.banded().bids().begin()->second, 
+                             1250, 2, 350));
+  BOOST_REQUIRE(verify_depth((++order_book.banded().bids().begin())->second,
+                             1245, 1, 200));
+}
+
+} // namespace
@@ -0,0 +1,338 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_BookCheckpoint
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+#include "impl/book_checkpoint.h"
+#include "impl/journal_replay.h"
+#include "book/book_manager.h"
+#include <unistd.h>
+
+namespace liquibook {
+
+using book::SymbolId;
+using impl::CheckpointOrder;
+using impl::CommandJournal;
+using impl::JournalReader;
+using impl::JournalRecord;
+using impl::SimpleOrder;
+
+typedef book::BookManager<SimpleOrder*, SimpleOrderBook> SimpleBookManager;
+typedef impl::BookCheckpoint<SimpleOrder*, SimpleBookManager> SimpleCheckpoint;
+typedef SimpleOrderBook::Tracker Tracker;
+
+// Recreates orders of a checkpoint, and of a journal, keeping their ids
+struct SimpleOrderFactory {
+  ~SimpleOrderFactory()
+  {
+    for (size_t index = 0; index < orders.size(); ++index) {
+      delete orders[index];
+    }
+  }
+  SimpleOrder* operator()(const CheckpointOrder& order)
+  {
+    SimpleOrder* result = create(order.is_buy != 0, order.price,
+                                 order.order_qty, order.order_id,
+                                 order.display_qty);
+    result->set_stop_price(order.stop_price);
+    Quantity filled_qty = order.order_qty - order.open_qty;
+    if (filled_qty) {
+      result->fill(filled_qty, filled_qty * order.price, 0);
+    }
+    return result;
+  }
+  SimpleOrder* operator()(const JournalRecord& add)
+  {
+    SimpleOrder* order = create(add.is_buy != 0, add.price, add.qty,
+                                add.order_id);
+    order->set_stop_price(add.stop_price);
+    order->set_display_qty(add.display_qty);
+    return order;
+  }
+  SimpleOrder* create(bool is_buy, Price price, Quantity qty, uint32_t id,
+                      Quantity display_qty = 0)
+  {
+    orders.push_back(new SimpleOrder(is_buy, price, qty, id));
+    orders.back()->set_display_qty(display_qty);
+    orders.back()->accept();
+    return orders.back();
+  }
+  std::vector<SimpleOrder*> orders;
+};
+
+template <class Orders>
+void verify_orders(const Orders& expected, const Orders& restored)
+{
+  BOOST_REQUIRE_EQUAL(expected.size(), restored.size());
+  typename Orders::const_iterator expected_order = expected.begin();
+  typename Orders::const_iterator restored_order = restored.begin();
+  for ( ; expected_order != expected.end();
+       ++expected_order, ++restored_order) {
+    const Tracker& expected_tracker = expected_order->second;
+    const Tracker& restored_tracker = restored_order->second;
+    BOOST_REQUIRE_EQUAL(expected_order->first, restored_order->first);
+    BOOST_REQUIRE_EQUAL(expected_tracker.ptr()->order_id_,
+                        restored_tracker.ptr()->order_id_);
+    BOOST_REQUIRE_EQUAL(expected_tracker.price(), restored_tracker.price());
+    BOOST_REQUIRE_EQUAL(expected_tracker.order_qty(),
+                        restored_tracker.order_qty());
+    BOOST_REQUIRE_EQUAL(expected_tracker.open_qty(),
+                        restored_tracker.open_qty());
+    BOOST_REQUIRE_EQUAL(expected_tracker.display_qty(),
+                        restored_tracker.display_qty());
+    BOOST_REQUIRE_EQUAL(expected_tracker.hidden_qty(),
+                        restored_tracker.hidden_qty());
+    BOOST_REQUIRE_EQUAL(expected_tracker.conditions(),
+                        restored_tracker.conditions());
+    BOOST_REQUIRE_EQUAL(expected_tracker.is_buy(), restored_tracker.is_buy());
+  }
+}
+
+template <class Levels>
+void verify_levels(const Levels& expected, const Levels& restored)
+{
+  BOOST_REQUIRE_EQUAL(expected.size(), restored.size());
+  typename Levels::const_iterator expected_level = expected.begin();
+  typename Levels::const_iterator restored_level = restored.begin();
+  for ( ; expected_level != expected.end();
+       ++expected_level, ++restored_level) {
+    BOOST_REQUIRE_EQUAL(expected_level->first, restored_level->first);
+    BOOST_REQUIRE_EQUAL(expected_level->second.order_count(),
+                        restored_level->second.order_count());
+    BOOST_REQUIRE_EQUAL(expected_level->second.aggregate_qty(),
+                        restored_level->second.aggregate_qty());
+    BOOST_REQUIRE_EQUAL(expected_level->second.last_change(),
+                        restored_level->second.last_change());
+  }
+}
+
+void verify_books(SimpleBookManager& expected, SimpleBookManager& restored)
+{
+  BOOST_REQUIRE_EQUAL(expected.size(), restored.size());
+  for (SymbolId symbol_id = 0; symbol_id < expected.size(); ++symbol_id) {
+    SimpleOrderBook& expected_book = expected.book(symbol_id);
+    SimpleOrderBook& restored_book = restored.book(symbol_id);
+    BOOST_REQUIRE_EQUAL(expected.symbol(symbol_id),
+                        restored.symbol(symbol_id));
+    BOOST_REQUIRE_EQUAL(expected_book.trans_id(), restored_book.trans_id());
+    verify_orders(expected_book.bids(), restored_book.bids());
+    verify_orders(expected_book.asks(), restored_book.asks());
+    verify_levels(expected_book.bid_levels(), restored_book.bid_levels());
+    verify_levels(expected_book.ask_levels(), restored_book.ask_levels());
+    const book::DepthLevel* expected_level = expected_book.depth().bids();
+    const book::DepthLevel* restored_level = restored_book.depth().bids();
+    for ( ; expected_level != expected_book.depth().end();
+         ++expected_level, ++restored_level) {
+      BOOST_REQUIRE_EQUAL(expected_level->price(), restored_level->price());
+      BOOST_REQUIRE_EQUAL(expected_level->order_count(),
+                          restored_level->order_count());
+      BOOST_REQUIRE_EQUAL(expected_level->aggregate_qty(),
+                          restored_level->aggregate_qty());
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestCheckpointRestore)
+{
+  std::string path = temp_path("book_checkpoint_restore");
+  SimpleBookManager books;
+  SymbolId aapl = books.add_book("AAPL");
+  SymbolId msft = books.add_book("MSFT");
+  books.add_book("IBM");
+  std::vector<SimpleOrder*> orders;
+  // Several orders a level, with all or none, and a partial fill
+  for (Price price = 1240; price < 1250; ++price) {
+    orders.push_back(new SimpleOrder(true, price, 100));
+    books.add(aapl, orders.back());
+    orders.push_back(new SimpleOrder(true, price, 200));
+    books.add(aapl, orders.back(), book::oc_all_or_none);
+    orders.push_back(new SimpleOrder(false, price + 10, 300));
+    books.add(aapl, orders.back());
+    orders.push_back(new SimpleOrder(false, price + 5, 100));
+    books.add(msft, orders.back());
+  }
+  orders.push_back(new SimpleOrder(false, 1249, 150));
+  books.add(aapl, orders.back());
+  // An iceberg, partly filled, showing part of its display qty
+  orders.push_back(new SimpleOrder(true, 1230, 1000));
+  orders.back()->set_display_qty(300);
+  books.add(msft, orders.back(), book::oc_iceberg);
+  orders.push_back(new SimpleOrder(false, 1230, 400));
+  books.add(msft, orders.back());
+  books.perform_callbacks();
+  const Tracker& iceberg = books.book(msft).bids().begin()->second;
+  BOOST_REQUIRE_EQUAL(200, iceberg.visible_qty());
+  BOOST_REQUIRE_EQUAL(400, iceberg.hidden_qty());
+
+  SimpleOrderIds order_ids;
+  SimpleCheckpoint::save(path, books, order_ids);
+  SimpleBookManager restored;
+  SimpleOrderFactory factory;
+  SimpleCheckpoint::load(path, restored, factory);
+  verify_books(books, restored);
+  BOOST_REQUIRE_EQUAL(0, restored.book(2).bids().size());
+
+  // The restored books match as before
+  SimpleOrder ask(false, 1248, 100);
+  BOOST_REQUIRE(restored.add(aapl, &ask));
+  restored.perform_callbacks();
+  BOOST_REQUIRE_EQUAL(impl::os_complete, ask.state());
+  // All or none bids, too large to fill, keep their priority
+  SimpleOrderBook::Bids::const_iterator bid =
+      restored.book(aapl).bids().begin();
+  BOOST_REQUIRE_EQUAL(1249, bid->second.price());
+  BOOST_REQUIRE_EQUAL(orders[37]->order_id_, bid->second.ptr()->order_id_);
+  ++bid;
+  BOOST_REQUIRE_EQUAL(1248, bid->second.price());
+  BOOST_REQUIRE_EQUAL(orders[33]->order_id_, bid->second.ptr()->order_id_);
+
+  // A book cannot be restored twice
+  BOOST_REQUIRE_THROW(SimpleCheckpoint::load(path, restored, factory),
+                      std::runtime_error);
+
+  for (size_t index = 0; index < orders.size(); ++index) {
+    delete orders[index];
+  }
+  ::unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestCheckpointRestoreStops)
+{
+  std::string path = temp_path("book_checkpoint_stops");
+  SimpleBookManager books;
+  SymbolId aapl = books.add_book("AAPL");
+  std::vector<SimpleOrder*> orders;
+  // A trade sets the market price
+  orders.push_back(new SimpleOrder(true, 1250, 100));
+  books.add(aapl, orders.back());
+  orders.push_back(new SimpleOrder(false, 1250, 100));
+  books.add(aapl, orders.back());
+  // Stops wait on either side of it
+  orders.push_back(new SimpleOrder(true, 1253, 100));
+  orders.back()->set_stop_price(1252);
+  books.add(aapl, orders.back(), book::oc_stop);
+  orders.push_back(new SimpleOrder(false, 0, 100));
+  orders.back()->set_stop_price(1248);
+  books.add(aapl, orders.back(), book::oc_stop);
+  orders.push_back(new SimpleOrder(false, 1253, 300));
+  books.add(aapl, orders.back());
+  books.perform_callbacks();
+  BOOST_REQUIRE_EQUAL(1, books.book(aapl).buy_stops().size());
+  BOOST_REQUIRE_EQUAL(1, books.book(aapl).sell_stops().size());
+
+  SimpleOrderIds order_ids;
+  SimpleCheckpoint::save(path, books, order_ids);
+  SimpleBookManager restored;
+  SimpleOrderFactory factory;
+  SimpleCheckpoint::load(path, restored, factory);
+  verify_books(books, restored);
+  SimpleOrderBook& restored_book = restored.book(aapl);
+  BOOST_REQUIRE_EQUAL(1250, restored_book.market_price());
+  BOOST_REQUIRE_EQUAL(1, restored_book.buy_stops().size());
+  BOOST_REQUIRE_EQUAL(1, restored_book.sell_stops().size());
+  BOOST_REQUIRE_EQUAL(1252, restored_book.buy_stops().begin()->first);
+  BOOST_REQUIRE_EQUAL(1248, restored_book.sell_stops().begin()->first);
+
+  // A trade at the stop price of the restored buy stop triggers it
+  SimpleOrder bid(true, 1252, 100);
+  SimpleOrder ask(false, 1252, 100);
+  BOOST_REQUIRE(!restored.add(aapl, &bid));
+  BOOST_REQUIRE(restored.add(aapl, &ask));
+  restored.perform_callbacks();
+  BOOST_REQUIRE(restored_book.buy_stops().empty());
+  BOOST_REQUIRE_EQUAL(1, restored_book.sell_stops().size());
+  // And fills part of the ask resting behind it
+  const SimpleOrderBook::Tracker& resting =
+      restored_book.asks().begin()->second;
+  BOOST_REQUIRE_EQUAL(orders[4]->order_id_, resting.ptr()->order_id_);
+  BOOST_REQUIRE_EQUAL(200, resting.open_qty());
+
+  for (size_t index = 0; index < orders.size(); ++index) {
+    delete orders[index];
+  }
+  ::unlink(path.c_str());
+}
+
+// A missing file, or one not a checkpoint, is not restored
+BOOST_AUTO_TEST_CASE(TestCheckpointInvalid)
+{
+  std::string path = temp_path("book_checkpoint_invalid");
+  SimpleBookManager restored;
+  SimpleOrderFactory factory;
+  BOOST_REQUIRE_THROW(SimpleCheckpoint::load(path, restored, factory),
+                      std::runtime_error);
+  {
+    CommandJournal journal(path, 16);
+  }
+  BOOST_REQUIRE_THROW(SimpleCheckpoint::load(path, restored, factory),
+                      std::runtime_error);
+  ::unlink(path.c_str());
+}
+
+// Journal an add before applying it, as a matching process would
+void add(CommandJournal& journal,
+         SimpleBookManager& books,
+         SymbolId symbol_id,
+         SimpleOrder* order)
+{
+  journal.append(JournalRecord::add(books.book(symbol_id).trans_id() + 1,
+                                    symbol_id, order->order_id_,
+                                    order->is_buy(), order->price(),
+                                    order->order_qty()));
+  books.add(symbol_id, order);
+  books.perform_callbacks();
+}
+
+BOOST_AUTO_TEST_CASE(TestCheckpointThenReplay)
+{
+  std::string checkpoint = temp_path("book_checkpoint_replay");
+  std::string journal_path = temp_path("book_checkpoint_journal");
+  SimpleBookManager books;
+  SymbolId aapl = books.add_book("AAPL");
+  std::vector<SimpleOrder*> orders;
+  {
+    CommandJournal journal(journal_path, 64);
+    for (Price price = 1240; price < 1260; ++price) {
+      // Checkpoint part way through the session
+      if (price == 1250) {
+        SimpleOrderIds order_ids;
+        SimpleCheckpoint::save(checkpoint, books, order_ids);
+      }
+      bool is_buy = price % 2 == 0;
+      orders.push_back(new SimpleOrder(is_buy, is_buy ? price : price + 20,
+                                       100));
+      add(journal, books, aapl, orders.back());
+    }
+    // Cross orders restored, and cancel one
+    orders.push_back(new SimpleOrder(false, 1246, 650));
+    add(journal, books, aapl, orders.back());
+    journal.append(JournalRecord::cancel(books.book(aapl).trans_id() + 1,
+                                         aapl, orders[2]->order_id_));
+    books.cancel(aapl, orders[2]);
+    books.perform_callbacks();
+  }
+
+  SimpleBookManager restored;
+  SimpleOrderFactory factory;
+  SimpleCheckpoint::load(checkpoint, restored, factory);
+  impl::JournalReplay<SimpleOrder*, SimpleBookManager, SimpleOrderFactory>
+      replay(restored, factory);
+  for (size_t index = 0; index < factory.orders.size(); ++index) {
+    replay.restore_order(factory.orders[index]->order_id_,
+                         factory.orders[index]);
+  }
+  // Only the journal after the checkpoint is applied
+  JournalReader reader(journal_path);
+  BOOST_REQUIRE_EQUAL(12, replay.replay(reader));
+  verify_books(books, restored);
+
+  for (size_t index = 0; index < orders.size(); ++index) {
+    delete orders[index];
+  }
+  ::unlink(checkpoint.c_str());
+  ::unlink(journal_path.c_str());
+}
+
+} // namespace
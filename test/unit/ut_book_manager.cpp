@@ -0,0 +1,90 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_BookManager
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+#include "book/book_manager.h"
+#include <memory>
+
+namespace liquibook {
+
+using book::SymbolId;
+using impl::SimpleOrder;
+
+typedef book::BookManager<SimpleOrder*, SimpleOrderBook> SimpleBookManager;
+
+BOOST_AUTO_TEST_CASE(TestDenseSymbolIds)
+{
+  SimpleBookManager manager;
+  BOOST_REQUIRE_EQUAL(0, manager.add_book("AAPL"));
+  BOOST_REQUIRE_EQUAL(1, manager.add_book("MSFT"));
+  BOOST_REQUIRE_EQUAL(2, manager.add_book("IBM"));
+  BOOST_REQUIRE_EQUAL(3, manager.size());
+  BOOST_REQUIRE_THROW(manager.add_book("MSFT"), std::runtime_error);
+
+  SymbolId symbol_id = 99;
+  BOOST_REQUIRE(manager.find_symbol("IBM", symbol_id));
+  BOOST_REQUIRE_EQUAL(2, symbol_id);
+  BOOST_REQUIRE_EQUAL("MSFT", manager.symbol(1));
+  BOOST_REQUIRE(!manager.find_symbol("GOOG", symbol_id));
+}
+
+BOOST_AUTO_TEST_CASE(TestRouteOrders)
+{
+  SimpleBookManager manager;
+  SymbolId aapl = manager.add_book("AAPL");
+  SymbolId msft = manager.add_book("MSFT");
+  SimpleOrder bid0(true, 1250, 100);
+  SimpleOrder bid1(true, 1251, 100);
+  SimpleOrder ask0(false, 1250, 100);
+
+  // Orders only match within their book
+  BOOST_REQUIRE(!manager.add(aapl, &bid0));
+  BOOST_REQUIRE(!manager.add(msft, &bid1));
+  BOOST_REQUIRE(manager.add(aapl, &ask0));
+  BOOST_REQUIRE_EQUAL(0, manager.book(aapl).bids().size());
+  BOOST_REQUIRE_EQUAL(1, manager.book(msft).bids().size());
+
+  // Callbacks are performed for each changed book
+  BOOST_REQUIRE_EQUAL(impl::os_new, bid0.state());
+  BOOST_REQUIRE_EQUAL(impl::os_new, bid1.state());
+  manager.perform_callbacks();
+  BOOST_REQUIRE_EQUAL(impl::os_complete, bid0.state());
+  BOOST_REQUIRE_EQUAL(impl::os_complete, ask0.state());
+  BOOST_REQUIRE_EQUAL(impl::os_accepted, bid1.state());
+
+  // Replace and cancel
+  BOOST_REQUIRE(!manager.replace(msft, &bid1, 0, 1252));
+  manager.perform_callbacks();
+  BOOST_REQUIRE_EQUAL(1252, bid1.price());
+  manager.cancel(msft, &bid1);
+  manager.perform_callbacks();
+  BOOST_REQUIRE_EQUAL(impl::os_cancelled, bid1.state());
+  BOOST_REQUIRE_EQUAL(0, manager.book(msft).bids().size());
+
+  BOOST_REQUIRE_THROW(manager.add(2, &bid0), std::runtime_error);
+}
+
+#if __cplusplus >= 201103L
+BOOST_AUTO_TEST_CASE(TestMoveOrders)
+{
+  typedef std::shared_ptr<SimpleOrder> SharedOrder;
+  book::BookManager<SharedOrder, book::OrderBook<SharedOrder> > manager;
+  SymbolId aapl = manager.add_book("AAPL");
+  SharedOrder bid0 = std::make_shared<SimpleOrder>(true, 1250, 100);
+  SimpleOrder* order = bid0.get();
+
+  // Held by the book and its accept callback, none left with the caller
+  BOOST_REQUIRE(!manager.add(aapl, std::move(bid0)));
+  BOOST_REQUIRE(!bid0);
+  const SharedOrder& resting = manager.book(aapl).bids().begin()->second.ptr();
+  BOOST_REQUIRE_EQUAL(order, resting.get());
+  BOOST_REQUIRE_EQUAL(2, resting.use_count());
+  manager.perform_callbacks();
+  BOOST_REQUIRE_EQUAL(1, resting.use_count());
+}
+#endif
+
+} // namespace
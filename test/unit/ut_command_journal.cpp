@@ -0,0 +1,155 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_CommandJournal
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+#include "impl/command_journal.h"
+#include <thread>
+#include <unistd.h>
+
+namespace liquibook {
+
+using impl::CommandJournal;
+using impl::JournalReader;
+using impl::JournalRecord;
+using impl::SimpleOrder;
+
+BOOST_AUTO_TEST_CASE(TestJournalGroupCommit)
+{
+  std::string path = temp_path("command_journal_group");
+  {
+    CommandJournal journal(path, 16, 4);
+    BOOST_REQUIRE_EQUAL(0, journal.size());
+    BOOST_REQUIRE_EQUAL(16, journal.capacity());
+    for (uint32_t order_id = 1; order_id <= 3; ++order_id) {
+      journal.append(
+          JournalRecord::add(order_id, 0, order_id, true, 1250, 100));
+    }
+    BOOST_REQUIRE_EQUAL(3, journal.uncommitted());
+    // Fourth record completes the group
+    journal.append(JournalRecord::cancel(4, 0, 2));
+    BOOST_REQUIRE_EQUAL(0, journal.uncommitted());
+    journal.append(JournalRecord::replace(5, 0, 1, -10, 1251));
+    BOOST_REQUIRE_EQUAL(1, journal.uncommitted());
+    journal.commit();
+    BOOST_REQUIRE_EQUAL(0, journal.uncommitted());
+    BOOST_REQUIRE_EQUAL(5, journal.size());
+  }
+  // Reopen to append after the records written
+  CommandJournal journal(path, 0, 0);
+  BOOST_REQUIRE_EQUAL(5, journal.size());
+  BOOST_REQUIRE_EQUAL(16, journal.capacity());
+  const JournalRecord& add = journal.record(0);
+  BOOST_REQUIRE_EQUAL(JournalRecord::jr_add, add.type);
+  BOOST_REQUIRE_EQUAL(1, add.trans_id);
+  BOOST_REQUIRE_EQUAL(1, add.is_buy);
+  BOOST_REQUIRE_EQUAL(1250, add.price);
+  BOOST_REQUIRE_EQUAL(100, add.qty);
+  const JournalRecord& cancel = journal.record(3);
+  BOOST_REQUIRE_EQUAL(JournalRecord::jr_cancel, cancel.type);
+  BOOST_REQUIRE_EQUAL(2, cancel.order_id);
+  const JournalRecord& replace = journal.record(4);
+  BOOST_REQUIRE_EQUAL(JournalRecord::jr_replace, replace.type);
+  BOOST_REQUIRE_EQUAL(-10, replace.size_delta);
+  BOOST_REQUIRE_EQUAL(1251, replace.new_price);
+  journal.append(JournalRecord::cancel(6, 0, 1));
+  BOOST_REQUIRE_EQUAL(6, journal.size());
+  ::unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestJournalFull)
+{
+  std::string path = temp_path("command_journal_full");
+  CommandJournal journal(path, 2);
+  journal.append(JournalRecord::cancel(1, 0, 1));
+  journal.append(JournalRecord::cancel(2, 0, 2));
+  BOOST_REQUIRE_THROW(journal.append(JournalRecord::cancel(3, 0, 3)),
+                      std::runtime_error);
+  BOOST_REQUIRE_EQUAL(2, journal.size());
+  ::unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestJournalNotJournal)
+{
+  std::string path = temp_path("command_journal_invalid");
+  {
+    impl::SharedMemory memory(path, 4096);
+  }
+  BOOST_REQUIRE_THROW(CommandJournal journal(path, 16), std::runtime_error);
+  ::unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestJournalBookCommands)
+{
+  std::string path = temp_path("command_journal_book");
+  CommandJournal journal(path, 16);
+  SimpleOrderBook order_book;
+  SimpleOrder bid(true, 1250, 100);
+  SimpleOrder ask(false, 1250, 40);
+
+  // Journal each command with the transaction id it is to be assigned
+  journal.append(JournalRecord::add(order_book.trans_id() + 1, 0,
+                                    bid.order_id_, bid.is_buy(),
+                                    bid.price(), bid.order_qty()));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid, false));
+  journal.append(JournalRecord::add(order_book.trans_id() + 1, 0,
+                                    ask.order_id_, ask.is_buy(),
+                                    ask.price(), ask.order_qty()));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask, true, true));
+  journal.append(JournalRecord::cancel(order_book.trans_id() + 1, 0,
+                                       bid.order_id_));
+  order_book.cancel(&bid);
+  journal.commit();
+
+  BOOST_REQUIRE_EQUAL(3, journal.size());
+  for (size_t index = 0; index < journal.size(); ++index) {
+    BOOST_REQUIRE_EQUAL(index + 1, journal.record(index).trans_id);
+  }
+  BOOST_REQUIRE_EQUAL(order_book.trans_id(), journal.record(2).trans_id);
+  BOOST_REQUIRE_EQUAL(ask.order_id_, journal.record(1).order_id);
+  BOOST_REQUIRE_EQUAL(0, journal.record(1).is_buy);
+  ::unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestJournalFollowedByReader)
+{
+  std::string path = temp_path("command_journal_follow");
+  const uint32_t num_records = 100000;
+  CommandJournal journal(path, num_records, 0);
+  JournalReader reader(path);
+  // Append on another thread while the reader follows
+  std::thread writer([&journal, num_records]() {
+    for (uint32_t trans_id = 1; trans_id <= num_records; ++trans_id) {
+      journal.append(JournalRecord::add(trans_id, trans_id % 7, trans_id,
+                                        trans_id % 2 == 0, 1000 + trans_id,
+                                        trans_id * 10));
+    }
+  });
+  // Each record is read whole, never part written
+  uint32_t trans_id = 0;
+  while (trans_id < num_records) {
+    const JournalRecord* record = reader.next();
+    if (!record) {
+      std::this_thread::yield();
+      continue;
+    }
+    ++trans_id;
+    if (record->type != JournalRecord::jr_add ||
+        record->trans_id != trans_id ||
+        record->symbol_id != trans_id % 7 ||
+        record->order_id != trans_id ||
+        record->price != 1000 + trans_id ||
+        record->qty != trans_id * 10) {
+      break;
+    }
+  }
+  writer.join();
+  BOOST_REQUIRE_EQUAL(num_records, trans_id);
+  BOOST_REQUIRE_EQUAL(num_records, reader.position());
+  BOOST_REQUIRE(!reader.next());
+  ::unlink(path.c_str());
+}
+
+} // namespace
@@ -0,0 +1,212 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_ConflatingDepthPublisher
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+#include "book/conflating_depth_publisher.h"
+#include "book/price_level_book.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace liquibook {
+
+using book::DepthDelta;
+using book::DepthDeltaHeader;
+
+typedef book::PriceLevelBook<5> SizedLevelBook;
+typedef book::ConflatingDepthPublisher<5> SizedPublisher;
+
+// Levels of a depth as a consumer of updates sees them, bids then asks
+struct ConsumerDepth {
+  ConsumerDepth()
+  {
+    for (int index = 0; index < 10; ++index) {
+      levels[index].init(0, false);
+    }
+  }
+
+  // Apply an update, returning its delta count
+  uint16_t apply(const char* buffer)
+  {
+    DepthDeltaHeader header;
+    memcpy(&header, buffer, sizeof(header));
+    const char* in = buffer + sizeof(header);
+    for (uint16_t index = 0; index < header.delta_count; ++index) {
+      DepthDelta delta;
+      memcpy(&delta, in, sizeof(delta));
+      in += sizeof(delta);
+      levels[delta.side * 5 + delta.level_index].init(delta.price, false);
+      levels[delta.side * 5 + delta.level_index].set(delta.order_count,
+                                                     delta.aggregate_qty);
+    }
+    return header.delta_count;
+  }
+
+  bool matches(const SizedLevelBook::TypedDepth& depth) const
+  {
+    const DepthLevel* level = depth.bids();
+    for (int index = 0; index < 10; ++index, ++level) {
+      if (!verify_depth(levels[index], level->price(), level->order_count(),
+                        level->aggregate_qty())) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  DepthLevel levels[10];
+};
+
+BOOST_AUTO_TEST_CASE(TestConflateByTransactions)
+{
+  SizedLevelBook book;
+  SizedPublisher publisher(book.depth(), 0, 10);
+  char buffer[SizedPublisher::MAX_ENCODED_SIZE];
+  ConsumerDepth consumer;
+  // The best bid changes every transaction, but is sent every tenth
+  for (book::Quantity qty = 100; qty <= 2500; qty += 100) {
+    book.set_level(1250, 1, qty, true);
+    size_t size = publisher.publish(0, book.trans_id(), buffer,
+                                    sizeof(buffer));
+    if (book.trans_id() % 10) {
+      BOOST_REQUIRE_EQUAL(0, size);
+      book::TransId next_update = book.trans_id() / 10 * 10 + 10;
+      BOOST_REQUIRE(!publisher.due(0, next_update - 1));
+      BOOST_REQUIRE(publisher.due(0, next_update));
+    } else {
+      BOOST_REQUIRE_EQUAL(sizeof(DepthDeltaHeader) + sizeof(DepthDelta),
+                          size);
+      BOOST_REQUIRE_EQUAL(1, consumer.apply(buffer));
+      BOOST_REQUIRE(verify_depth(consumer.levels[0], 1250, 1, qty));
+    }
+  }
+  BOOST_REQUIRE_EQUAL(2, publisher.updates());
+  // The rest is sent once quiet
+  BOOST_REQUIRE(!consumer.matches(book.depth()));
+  BOOST_REQUIRE(publisher.flush(0, book.trans_id(), buffer, sizeof(buffer)));
+  consumer.apply(buffer);
+  BOOST_REQUIRE(consumer.matches(book.depth()));
+  BOOST_REQUIRE(!publisher.due(0, book.trans_id() + 10));
+  BOOST_REQUIRE_EQUAL(0, publisher.flush(0, book.trans_id(), buffer,
+                                         sizeof(buffer)));
+}
+
+BOOST_AUTO_TEST_CASE(TestConflateByInterval)
+{
+  SizedLevelBook book;
+  SizedPublisher publisher(book.depth(), 1000, 0);
+  char buffer[SizedPublisher::MAX_ENCODED_SIZE];
+  ConsumerDepth consumer;
+  // Nothing is due until the depth changes
+  BOOST_REQUIRE(!publisher.due(5000, book.trans_id()));
+  book.set_level(1250, 1, 100, true);
+  BOOST_REQUIRE(publisher.publish(5000, book.trans_id(), buffer,
+                                  sizeof(buffer)));
+  consumer.apply(buffer);
+
+  // A burst within the interval is sent once, after it
+  uint64_t now = 5000;
+  for (book::Price price = 1251; price < 1261; ++price, now += 50) {
+    book.set_level(price, 2, 200, false);
+    BOOST_REQUIRE_EQUAL(0, publisher.publish(now, book.trans_id(), buffer,
+                                             sizeof(buffer)));
+  }
+  BOOST_REQUIRE(!publisher.due(5999, book.trans_id()));
+  BOOST_REQUIRE(publisher.due(6000, book.trans_id()));
+  // Only the visible levels are sent
+  BOOST_REQUIRE_EQUAL(sizeof(DepthDeltaHeader) + 5 * sizeof(DepthDelta),
+                      publisher.publish(6000, book.trans_id(), buffer,
+                                        sizeof(buffer)));
+  BOOST_REQUIRE_EQUAL(5, consumer.apply(buffer));
+  BOOST_REQUIRE(consumer.matches(book.depth()));
+  BOOST_REQUIRE_EQUAL(2, publisher.updates());
+}
+
+BOOST_AUTO_TEST_CASE(TestNetChangeOnly)
+{
+  SizedLevelBook book;
+  SizedPublisher publisher(book.depth(), 1000, 100);
+  char buffer[SizedPublisher::MAX_ENCODED_SIZE];
+  ConsumerDepth consumer;
+  book.set_level(1250, 1, 100, true);
+  book.set_level(1249, 1, 100, true);
+  book.set_level(1251, 1, 100, false);
+  publisher.flush(0, book.trans_id(), buffer, sizeof(buffer));
+  consumer.apply(buffer);
+
+  // A level changed and changed back is not sent
+  book.set_level(1250, 3, 900, true);
+  book.set_level(1250, 1, 100, true);
+  // Nor is one deleted and set again
+  book.delete_level(1251, false);
+  book.set_level(1251, 1, 100, false);
+  // A level inserted, shifting the next, then deleted
+  book.set_level(1249, 2, 400, true);
+  book.set_level(1252, 1, 300, false);
+  book.set_level(1250, 1, 200, false);
+  book.delete_level(1250, false);
+  BOOST_REQUIRE(publisher.due(1000, book.trans_id()));
+  BOOST_REQUIRE_EQUAL(sizeof(DepthDeltaHeader) + 2 * sizeof(DepthDelta),
+                      publisher.publish(1000, book.trans_id(), buffer,
+                                        sizeof(buffer)));
+  BOOST_REQUIRE_EQUAL(2, consumer.apply(buffer));
+  BOOST_REQUIRE(verify_depth(consumer.levels[1], 1249, 2, 400));
+  BOOST_REQUIRE(verify_depth(consumer.levels[6], 1252, 1, 300));
+  BOOST_REQUIRE(consumer.matches(book.depth()));
+
+  // Changes cancelling out send nothing at all
+  book.set_level(1249, 1, 100, true);
+  book.set_level(1249, 2, 400, true);
+  BOOST_REQUIRE(publisher.due(2000, book.trans_id()));
+  BOOST_REQUIRE_EQUAL(0, publisher.publish(2000, book.trans_id(), buffer,
+                                           sizeof(buffer)));
+  BOOST_REQUIRE(!publisher.due(3000, book.trans_id()));
+  BOOST_REQUIRE_EQUAL(2, publisher.updates());
+}
+
+BOOST_AUTO_TEST_CASE(TestConflatedBurst)
+{
+  // However conflated, the consumer ends with the depth
+  SizedLevelBook book;
+  SizedPublisher publisher(book.depth(), 700, 64);
+  char buffer[SizedPublisher::MAX_ENCODED_SIZE];
+  ConsumerDepth consumer;
+  srand(1250);
+  uint64_t now = 0;
+  for (int index = 0; index < 100000; ++index) {
+    bool is_bid = rand() % 2 == 0;
+    book::Price price = is_bid ? 1240 + rand() % 10 : 1251 + rand() % 10;
+    if (rand() % 4) {
+      book.set_level(price, rand() % 5 + 1, (rand() % 20 + 1) * 100,
+                     is_bid);
+    } else {
+      book.delete_level(price, is_bid);
+    }
+    now += rand() % 10;
+    if (publisher.publish(now, book.trans_id(), buffer, sizeof(buffer))) {
+      consumer.apply(buffer);
+    }
+  }
+  // At most one update per 64 transactions
+  BOOST_REQUIRE(publisher.updates() <= 100000 / 64);
+  if (publisher.flush(now, book.trans_id(), buffer, sizeof(buffer))) {
+    consumer.apply(buffer);
+  }
+  BOOST_REQUIRE(consumer.matches(book.depth()));
+}
+
+BOOST_AUTO_TEST_CASE(TestInvalidPublisher)
+{
+  SizedLevelBook book;
+  BOOST_REQUIRE_THROW(SizedPublisher(book.depth(), 0, 0), std::runtime_error);
+  SizedPublisher publisher(book.depth(), 1, 0);
+  char buffer[SizedPublisher::MAX_ENCODED_SIZE];
+  book.set_level(1250, 1, 100, true);
+  BOOST_REQUIRE_THROW(publisher.flush(0, book.trans_id(), buffer,
+                                      sizeof(buffer) - 1),
+                      std::runtime_error);
+}
+
+} // namespace
@@ -5,14 +5,20 @@
 #define BOOST_TEST_MODULE liquibook_Depth
 #include <boost/test/unit_test.hpp>
 #include "book/depth.h"
+#include "book/depth_delta_encoder.h"
+#include "book/depth_subscriber.h"
 #include "changed_checker.h"
 #include <iostream>
+#include <stdlib.h>
 
 namespace liquibook {
 
 using book::Depth;
 using book::DepthLevel;
+using book::DepthDelta;
+using book::DepthDeltaHeader;
 typedef Depth<5> SizedDepth;
+typedef book::DepthDeltaEncoder<5> SizedEncoder;
 typedef test::ChangedChecker<5> ChangedChecker;
 
 bool verify_level(const DepthLevel*& level, 
@@ -738,4 +744,194 @@ BOOST_AUTO_TEST_CASE(TestReplaceAsk)
   BOOST_REQUIRE(cc.verify_ask_changed(0, 1, 0, 1, 0)); cc.reset();
 }
 
+BOOST_AUTO_TEST_CASE(TestEncodeChangedLevels)
+{
+  SizedDepth depth;
+  char buffer[SizedEncoder::MAX_ENCODED_SIZE];
+  depth.add_order(1236, 300, true);
+  depth.add_order(1235, 200, true);
+  depth.add_order(1240, 100, false);
+
+  // All three levels changed
+  size_t size = SizedEncoder::encode(depth, buffer, sizeof(buffer));
+  BOOST_REQUIRE_EQUAL(sizeof(DepthDeltaHeader) + 3 * sizeof(DepthDelta), size);
+  DepthDeltaHeader header;
+  memcpy(&header, buffer, sizeof(header));
+  // Fields of packed records are compared by value, as a reference to one
+  // may be misaligned
+  BOOST_REQUIRE_EQUAL(3, uint16_t(header.delta_count));
+  BOOST_REQUIRE_EQUAL(depth.last_change(), ChangeId(header.change_id));
+  BOOST_REQUIRE(!depth.changed());
+
+  // Nothing changed
+  BOOST_REQUIRE_EQUAL(0u, SizedEncoder::encode(depth, buffer, sizeof(buffer)));
+
+  // Insert shifts the second bid level, close empties the only ask level
+  depth.add_order(1235, 100, true);
+  depth.close_order(1240, 100, false);
+  size = SizedEncoder::encode(depth, buffer, sizeof(buffer));
+  BOOST_REQUIRE_EQUAL(sizeof(DepthDeltaHeader) + 2 * sizeof(DepthDelta), size);
+  memcpy(&header, buffer, sizeof(header));
+  BOOST_REQUIRE_EQUAL(2, uint16_t(header.delta_count));
+
+  DepthDelta delta;
+  memcpy(&delta, buffer + sizeof(header), sizeof(delta));
+  BOOST_REQUIRE_EQUAL(DepthDelta::side_bid, delta.side);
+  BOOST_REQUIRE_EQUAL(1, delta.level_index);
+  BOOST_REQUIRE_EQUAL(1235u, uint32_t(delta.price));
+  BOOST_REQUIRE_EQUAL(300u, uint32_t(delta.aggregate_qty));
+  BOOST_REQUIRE_EQUAL(2u, uint32_t(delta.order_count));
+
+  memcpy(&delta, buffer + sizeof(header) + sizeof(delta), sizeof(delta));
+  BOOST_REQUIRE_EQUAL(DepthDelta::side_ask, delta.side);
+  BOOST_REQUIRE_EQUAL(0, delta.level_index);
+  BOOST_REQUIRE_EQUAL(0u, uint32_t(delta.order_count));
+  BOOST_REQUIRE_EQUAL(0u, uint32_t(delta.aggregate_qty));
+}
+
+BOOST_AUTO_TEST_CASE(TestEncodeBufferTooSmall)
+{
+  SizedDepth depth;
+  char buffer[SizedEncoder::MAX_ENCODED_SIZE];
+  depth.add_order(1236, 300, true);
+  BOOST_REQUIRE_THROW(SizedEncoder::encode(depth, buffer, sizeof(buffer) - 1),
+                      std::runtime_error);
+  BOOST_REQUIRE(depth.changed());
+}
+
+BOOST_AUTO_TEST_CASE(TestSubscribers)
+{
+  SizedDepth depth;
+  book::DepthSubscriber<5> fast(depth);
+  book::DepthSubscriber<5> slow(depth);
+  char buffer[SizedEncoder::MAX_ENCODED_SIZE];
+  depth.add_order(1236, 300, true);
+  depth.add_order(1240, 100, false);
+  BOOST_REQUIRE(fast.changed());
+  BOOST_REQUIRE(slow.changed());
+
+  // Each subscriber iterates the levels it has not seen
+  const DepthLevel* level = fast.next_changed(depth.bids());
+  BOOST_REQUIRE(level == depth.bids());
+  level = fast.next_changed(level + 1);
+  BOOST_REQUIRE(level == depth.asks());
+  level = fast.next_changed(level + 1);
+  BOOST_REQUIRE(level == depth.end());
+  fast.seen();
+  BOOST_REQUIRE(!fast.changed());
+  BOOST_REQUIRE(slow.changed());
+
+  // The fast subscriber sees only the new change, the slow sees all
+  depth.add_order(1235, 200, true);
+  level = fast.next_changed(depth.bids());
+  BOOST_REQUIRE(level == depth.bids() + 1);
+  BOOST_REQUIRE(fast.next_changed(level + 1) == depth.end());
+  size_t size = SizedEncoder::encode(slow, buffer, sizeof(buffer));
+  BOOST_REQUIRE_EQUAL(sizeof(DepthDeltaHeader) + 3 * sizeof(DepthDelta), size);
+  BOOST_REQUIRE(!slow.changed());
+  BOOST_REQUIRE(fast.changed());
+  size = SizedEncoder::encode(fast, buffer, sizeof(buffer));
+  BOOST_REQUIRE_EQUAL(sizeof(DepthDeltaHeader) + sizeof(DepthDelta), size);
+  BOOST_REQUIRE_EQUAL(0u, SizedEncoder::encode(fast, buffer, sizeof(buffer)));
+
+  // Subscribers leave the depth's own publication alone
+  BOOST_REQUIRE(depth.changed());
+}
+
+BOOST_AUTO_TEST_CASE(TestRestore)
+{
+  typedef std::map<book::Price, DepthLevel, std::greater<book::Price> > Bids;
+  typedef std::map<book::Price, DepthLevel, std::less<book::Price> > Asks;
+  Bids bids;
+  Asks asks;
+  for (book::Price price = 1230; price < 1237; ++price) {
+    bids[price].init(price, false);
+    bids[price].set(1, price - 1200);
+  }
+  asks[1240].init(1240, false);
+  asks[1240].set(2, 500);
+
+  SizedDepth depth;
+  ChangedChecker cc(depth);
+  depth.add_order(1250, 100, false);
+  depth.add_order(1251, 100, false);
+  cc.reset();
+  depth.restore(bids.begin(), bids.end(), asks.begin(), asks.end());
+  BOOST_REQUIRE(cc.verify_bid_changed(1, 1, 1, 1, 1));
+  BOOST_REQUIRE(cc.verify_ask_changed(1, 1, 1, 1, 1));
+
+  const DepthLevel* bid = depth.bids();
+  BOOST_REQUIRE(verify_level(bid, 1236, 1, 36));
+  BOOST_REQUIRE(verify_level(bid, 1235, 1, 35));
+  BOOST_REQUIRE(verify_level(bid, 1234, 1, 34));
+  BOOST_REQUIRE(verify_level(bid, 1233, 1, 33));
+  BOOST_REQUIRE(verify_level(bid, 1232, 1, 32));
+  const DepthLevel* ask = depth.asks();
+  BOOST_REQUIRE(verify_level(ask, 1240, 2, 500));
+  BOOST_REQUIRE(verify_level(ask, 0, 0, 0));
+
+  // Excess levels were restored too
+  cc.reset();
+  depth.close_order(1236, 36, true);
+  BOOST_REQUIRE(cc.verify_bid_changed(1, 1, 1, 1, 1));
+  bid = depth.bids() + 4;
+  BOOST_REQUIRE(verify_level(bid, 1231, 1, 31));
+}
+
+BOOST_AUTO_TEST_CASE(TestSearchDeepLevels)
+{
+  // Enough levels that the search spans several vectors
+  typedef Depth<21> DeepDepth;
+  typedef std::map<book::Price, book::Quantity, std::greater<book::Price> > Bids;
+  typedef std::map<book::Price, book::Quantity, std::less<book::Price> > Asks;
+  DeepDepth depth;
+  Bids bids;
+  Asks asks;
+  srand(1234);
+  for (int i = 0; i < 20000; ++i) {
+    bool is_bid = (rand() % 2) == 0;
+    book::Price price = is_bid ? 1000 + rand() % 40 : 1020 + rand() % 40;
+    book::Quantity qty = 1 + rand() % 100;
+    // Empty a level a tenth of the time
+    if ((rand() % 10) == 0) {
+      depth.set_level(price, 0, 0, is_bid);
+      if (is_bid) {
+        bids.erase(price);
+      } else {
+        asks.erase(price);
+      }
+    } else {
+      depth.add_order(price, qty, is_bid);
+      if (is_bid) {
+        bids[price] += qty;
+      } else {
+        asks[price] += qty;
+      }
+    }
+    // Visible levels are the best of each side
+    const DepthLevel* bid = depth.bids();
+    Bids::const_iterator b = bids.begin();
+    for (int level = 0; level < 21; ++level, ++bid) {
+      if (b == bids.end()) {
+        BOOST_REQUIRE_EQUAL(0, bid->price());
+      } else {
+        BOOST_REQUIRE_EQUAL(b->first, bid->price());
+        BOOST_REQUIRE_EQUAL(b->second, bid->aggregate_qty());
+        ++b;
+      }
+    }
+    const DepthLevel* ask = depth.asks();
+    Asks::const_iterator a = asks.begin();
+    for (int level = 0; level < 21; ++level, ++ask) {
+      if (a == asks.end()) {
+        BOOST_REQUIRE_EQUAL(0, ask->price());
+      } else {
+        BOOST_REQUIRE_EQUAL(a->first, ask->price());
+        BOOST_REQUIRE_EQUAL(a->second, ask->aggregate_qty());
+        ++a;
+      }
+    }
+  }
+}
+
 } // namespace
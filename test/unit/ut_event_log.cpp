@@ -0,0 +1,213 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_EventLog
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+#include "impl/event_log.h"
+#include "book/book_manager.h"
+#include <unistd.h>
+
+namespace liquibook {
+
+using impl::EventCodec;
+using impl::EventLogReader;
+using impl::EventLogWriter;
+using impl::LoggedEvent;
+using impl::SimpleOrder;
+
+typedef impl::EventLogBook<SimpleOrder*, SimpleOrderBook, SimpleOrderIds>
+    LoggingBook;
+typedef book::BookManager<SimpleOrder*, LoggingBook> LoggingBookManager;
+
+LoggedEvent make_event(uint8_t type,
+                       book::TransId trans_id,
+                       uint32_t order_id,
+                       uint32_t matched_order_id = 0,
+                       Quantity qty = 0,
+                       Price price = 0,
+                       const char* reason = NULL)
+{
+  LoggedEvent event = LoggedEvent();
+  event.type = type;
+  event.symbol_id = 3;
+  event.trans_id = trans_id;
+  event.order_id = order_id;
+  event.matched_order_id = matched_order_id;
+  event.qty = qty;
+  event.price = price;
+  event.reason = reason;
+  return event;
+}
+
+void verify_event(const LoggedEvent& expected, const LoggedEvent& event)
+{
+  BOOST_REQUIRE_EQUAL(expected.type, event.type);
+  BOOST_REQUIRE_EQUAL(expected.symbol_id, event.symbol_id);
+  BOOST_REQUIRE_EQUAL(expected.trans_id, event.trans_id);
+  BOOST_REQUIRE_EQUAL(expected.order_id, event.order_id);
+  BOOST_REQUIRE_EQUAL(expected.matched_order_id, event.matched_order_id);
+  BOOST_REQUIRE_EQUAL(expected.qty, event.qty);
+  BOOST_REQUIRE_EQUAL(expected.price, event.price);
+  if (expected.reason) {
+    BOOST_REQUIRE_EQUAL(std::string(expected.reason), event.reason);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestEventCodecRoundTrip)
+{
+  LoggedEvent events[] = {
+    make_event(LoggedEvent::le_accept, 1, 1000),
+    make_event(LoggedEvent::le_fill, 2, 1001, 1000, 100, 1250),
+    make_event(LoggedEvent::le_fill, 2, 1001, 999, 100, 1249),
+    make_event(LoggedEvent::le_cancel, 3, 17),
+    make_event(LoggedEvent::le_replace, 4, 0xFFFFFFFF, 0, 300, 0xFFFFFFFE),
+    make_event(LoggedEvent::le_replace_reject, 5, 2, 0, 0, 0, "not found"),
+    make_event(LoggedEvent::le_reject, 6, 3, 0, 0, 0, "")
+  };
+  const size_t count = sizeof(events) / sizeof(events[0]);
+  std::vector<char> buffer(count * EventCodec::MAX_ENCODED_SIZE);
+  EventCodec encoder;
+  size_t size = 0;
+  std::vector<size_t> sizes;
+  for (size_t index = 0; index < count; ++index) {
+    sizes.push_back(encoder.encode(events[index], &buffer[size]));
+    size += sizes.back();
+  }
+  // Nearby ids and prices encode to a byte each
+  BOOST_REQUIRE_EQUAL(1 + 1 + 1 + 2, sizes[0]);
+  BOOST_REQUIRE_EQUAL(1 + 1 + 1 + 1 + 1 + 1 + 2, sizes[1]);
+  BOOST_REQUIRE_EQUAL(1 + 1 + 1 + 1 + 1 + 1 + 1, sizes[2]);
+
+  EventCodec decoder;
+  std::string reason;
+  size_t position = 0;
+  for (size_t index = 0; index < count; ++index) {
+    LoggedEvent event;
+    // An event cut short is not decoded
+    EventCodec partial(decoder);
+    BOOST_REQUIRE_EQUAL(0, partial.decode(&buffer[position],
+                                          sizes[index] - 1,
+                                          event, reason));
+    BOOST_REQUIRE_EQUAL(sizes[index], decoder.decode(&buffer[position],
+                                                     size - position,
+                                                     event, reason));
+    verify_event(events[index], event);
+    position += sizes[index];
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestEventLogBook)
+{
+  std::string path = temp_path("event_log_book");
+  SimpleOrder bid(true, 1250, 100);
+  SimpleOrder ask0(false, 1250, 60);
+  SimpleOrder ask1(false, 1250, 60);
+  SimpleOrder empty(false, 1251, 0);
+  {
+    EventLogWriter log(path, 16);
+    LoggingBookManager books;
+    books.add_book("AAPL");
+    books.add_book("MSFT");
+    books.book(0).attach(&log, 0);
+    books.book(1).attach(&log, 1);
+    books.add(1, &bid);
+    books.add(1, &ask0);
+    books.perform_callbacks();
+    books.add(1, &ask1);
+    books.replace(1, &ask1, -10, 1252);
+    books.cancel(1, &bid);
+    books.add(0, &empty);
+    books.perform_callbacks();
+    // Callbacks are still performed
+    BOOST_REQUIRE_EQUAL(impl::os_complete, bid.state());
+    BOOST_REQUIRE_EQUAL(1252, ask1.price());
+    log.stop();
+    BOOST_REQUIRE_EQUAL(8, log.logged());
+  }
+
+  LoggedEvent expected[] = {
+    make_event(LoggedEvent::le_accept, 1, bid.order_id_),
+    make_event(LoggedEvent::le_accept, 2, ask0.order_id_),
+    make_event(LoggedEvent::le_fill, 2, ask0.order_id_, bid.order_id_,
+               60, 1250),
+    make_event(LoggedEvent::le_accept, 3, ask1.order_id_),
+    make_event(LoggedEvent::le_fill, 3, ask1.order_id_, bid.order_id_,
+               40, 1250),
+    make_event(LoggedEvent::le_replace, 4, ask1.order_id_, 0, 50, 1252),
+    make_event(LoggedEvent::le_cancel_reject, 5, bid.order_id_, 0, 0, 0,
+               "not found"),
+    make_event(LoggedEvent::le_reject, 1, empty.order_id_, 0, 0, 0,
+               "size must be positive")
+  };
+  const size_t count = sizeof(expected) / sizeof(expected[0]);
+  EventLogReader reader(path);
+  LoggedEvent event;
+  size_t index = 0;
+  while (reader.next(event)) {
+    BOOST_REQUIRE(index < count);
+    expected[index].symbol_id = index == count - 1 ? 0 : 1;
+    verify_event(expected[index], event);
+    ++index;
+  }
+  BOOST_REQUIRE_EQUAL(count, index);
+  ::unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestEventLogManyEvents)
+{
+  std::string path = temp_path("event_log_many");
+  const uint32_t num_events = 200000;
+  size_t bytes_written = 0;
+  {
+    // A small queue, so the producer waits on the writer
+    EventLogWriter log(path, 64);
+    for (uint32_t index = 0; index < num_events; ++index) {
+      log.log(make_event(LoggedEvent::le_fill, index / 2, index, index - 1,
+                         100, 1250 + index % 7));
+    }
+    log.stop();
+    bytes_written = log.bytes_written();
+  }
+  // Far smaller than the events themselves
+  BOOST_REQUIRE(bytes_written < num_events * 10);
+
+  EventLogReader reader(path);
+  LoggedEvent event;
+  for (uint32_t index = 0; index < num_events; ++index) {
+    BOOST_REQUIRE(reader.next(event));
+    BOOST_REQUIRE_EQUAL(index, event.order_id);
+    BOOST_REQUIRE_EQUAL(index - 1, event.matched_order_id);
+    BOOST_REQUIRE_EQUAL(index / 2, event.trans_id);
+    BOOST_REQUIRE_EQUAL(1250 + index % 7, event.price);
+  }
+  BOOST_REQUIRE(!reader.next(event));
+  ::unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestEventLogWriteFailed)
+{
+  // Every write to /dev/full fails, as the device is out of space
+  EventLogWriter log("/dev/full", 64);
+  for (uint32_t index = 0; index < 100000; ++index) {
+    log.log(make_event(LoggedEvent::le_fill, index, index, index - 1,
+                       100, 1250));
+  }
+  log.stop();
+  BOOST_REQUIRE_EQUAL(100000, log.logged());
+  BOOST_REQUIRE(!log.error().empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestEventLogInvalid)
+{
+  std::string path = temp_path("event_log_invalid");
+  BOOST_REQUIRE_THROW(EventLogReader reader(path), std::runtime_error);
+  FILE* file = fopen(path.c_str(), "wb");
+  fputs("not an event log", file);
+  fclose(file);
+  BOOST_REQUIRE_THROW(EventLogReader reader(path), std::runtime_error);
+  ::unlink(path.c_str());
+}
+
+} // namespace
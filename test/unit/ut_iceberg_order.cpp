@@ -0,0 +1,217 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_IcebergOrder
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+
+namespace liquibook {
+
+using impl::SimpleOrder;
+typedef FillCheck<SimpleOrder*> SimpleFillCheck;
+
+OrderConditions ICEBERG(oc_iceberg);
+
+BOOST_AUTO_TEST_CASE(TestIcebergShowsDisplayQty)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder ask0(false, 1252, 1000);
+  SimpleOrder ask1(false, 1252, 100);
+  SimpleOrder bid0(true,  1250, 500);
+  ask0.set_display_qty(200);
+  bid0.set_display_qty(100);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &ask0, false, false, ICEBERG));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask1, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid0, false, false, ICEBERG));
+
+  // Only the display qty is in the depth
+  DepthCheck dc(order_book.depth());
+  BOOST_REQUIRE(dc.verify_ask(1252, 2, 300));
+  BOOST_REQUIRE(dc.verify_bid(1250, 1, 100));
+  const SimpleOrderBook::Tracker& iceberg = order_book.asks().begin()->second;
+  BOOST_REQUIRE(iceberg.iceberg());
+  BOOST_REQUIRE_EQUAL(1000, iceberg.open_qty());
+  BOOST_REQUIRE_EQUAL(200, iceberg.visible_qty());
+  BOOST_REQUIRE_EQUAL(800, iceberg.hidden_qty());
+}
+
+BOOST_AUTO_TEST_CASE(TestIcebergRefreshBehind)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder ask0(false, 1252, 1000);
+  SimpleOrder ask1(false, 1252, 100);
+  SimpleOrder ask2(false, 1253, 100);
+  SimpleOrder bid0(true,  1252, 250);
+  SimpleOrder bid1(true,  1252, 100);
+  ask0.set_display_qty(200);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &ask0, false, false, ICEBERG));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask1, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask2, false));
+
+  // The display qty is filled, the next shown behind ask1
+  { BOOST_REQUIRE_NO_THROW(
+    SimpleFillCheck fc0(&bid0, 250, 250 * 1252);
+    SimpleFillCheck fc1(&ask0, 200, 200 * 1252);
+    SimpleFillCheck fc2(&ask1, 50, 50 * 1252);
+    BOOST_REQUIRE(add_and_verify(order_book, &bid0, true, true));
+  ); }
+  DepthCheck dc(order_book.depth());
+  BOOST_REQUIRE(dc.verify_ask(1252, 2, 250));
+  BOOST_REQUIRE(dc.verify_ask(1253, 1, 100));
+  SimpleOrderBook::Asks::const_iterator ask = order_book.asks().begin();
+  BOOST_REQUIRE_EQUAL(&ask1, ask->second.ptr());
+  ++ask;
+  BOOST_REQUIRE_EQUAL(&ask0, ask->second.ptr());
+  BOOST_REQUIRE_EQUAL(200, ask->second.visible_qty());
+  BOOST_REQUIRE_EQUAL(600, ask->second.hidden_qty());
+
+  // Which now has priority
+  { BOOST_REQUIRE_NO_THROW(
+    SimpleFillCheck fc0(&bid1, 100, 100 * 1252);
+    SimpleFillCheck fc1(&ask1, 50, 50 * 1252);
+    SimpleFillCheck fc2(&ask0, 50, 50 * 1252);
+    BOOST_REQUIRE(add_and_verify(order_book, &bid1, true, true));
+  ); }
+  BOOST_REQUIRE_EQUAL(impl::os_complete, ask1.state());
+  dc.reset();
+  BOOST_REQUIRE(dc.verify_ask(1252, 1, 150));
+  BOOST_REQUIRE(dc.verify_ask(1253, 1, 100));
+}
+
+BOOST_AUTO_TEST_CASE(TestIcebergRefreshInPlace)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder bid0(true,  1250, 500);
+  SimpleOrder bid1(true,  1249, 100);
+  SimpleOrder ask0(false, 1249, 450);
+  SimpleOrder ask1(false, 1249, 100);
+  bid0.set_display_qty(200);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &bid0, false, false, ICEBERG));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid1, false));
+
+  // Alone at its price, the iceberg is refreshed and filled again in turn
+  { BOOST_REQUIRE_NO_THROW(
+    SimpleFillCheck fc0(&ask0, 450, 450 * 1250);
+    SimpleFillCheck fc1(&bid0, 450, 450 * 1250);
+    BOOST_REQUIRE(add_and_verify(order_book, &ask0, true, true));
+  ); }
+  DepthCheck dc(order_book.depth());
+  BOOST_REQUIRE(dc.verify_bid(1250, 1, 50));
+  BOOST_REQUIRE(dc.verify_bid(1249, 1, 100));
+  BOOST_REQUIRE_EQUAL(0, order_book.bids().begin()->second.hidden_qty());
+
+  // Until filled
+  { BOOST_REQUIRE_NO_THROW(
+    SimpleFillCheck fc0(&ask1, 100, 50 * 1250 + 50 * 1249);
+    SimpleFillCheck fc1(&bid0, 50, 50 * 1250);
+    SimpleFillCheck fc2(&bid1, 50, 50 * 1249);
+    BOOST_REQUIRE(add_and_verify(order_book, &ask1, true, true));
+  ); }
+  BOOST_REQUIRE_EQUAL(impl::os_complete, bid0.state());
+  dc.reset();
+  BOOST_REQUIRE(dc.verify_bid(1249, 1, 50));
+  BOOST_REQUIRE(dc.verify_bid(0, 0, 0));
+}
+
+BOOST_AUTO_TEST_CASE(TestInboundIceberg)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder ask0(false, 1251, 300);
+  SimpleOrder ask1(false, 1252, 300);
+  SimpleOrder bid0(true,  1251, 1000);
+  bid0.set_display_qty(100);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &ask0, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask1, false));
+
+  // All the open qty of an inbound iceberg matches, the rest is hidden
+  { BOOST_REQUIRE_NO_THROW(
+    SimpleFillCheck fc0(&bid0, 300, 300 * 1251);
+    SimpleFillCheck fc1(&ask0, 300, 300 * 1251);
+    BOOST_REQUIRE(add_and_verify(order_book, &bid0, true, false, ICEBERG));
+  ); }
+  DepthCheck dc(order_book.depth());
+  BOOST_REQUIRE(dc.verify_bid(1251, 1, 100));
+  BOOST_REQUIRE(dc.verify_ask(1252, 1, 300));
+  BOOST_REQUIRE_EQUAL(600, order_book.bids().begin()->second.hidden_qty());
+}
+
+BOOST_AUTO_TEST_CASE(TestIcebergCancel)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder ask0(false, 1252, 1000);
+  SimpleOrder ask1(false, 1252, 100);
+  SimpleOrder bid0(true,  1252, 250);
+  ask0.set_display_qty(200);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &ask0, false, false, ICEBERG));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask1, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid0, true, true));
+
+  // Only the qty shown leaves the depth
+  BOOST_REQUIRE(cancel_and_verify(order_book, &ask0, impl::os_cancelled));
+  DepthCheck dc(order_book.depth());
+  BOOST_REQUIRE(dc.verify_ask(1252, 1, 50));
+  BOOST_REQUIRE(dc.verify_ask(0, 0, 0));
+  BOOST_REQUIRE_EQUAL(1, order_book.asks().size());
+}
+
+BOOST_AUTO_TEST_CASE(TestIcebergReplace)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder ask0(false, 1252, 1000);
+  SimpleOrder ask1(false, 1252, 100);
+  SimpleOrder bid0(true,  1250, 1000);
+  ask0.set_display_qty(200);
+  bid0.set_display_qty(300);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &ask0, false, false, ICEBERG));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask1, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid0, false, false, ICEBERG));
+
+  // A size decrease below the display qty shows all that is left
+  BOOST_REQUIRE(replace_and_verify(order_book, &bid0, -800));
+  DepthCheck dc(order_book.depth());
+  BOOST_REQUIRE(dc.verify_bid(1250, 1, 200));
+  BOOST_REQUIRE_EQUAL(0, order_book.bids().begin()->second.hidden_qty());
+
+  // A size increase is hidden, and the order loses its place
+  BOOST_REQUIRE(replace_and_verify(order_book, &ask0, 500));
+  dc.reset();
+  BOOST_REQUIRE(dc.verify_ask(1252, 2, 300));
+  SimpleOrderBook::Asks::const_iterator ask = order_book.asks().begin();
+  BOOST_REQUIRE_EQUAL(&ask1, ask->second.ptr());
+  ++ask;
+  BOOST_REQUIRE_EQUAL(1300, ask->second.hidden_qty());
+
+  // A price change shows the display qty at the new price
+  BOOST_REQUIRE(replace_and_verify(order_book, &ask0, SIZE_UNCHANGED, 1251));
+  dc.reset();
+  BOOST_REQUIRE(dc.verify_ask(1251, 1, 200));
+  BOOST_REQUIRE(dc.verify_ask(1252, 1, 100));
+}
+
+BOOST_AUTO_TEST_CASE(TestInvalidIceberg)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder ask0(false, 1252, 1000);
+  SimpleOrder ask1(false, 1252, 1000);
+  ask1.set_display_qty(200);
+
+  // An iceberg needs a display qty
+  BOOST_REQUIRE(!order_book.add(&ask0, ICEBERG));
+  order_book.perform_callbacks();
+  BOOST_REQUIRE_EQUAL(impl::os_new, ask0.state());
+
+  // And cannot be all or none
+  BOOST_REQUIRE(!order_book.add(&ask1, ICEBERG | oc_all_or_none));
+  order_book.perform_callbacks();
+  BOOST_REQUIRE_EQUAL(impl::os_new, ask1.state());
+  BOOST_REQUIRE_EQUAL(0, order_book.asks().size());
+}
+
+} // namespace
@@ -0,0 +1,223 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_ItchFeed
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+#include "impl/itch_feed.h"
+#include <stdio.h>
+#include <sstream>
+#include <unistd.h>
+
+namespace liquibook {
+
+using impl::ItchMessage;
+
+typedef impl::ItchFeedHandler<SimpleOrderBook> FeedHandler;
+typedef SimpleOrderBook::SimpleDepth SimpleDepth;
+
+// Builder of a capture of ITCH 5.0 messages, each preceded by its length
+class ItchCapture {
+public:
+  void stock_directory(uint16_t locate, const char* stock)
+  {
+    begin(ItchMessage::im_stock_directory, locate,
+          ItchMessage::STOCK_DIRECTORY_SIZE);
+    put_stock(ItchMessage::STOCK, stock);
+  }
+
+  void add(uint16_t locate, uint64_t ref, bool is_buy, uint32_t shares,
+           const char* stock, uint32_t price, bool attributed = false)
+  {
+    begin(attributed ? ItchMessage::im_add_attributed : ItchMessage::im_add,
+          locate, attributed ? ItchMessage::ADD_ATTRIBUTED_SIZE :
+                               ItchMessage::ADD_SIZE);
+    put64(ItchMessage::ORDER_REF, ref);
+    message_[ItchMessage::ADD_SIDE] = is_buy ? 'B' : 'S';
+    put32(ItchMessage::ADD_SHARES, shares);
+    put_stock(ItchMessage::ADD_STOCK, stock);
+    put32(ItchMessage::ADD_PRICE, price);
+  }
+
+  void executed(uint16_t locate, uint64_t ref, uint32_t shares)
+  {
+    begin(ItchMessage::im_executed, locate, ItchMessage::EXECUTED_SIZE);
+    put64(ItchMessage::ORDER_REF, ref);
+    put32(ItchMessage::EXECUTED_SHARES, shares);
+  }
+
+  void cancel(uint16_t locate, uint64_t ref, uint32_t shares)
+  {
+    begin(ItchMessage::im_cancel, locate, ItchMessage::CANCEL_SIZE);
+    put64(ItchMessage::ORDER_REF, ref);
+    put32(ItchMessage::CANCELLED_SHARES, shares);
+  }
+
+  void remove(uint16_t locate, uint64_t ref)
+  {
+    begin(ItchMessage::im_delete, locate, ItchMessage::DELETE_SIZE);
+    put64(ItchMessage::ORDER_REF, ref);
+  }
+
+  void replace(uint16_t locate, uint64_t ref, uint64_t new_ref,
+               uint32_t shares, uint32_t price)
+  {
+    begin(ItchMessage::im_replace, locate, ItchMessage::REPLACE_SIZE);
+    put64(ItchMessage::ORDER_REF, ref);
+    put64(ItchMessage::REPLACE_NEW_ORDER_REF, new_ref);
+    put32(ItchMessage::REPLACE_SHARES, shares);
+    put32(ItchMessage::REPLACE_PRICE, price);
+  }
+
+  // A message of a type not handled, e.g. a system event
+  void other(char type, size_t length)
+  {
+    begin(type, 0, length);
+  }
+
+  const std::string& data() const { return data_; }
+
+private:
+  void begin(char type, uint16_t locate, size_t length)
+  {
+    data_.push_back(char(length >> 8));
+    data_.push_back(char(length));
+    data_.append(length, '\0');
+    message_ = &data_[data_.size() - length];
+    message_[ItchMessage::TYPE] = type;
+    message_[ItchMessage::STOCK_LOCATE] = char(locate >> 8);
+    message_[ItchMessage::STOCK_LOCATE + 1] = char(locate);
+  }
+
+  void put32(size_t offset, uint32_t value)
+  {
+    for (int index = 0; index < 4; ++index) {
+      message_[offset + index] = char(value >> (24 - index * 8));
+    }
+  }
+
+  void put64(size_t offset, uint64_t value)
+  {
+    put32(offset, uint32_t(value >> 32));
+    put32(offset + 4, uint32_t(value));
+  }
+
+  void put_stock(size_t offset, const char* stock)
+  {
+    memset(message_ + offset, ' ', ItchMessage::STOCK_SIZE);
+    memcpy(message_ + offset, stock, strlen(stock));
+  }
+
+  std::string data_;
+  char* message_;
+};
+
+BOOST_AUTO_TEST_CASE(TestReadBigEndian)
+{
+  const char data[] = { char(0x01), char(0x02), char(0x03), char(0x04),
+                        char(0x85), char(0x06), char(0x07), char(0xF8) };
+  BOOST_REQUIRE_EQUAL(0x0102, FeedHandler::read16(data));
+  BOOST_REQUIRE_EQUAL(0x01020304u, FeedHandler::read32(data));
+  BOOST_REQUIRE_EQUAL(0x01020304850607F8ull, FeedHandler::read64(data));
+}
+
+BOOST_AUTO_TEST_CASE(TestFeedBuildsDepth)
+{
+  ItchCapture capture;
+  capture.stock_directory(7, "AAPL");
+  capture.other('S', 12);
+  capture.add(7, 1, true, 100, "AAPL", 1250000);
+  capture.add(7, 2, true, 200, "AAPL", 1250000);
+  capture.add(7, 3, true, 300, "AAPL", 1249000, true);
+  capture.add(7, 4, false, 400, "AAPL", 1251000);
+  capture.add(9, 5, false, 500, "MSFT", 300000);
+  FeedHandler feed;
+  BOOST_REQUIRE_EQUAL(7, feed.process(capture.data().data(),
+                                      capture.data().size()));
+  BOOST_REQUIRE_EQUAL(5, feed.order_count());
+  BOOST_REQUIRE_EQUAL(2, feed.books().size());
+  SimpleOrderBook* aapl = feed.find_book("AAPL");
+  BOOST_REQUIRE(aapl);
+  BOOST_REQUIRE(!feed.find_book("IBM"));
+  // The books hold no orders, only levels
+  BOOST_REQUIRE_EQUAL(0, aapl->bids().size());
+  SimpleDepth& depth = aapl->depth();
+  BOOST_REQUIRE(verify_depth(depth.bids()[0], 1250000, 2, 300));
+  BOOST_REQUIRE(verify_depth(depth.bids()[1], 1249000, 1, 300));
+  BOOST_REQUIRE(verify_depth(depth.asks()[0], 1251000, 1, 400));
+  BOOST_REQUIRE(verify_depth(feed.find_book("MSFT")->depth().asks()[0],
+                             300000, 1, 500));
+  depth.published();
+
+  ItchCapture updates;
+  updates.executed(7, 1, 60);     // partial
+  updates.cancel(7, 2, 200);      // whole
+  updates.executed(7, 4, 400);    // whole
+  updates.replace(7, 3, 6, 250, 1250500);
+  updates.remove(9, 5);
+  updates.remove(9, 99);          // not known
+  BOOST_REQUIRE_EQUAL(6, feed.process(updates.data().data(),
+                                      updates.data().size()));
+  BOOST_REQUIRE_EQUAL(2, feed.order_count());
+  BOOST_REQUIRE_EQUAL(1, feed.unknown_orders());
+  BOOST_REQUIRE(depth.changed());
+  BOOST_REQUIRE(verify_depth(depth.bids()[0], 1250500, 1, 250));
+  BOOST_REQUIRE(verify_depth(depth.bids()[1], 1250000, 1, 40));
+  BOOST_REQUIRE(verify_depth(depth.bids()[2], 0, 0, 0));
+  BOOST_REQUIRE(verify_depth(depth.asks()[0], 0, 0, 0));
+  BOOST_REQUIRE(verify_depth(feed.find_book("MSFT")->depth().asks()[0],
+                             0, 0, 0));
+  // Each level change is a transaction
+  BOOST_REQUIRE_EQUAL(4 + 5, aapl->trans_id());
+}
+
+BOOST_AUTO_TEST_CASE(TestFeedBeyondDepth)
+{
+  // Levels beyond the depth are restored as better levels empty
+  ItchCapture capture;
+  for (uint32_t index = 0; index < 8; ++index) {
+    capture.add(1, index + 1, false, 100 + index, "IBM", 1000 + index);
+  }
+  for (uint32_t index = 0; index < 3; ++index) {
+    capture.remove(1, index + 1);
+  }
+  FeedHandler feed;
+  feed.process(capture.data().data(), capture.data().size());
+  SimpleDepth& depth = feed.find_book("IBM")->depth();
+  for (uint32_t index = 0; index < 5; ++index) {
+    BOOST_REQUIRE(verify_depth(depth.asks()[index], 1003 + index, 1,
+                               103 + index));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestFeedFromFile)
+{
+  std::ostringstream path;
+  path << "/tmp/ut_itch_feed_" << getpid();
+  ItchCapture capture;
+  capture.add(1, 1, true, 100, "IBM", 1000);
+  capture.add(1, 2, true, 100, "IBM", 1000);
+  FILE* file = fopen(path.str().c_str(), "wb");
+  fwrite(capture.data().data(), 1, capture.data().size(), file);
+  fclose(file);
+
+  FeedHandler feed;
+  BOOST_REQUIRE_EQUAL(2, feed.process_file(path.str()));
+  BOOST_REQUIRE(verify_depth(feed.find_book("IBM")->depth().bids()[0],
+                             1000, 2, 200));
+  ::unlink(path.str().c_str());
+  BOOST_REQUIRE_THROW(feed.process_file(path.str()), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(TestFeedTruncated)
+{
+  ItchCapture capture;
+  capture.add(1, 1, true, 100, "IBM", 1000);
+  FeedHandler feed;
+  BOOST_REQUIRE_THROW(feed.process(capture.data().data(),
+                                   capture.data().size() - 1),
+                      std::runtime_error);
+}
+
+} // namespace
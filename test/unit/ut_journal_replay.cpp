@@ -0,0 +1,276 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_JournalReplay
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+#include "impl/journal_replay.h"
+#include "impl/simple_order_store.h"
+#include "book/book_manager.h"
+#include <unistd.h>
+
+namespace liquibook {
+
+using book::SymbolId;
+using impl::CommandJournal;
+using impl::JournalReader;
+using impl::JournalRecord;
+using impl::SimpleOrder;
+
+typedef book::BookManager<SimpleOrder*, SimpleOrderBook> SimpleBookManager;
+
+typedef impl::JournalReplay<SimpleOrder*, SimpleBookManager, StoreFactory>
+    SimpleReplay;
+
+// Journal each command before applying it, as a matching process would
+class JournaledBooks {
+public:
+  JournaledBooks(const std::string& path)
+  : journal_(path, 1024)
+  {
+    manager_.add_book("AAPL");
+    manager_.add_book("MSFT");
+  }
+
+  void add(SymbolId symbol_id,
+           SimpleOrder* order,
+           OrderConditions conditions = 0)
+  {
+    journal_.append(JournalRecord::add(next_trans_id(symbol_id), symbol_id,
+                                       order->order_id_, order->is_buy(),
+                                       order->price(), order->order_qty(),
+                                       conditions, order->stop_price(),
+                                       order->display_qty()));
+    manager_.add(symbol_id, order, conditions);
+    manager_.perform_callbacks();
+  }
+
+  void cancel(SymbolId symbol_id, SimpleOrder* order)
+  {
+    journal_.append(JournalRecord::cancel(next_trans_id(symbol_id), symbol_id,
+                                          order->order_id_));
+    manager_.cancel(symbol_id, order);
+    manager_.perform_callbacks();
+  }
+
+  void replace(SymbolId symbol_id,
+               SimpleOrder* order,
+               int32_t size_delta,
+               Price new_price)
+  {
+    journal_.append(JournalRecord::replace(next_trans_id(symbol_id),
+                                           symbol_id, order->order_id_,
+                                           size_delta, new_price));
+    manager_.replace(symbol_id, order, size_delta, new_price);
+    manager_.perform_callbacks();
+  }
+
+  SimpleBookManager& manager() { return manager_; }
+
+private:
+  book::TransId next_trans_id(SymbolId symbol_id)
+  {
+    return manager_.book(symbol_id).trans_id() + 1;
+  }
+
+  CommandJournal journal_;
+  SimpleBookManager manager_;
+};
+
+void run_session(JournaledBooks& books, std::vector<SimpleOrder*>& orders)
+{
+  for (Price price = 1240; price < 1250; ++price) {
+    orders.push_back(new SimpleOrder(true, price, 100));
+    books.add(0, orders.back());
+    orders.push_back(new SimpleOrder(false, price + 11, 100));
+    books.add(0, orders.back());
+    orders.push_back(new SimpleOrder(price % 2 == 0, price, 50));
+    books.add(1, orders.back());
+  }
+  // Cross, replace, and cancel a replaced order
+  orders.push_back(new SimpleOrder(false, 1247, 250));
+  books.add(0, orders.back());
+  books.replace(0, orders[1], 50, 1258);
+  books.replace(0, orders[3], -20, 1249);
+  books.cancel(0, orders[3]);
+  books.replace(1, orders[2], 0, 1239);
+  books.cancel(1, orders[5]);
+}
+
+void verify_books(SimpleBookManager& expected, SimpleBookManager& replayed)
+{
+  BOOST_REQUIRE_EQUAL(expected.size(), replayed.size());
+  for (SymbolId symbol_id = 0; symbol_id < expected.size(); ++symbol_id) {
+    SimpleOrderBook& expected_book = expected.book(symbol_id);
+    SimpleOrderBook& replayed_book = replayed.book(symbol_id);
+    BOOST_REQUIRE_EQUAL(expected_book.trans_id(), replayed_book.trans_id());
+    BOOST_REQUIRE_EQUAL(expected_book.bids().size(),
+                        replayed_book.bids().size());
+    BOOST_REQUIRE_EQUAL(expected_book.asks().size(),
+                        replayed_book.asks().size());
+    const book::DepthLevel* expected_level = expected_book.depth().bids();
+    const book::DepthLevel* replayed_level = replayed_book.depth().bids();
+    for ( ; expected_level != expected_book.depth().end();
+         ++expected_level, ++replayed_level) {
+      BOOST_REQUIRE_EQUAL(expected_level->price(), replayed_level->price());
+      BOOST_REQUIRE_EQUAL(expected_level->order_count(),
+                          replayed_level->order_count());
+      BOOST_REQUIRE_EQUAL(expected_level->aggregate_qty(),
+                          replayed_level->aggregate_qty());
+    }
+  }
+}
+
+void replay_session(bool perform_callbacks)
+{
+  std::string path = temp_path(perform_callbacks ? "journal_replay_callbacks"
+                                                : "journal_replay_quiet");
+  std::vector<SimpleOrder*> orders;
+  JournaledBooks books(path);
+  run_session(books, orders);
+
+  SimpleBookManager replayed;
+  replayed.add_book("AAPL");
+  replayed.add_book("MSFT");
+  StoreFactory factory;
+  SimpleReplay replay(replayed, factory, perform_callbacks);
+  JournalReader reader(path);
+  BOOST_REQUIRE_EQUAL(36, replay.replay(reader));
+  BOOST_REQUIRE_EQUAL(36, replay.applied());
+  BOOST_REQUIRE_EQUAL(0, replay.replay(reader));
+  verify_books(books.manager(), replayed);
+
+  // The replayed orders reflect their replaces
+  SimpleOrder* order = NULL;
+  BOOST_REQUIRE(replay.find_order(orders[2]->order_id_, order));
+  BOOST_REQUIRE_EQUAL(1239, order->price());
+  BOOST_REQUIRE(!replay.find_order(0, order));
+
+  for (size_t index = 0; index < orders.size(); ++index) {
+    delete orders[index];
+  }
+  ::unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestReplayWithCallbacks)
+{
+  replay_session(true);
+}
+
+BOOST_AUTO_TEST_CASE(TestReplayWithoutCallbacks)
+{
+  replay_session(false);
+}
+
+BOOST_AUTO_TEST_CASE(TestReplayStopOrder)
+{
+  std::string path = temp_path("journal_replay_stop");
+  std::vector<SimpleOrder*> orders;
+  JournaledBooks books(path);
+  orders.push_back(new SimpleOrder(false, 1251, 100));
+  books.add(0, orders.back());
+  orders.push_back(new SimpleOrder(false, 1252, 100));
+  books.add(0, orders.back());
+  orders.push_back(new SimpleOrder(true, 1252, 100));
+  orders.back()->set_stop_price(1251);
+  books.add(0, orders.back(), book::oc_stop);
+  orders.push_back(new SimpleOrder(true, 1251, 100));
+  books.add(0, orders.back());
+  // The stop is triggered, and trades
+  BOOST_REQUIRE_EQUAL(impl::os_complete, orders[2]->state());
+
+  SimpleBookManager replayed;
+  replayed.add_book("AAPL");
+  replayed.add_book("MSFT");
+  StoreFactory factory;
+  SimpleReplay replay(replayed, factory);
+  JournalReader reader(path);
+  BOOST_REQUIRE_EQUAL(4, replay.replay(reader));
+  verify_books(books.manager(), replayed);
+  // The replayed stop waited for its stop price, rather than be rejected
+  SimpleOrder* stop = NULL;
+  BOOST_REQUIRE(replay.find_order(orders[2]->order_id_, stop));
+  BOOST_REQUIRE_EQUAL(1251, stop->stop_price());
+  BOOST_REQUIRE_EQUAL(100, stop->filled_qty());
+  BOOST_REQUIRE(replayed.book(0).asks().empty());
+
+  for (size_t index = 0; index < orders.size(); ++index) {
+    delete orders[index];
+  }
+  ::unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestReplayIcebergOrder)
+{
+  std::string path = temp_path("journal_replay_iceberg");
+  std::vector<SimpleOrder*> orders;
+  JournaledBooks books(path);
+  orders.push_back(new SimpleOrder(false, 1251, 1000));
+  orders.back()->set_display_qty(200);
+  books.add(0, orders.back(), book::oc_iceberg);
+  orders.push_back(new SimpleOrder(false, 1251, 100));
+  books.add(0, orders.back());
+  orders.push_back(new SimpleOrder(true, 1251, 250));
+  books.add(0, orders.back());
+
+  SimpleBookManager replayed;
+  replayed.add_book("AAPL");
+  replayed.add_book("MSFT");
+  StoreFactory factory;
+  SimpleReplay replay(replayed, factory);
+  JournalReader reader(path);
+  BOOST_REQUIRE_EQUAL(3, replay.replay(reader));
+  verify_books(books.manager(), replayed);
+  // The replayed iceberg shows its display qty, rather than be rejected
+  SimpleOrder* iceberg = NULL;
+  BOOST_REQUIRE(replay.find_order(orders[0]->order_id_, iceberg));
+  BOOST_REQUIRE_EQUAL(200, iceberg->display_qty());
+  BOOST_REQUIRE_EQUAL(200, iceberg->filled_qty());
+  DepthCheck dc(replayed.book(0).depth());
+  BOOST_REQUIRE(dc.verify_ask(1251, 2, 250));
+
+  for (size_t index = 0; index < orders.size(); ++index) {
+    delete orders[index];
+  }
+  ::unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestReplayTransIdMismatch)
+{
+  std::string path = temp_path("journal_replay_mismatch");
+  {
+    CommandJournal journal(path, 16);
+    journal.append(JournalRecord::add(1, 0, 1, true, 1250, 100));
+    journal.append(JournalRecord::add(2, 0, 2, false, 1251, 100));
+    // Journaled as though a transaction were missing
+    journal.append(JournalRecord::cancel(4, 0, 1));
+  }
+  SimpleBookManager replayed;
+  replayed.add_book("AAPL");
+  StoreFactory factory;
+  SimpleReplay replay(replayed, factory, false);
+  JournalReader reader(path);
+  BOOST_REQUIRE_THROW(replay.replay(reader), std::runtime_error);
+  BOOST_REQUIRE_EQUAL(2, replay.applied());
+  ::unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestReplayUnknownOrder)
+{
+  std::string path = temp_path("journal_replay_unknown");
+  {
+    CommandJournal journal(path, 16);
+    journal.append(JournalRecord::cancel(1, 0, 7));
+  }
+  SimpleBookManager replayed;
+  replayed.add_book("AAPL");
+  StoreFactory factory;
+  SimpleReplay replay(replayed, factory);
+  JournalReader reader(path);
+  BOOST_REQUIRE_THROW(replay.replay(reader), std::runtime_error);
+  BOOST_REQUIRE_EQUAL(0, replay.applied());
+  ::unlink(path.c_str());
+}
+
+} // namespace
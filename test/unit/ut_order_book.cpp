@@ -9,6 +9,8 @@
 #include "book/order_book.h"
 #include "impl/simple_order.h"
 #include "impl/simple_order_book.h"
+#include "impl/multi_depth_order_book.h"
+#include "book/order_handle.h"
 #include <boost/shared_ptr.hpp>
 
 namespace liquibook {
@@ -102,6 +104,64 @@ BOOST_AUTO_TEST_CASE(TestAsksMultimapSortCorrect)
   BOOST_REQUIRE((asks.lower_bound(3235))->second.ptr()->price() == 3235);
 }
 
+BOOST_AUTO_TEST_CASE(TestBidsMoveToBack)
+{
+  SimpleOrderBook::Bids bids;
+  SimpleOrder order0(true, 1250, 100);
+  SimpleOrder order1(true, 1250, 100);
+  SimpleOrder order2(true, 1250, 100);
+  SimpleOrder order3(true, 1249, 100);
+  SimpleOrderBook::Bids::iterator bid0 =
+      bids.insert(std::make_pair(1250, SimpleTracker(&order0)));
+  SimpleOrderBook::Bids::iterator bid1 =
+      bids.insert(std::make_pair(1250, SimpleTracker(&order1)));
+  bids.insert(std::make_pair(1250, SimpleTracker(&order2)));
+  SimpleOrderBook::Bids::iterator bid3 =
+      bids.insert(std::make_pair(1249, SimpleTracker(&order3)));
+
+  // Moved behind the others of its price, but not the lower price
+  BOOST_REQUIRE(!bids.last_of_price(bid0));
+  BOOST_REQUIRE(bid1 == bids.move_to_back(bid0));
+  BOOST_REQUIRE(bids.last_of_price(bid0));
+  SimpleOrder* expected_order[] = { &order1, &order2, &order0, &order3 };
+  SimpleOrderBook::Bids::const_iterator bid = bids.begin();
+  for (size_t index = 0; index < 4; ++index, ++bid) {
+    BOOST_REQUIRE_EQUAL(expected_order[index], bid->second.ptr());
+  }
+  BOOST_REQUIRE(bid == bids.end());
+  BOOST_REQUIRE_EQUAL(4, bids.size());
+
+  // The iterators of the other orders remain valid
+  BOOST_REQUIRE(bid3 == bids.erase(bid0));
+  BOOST_REQUIRE_EQUAL(&order1, bid1->second.ptr());
+  BOOST_REQUIRE_EQUAL(&order3, bid3->second.ptr());
+  BOOST_REQUIRE(bids.end() == bids.erase(bid3));
+  BOOST_REQUIRE(bids.find(1249) == bids.end());
+  BOOST_REQUIRE_EQUAL(2, bids.size());
+}
+
+BOOST_AUTO_TEST_CASE(TestTrackerCachesOrder)
+{
+  SimpleOrder order(false, 1250, 300);
+  SimpleTracker tracker(&order);
+  BOOST_REQUIRE(!tracker.is_buy());
+  BOOST_REQUIRE_EQUAL(1250, tracker.price());
+  BOOST_REQUIRE_EQUAL(300, tracker.order_qty());
+  BOOST_REQUIRE_EQUAL(300, tracker.open_qty());
+
+  // The tracker follows fills and replaces before the order does
+  tracker.fill(100);
+  BOOST_REQUIRE_EQUAL(100, tracker.filled_qty());
+  tracker.change_qty(-50);
+  tracker.change_price(1251);
+  BOOST_REQUIRE_EQUAL(1251, tracker.price());
+  BOOST_REQUIRE_EQUAL(250, tracker.order_qty());
+  BOOST_REQUIRE_EQUAL(150, tracker.open_qty());
+  BOOST_REQUIRE_EQUAL(100, tracker.filled_qty());
+  BOOST_REQUIRE_EQUAL(1250, order.price());
+  BOOST_REQUIRE_EQUAL(300, order.order_qty());
+}
+
 BOOST_AUTO_TEST_CASE(TestAddCompleteBid)
 {
   SimpleOrderBook order_book;
@@ -2636,8 +2696,8 @@ BOOST_AUTO_TEST_CASE(TestReplaceBidMatch)
   BOOST_REQUIRE(dc.verify_ask(1253, 1, 160));
   BOOST_REQUIRE(dc.verify_ask(1254, 1, 200));
 
-  // Verify changed stamps
-  BOOST_REQUIRE(cc.verify_bid_changed(1, 1, 1, 0, 0));
+  // Verify changed stamps - the completely matched replacement never rests
+  BOOST_REQUIRE(cc.verify_bid_changed(0, 1, 0, 0, 0));
   BOOST_REQUIRE(cc.verify_ask_changed(1, 0, 0, 0, 0));
 }
 
@@ -2729,4 +2789,258 @@ BOOST_AUTO_TEST_CASE(TestReplaceAskMatch)
   BOOST_REQUIRE(cc.verify_ask_changed(1, 1, 1, 0, 0));
 }
 
+BOOST_AUTO_TEST_CASE(TestBookLevelsAggregate)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder ask1(false, 1252, 100);
+  SimpleOrder ask0(false, 1251, 200);
+  SimpleOrder bid2(true,  1251, 300);
+  SimpleOrder bid1(true,  1250, 100);
+  SimpleOrder bid0(true,  1250, 200);
+  SimpleOrder mkt0(false,    0, 100);
+
+  // No match
+  BOOST_REQUIRE(add_and_verify(order_book, &bid0, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid1, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask0, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask1, false));
+
+  // Verify levels
+  BOOST_REQUIRE_EQUAL(1, order_book.bid_levels().size());
+  BOOST_REQUIRE_EQUAL(2, order_book.ask_levels().size());
+  SimpleOrderBook::BidLevels::const_iterator bid_level = 
+      order_book.bid_levels().begin();
+  BOOST_REQUIRE(verify_depth(bid_level->second, 1250, 2, 300));
+  SimpleOrderBook::AskLevels::const_iterator ask_level = 
+      order_book.ask_levels().begin();
+  BOOST_REQUIRE(verify_depth(ask_level->second, 1251, 1, 200));
+  BOOST_REQUIRE(verify_depth((++ask_level)->second, 1252, 1, 100));
+
+  // Match - inbound rests with remaining quantity only
+  BOOST_REQUIRE(add_and_verify(order_book, &bid2, true));
+  BOOST_REQUIRE_EQUAL(2, order_book.bid_levels().size());
+  BOOST_REQUIRE_EQUAL(1, order_book.ask_levels().size());
+  bid_level = order_book.bid_levels().begin();
+  BOOST_REQUIRE(verify_depth(bid_level->second, 1251, 1, 100));
+  ask_level = order_book.ask_levels().begin();
+  BOOST_REQUIRE(verify_depth(ask_level->second, 1252, 1, 100));
+
+  // Market order fills the rest of a resting order, emptying its level,
+  // and is not aggregated
+  BOOST_REQUIRE(add_and_verify(order_book, &mkt0, true, true));
+  BOOST_REQUIRE_EQUAL(1, order_book.bid_levels().size());
+  BOOST_REQUIRE(order_book.bid_levels().find(1251) ==
+                order_book.bid_levels().end());
+  BOOST_REQUIRE(order_book.ask_levels().find(MARKET_ORDER_ASK_SORT_PRICE) ==
+                order_book.ask_levels().end());
+  bid_level = order_book.bid_levels().begin();
+  BOOST_REQUIRE(verify_depth(bid_level->second, 1250, 2, 300));
+
+  // Cancel removes quantity, and the level once empty
+  BOOST_REQUIRE(cancel_and_verify(order_book, &bid0, impl::os_cancelled));
+  bid_level = order_book.bid_levels().begin();
+  BOOST_REQUIRE(verify_depth(bid_level->second, 1250, 1, 100));
+  BOOST_REQUIRE(cancel_and_verify(order_book, &bid1, impl::os_cancelled));
+  BOOST_REQUIRE(order_book.bid_levels().empty());
+
+  // Verify depth agrees
+  DepthCheck dc(order_book.depth());
+  BOOST_REQUIRE(dc.verify_bid(   0, 0,   0));
+  BOOST_REQUIRE(dc.verify_ask(1252, 1, 100));
+}
+
+BOOST_AUTO_TEST_CASE(TestPopulateDepth)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder ask1(false, 1252, 100);
+  SimpleOrder ask0(false, 1251, 200);
+  SimpleOrder bid1(true,  1251, 300);
+  SimpleOrder bid0(true,  1250, 200);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &bid0, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask0, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask1, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid1, true));
+
+  // Rebuilt depth matches incremental depth
+  SimpleDepth rebuilt;
+  order_book.populate_depth(rebuilt);
+  const DepthLevel* level = order_book.depth().bids();
+  const DepthLevel* rebuilt_level = rebuilt.bids();
+  for ( ; level != order_book.depth().end(); ++level, ++rebuilt_level) {
+    BOOST_REQUIRE(verify_depth(*rebuilt_level, level->price(), 
+                               level->order_count(), level->aggregate_qty()));
+  }
+
+  // Best levels
+  DepthLevel best;
+  BOOST_REQUIRE(order_book.populate_bid_depth_level_after(
+      MARKET_ORDER_BID_SORT_PRICE, best));
+  BOOST_REQUIRE(verify_depth(best, 1251, 1, 100));
+  BOOST_REQUIRE(order_book.populate_bid_depth_level_after(1251, best));
+  BOOST_REQUIRE(verify_depth(best, 1250, 1, 200));
+  BOOST_REQUIRE(!order_book.populate_bid_depth_level_after(1250, best));
+  BOOST_REQUIRE(verify_depth(best, 0, 0, 0));
+  BOOST_REQUIRE(order_book.populate_ask_depth_level_after(
+      MARKET_ORDER_ASK_SORT_PRICE, best));
+  BOOST_REQUIRE(verify_depth(best, 1252, 1, 100));
+}
+
+BOOST_AUTO_TEST_CASE(TestMultipleDepthViews)
+{
+  typedef impl::MultiDepthOrderBook<5> MultiDepthOrderBook;
+  MultiDepthOrderBook order_book;
+  test::ChangedChecker<1> bbo_cc(order_book.bbo());
+  SimpleOrder bid6(true,  1244, 100);
+  SimpleOrder bid5(true,  1245, 100);
+  SimpleOrder bid4(true,  1246, 100);
+  SimpleOrder bid3(true,  1247, 100);
+  SimpleOrder bid2(true,  1248, 100);
+  SimpleOrder bid1(true,  1249, 100);
+  SimpleOrder bid0(true,  1250, 200);
+  SimpleOrder ask0(false, 1250, 200);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &bid0, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid1, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid2, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid3, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid4, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid5, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid6, false));
+
+  // All views agree
+  BOOST_REQUIRE(verify_depth(*order_book.bbo().bids(), 1250, 1, 200));
+  DepthCheck dc(order_book.depth());
+  BOOST_REQUIRE(dc.verify_bid(1250, 1, 200));
+  BOOST_REQUIRE(dc.verify_bid(1249, 1, 100));
+  BOOST_REQUIRE(dc.verify_bid(1248, 1, 100));
+  BOOST_REQUIRE(dc.verify_bid(1247, 1, 100));
+  BOOST_REQUIRE(dc.verify_bid(1246, 1, 100));
+  BOOST_REQUIRE_EQUAL(7, order_book.bid_levels().size());
+
+  // Views publish independently
+  order_book.depth().published();
+  BOOST_REQUIRE(!order_book.depth().changed());
+  BOOST_REQUIRE(order_book.bbo().changed());
+  bbo_cc.reset();
+
+  // Changes below the BBO do not change it
+  BOOST_REQUIRE(cancel_and_verify(order_book, &bid3, impl::os_cancelled));
+  BOOST_REQUIRE(!order_book.bbo().changed());
+  BOOST_REQUIRE(order_book.depth().changed());
+
+  // Removal of the best bid restores both views from the book's levels
+  BOOST_REQUIRE(add_and_verify(order_book, &ask0, true, true));
+  BOOST_REQUIRE(bbo_cc.verify_bbo_changed(1, 0));
+  BOOST_REQUIRE(verify_depth(*order_book.bbo().bids(), 1249, 1, 100));
+  dc.reset();
+  BOOST_REQUIRE(dc.verify_bid(1249, 1, 100));
+  BOOST_REQUIRE(dc.verify_bid(1248, 1, 100));
+  BOOST_REQUIRE(dc.verify_bid(1246, 1, 100));
+  BOOST_REQUIRE(dc.verify_bid(1245, 1, 100));
+  BOOST_REQUIRE(dc.verify_bid(1244, 1, 100));
+}
+
+// Store of orders referred to by handle
+struct HandleStore {
+  typedef SimpleOrder OrderType;
+  static SimpleOrder& order(uint32_t index) { return orders[index]; }
+  static std::vector<SimpleOrder> orders;
+};
+std::vector<SimpleOrder> HandleStore::orders;
+typedef book::OrderHandle<HandleStore> SimpleHandle;
+
+BOOST_AUTO_TEST_CASE(TestOrderHandleBook)
+{
+  // Trackers of handles hold no more than six 32 bit values: the five of
+  // every order, and the hidden quantity an iceberg needs while matching
+  BOOST_REQUIRE(sizeof(OrderTracker<SimpleHandle>) <= 6 * sizeof(uint32_t));
+
+  HandleStore::orders.clear();
+  HandleStore::orders.push_back(SimpleOrder(true, 1250, 100));
+  HandleStore::orders.push_back(SimpleOrder(true, 1249, 100));
+  HandleStore::orders.push_back(SimpleOrder(false, 1252, 100));
+  HandleStore::orders.push_back(SimpleOrder(false, 1250, 60));
+  OrderBook<SimpleHandle> order_book;
+  SimpleHandle bid0(0), bid1(1), ask0(2), ask1(3);
+  BOOST_REQUIRE(!order_book.add(bid0));
+  BOOST_REQUIRE(!order_book.add(bid1));
+  BOOST_REQUIRE(!order_book.add(ask0));
+  BOOST_REQUIRE(order_book.add(ask1));
+  order_book.perform_callbacks();
+
+  // The inbound ask filled against the best bid
+  BOOST_REQUIRE_EQUAL(2, order_book.bids().size());
+  BOOST_REQUIRE(order_book.bids().begin()->second.ptr() == bid0);
+  BOOST_REQUIRE_EQUAL(40, order_book.bids().begin()->second.open_qty());
+  BOOST_REQUIRE_EQUAL(40, order_book.bid_levels().begin()->second.aggregate_qty());
+  BOOST_REQUIRE_EQUAL(1, order_book.asks().size());
+
+  // Cancel by handle
+  order_book.cancel(bid0);
+  BOOST_REQUIRE_EQUAL(1, order_book.bids().size());
+  BOOST_REQUIRE(order_book.bids().begin()->second.ptr() == bid1);
+  BOOST_REQUIRE(!SimpleHandle());
+}
+
+#if __cplusplus >= 201103L
+// Order pointer counting the copies made of it, as a smart pointer would
+// update its reference count
+struct CountedOrderPtr {
+  CountedOrderPtr(SimpleOrder* order = NULL) : order_(order) {}
+  CountedOrderPtr(const CountedOrderPtr& rhs) : order_(rhs.order_) { ++copies; }
+  CountedOrderPtr(CountedOrderPtr&& rhs) : order_(rhs.order_) {}
+  CountedOrderPtr& operator=(const CountedOrderPtr& rhs) 
+    { order_ = rhs.order_; ++copies; return *this; }
+  CountedOrderPtr& operator=(CountedOrderPtr&& rhs) 
+    { order_ = rhs.order_; return *this; }
+  SimpleOrder* operator->() const { return order_; }
+  operator bool() const { return order_ != NULL; }
+  bool operator==(const CountedOrderPtr& rhs) const 
+    { return order_ == rhs.order_; }
+  SimpleOrder* order_;
+  static int copies;
+};
+int CountedOrderPtr::copies = 0;
+
+BOOST_AUTO_TEST_CASE(TestOrderPtrCopies)
+{
+  OrderBook<CountedOrderPtr> order_book;
+  SimpleOrder bid0(true, 1250, 100);
+  SimpleOrder bid1(true, 1248, 100);
+  SimpleOrder ask0(false, 1249, 100);
+  SimpleOrder ask1(false, 1251, 100);
+
+  // Resting order is moved into the book, and copied for the accept
+  CountedOrderPtr::copies = 0;
+  order_book.add(CountedOrderPtr(&bid0));
+  BOOST_REQUIRE_EQUAL(1, CountedOrderPtr::copies);
+
+  // Order added by reference is copied for the book too
+  CountedOrderPtr bid1_ptr(&bid1);
+  CountedOrderPtr::copies = 0;
+  order_book.add(bid1_ptr);
+  BOOST_REQUIRE_EQUAL(2, CountedOrderPtr::copies);
+
+  // Replace moves the order's tracker
+  CountedOrderPtr::copies = 0;
+  order_book.replace(CountedOrderPtr(&bid0), 0, 1249);
+  BOOST_REQUIRE_EQUAL(1, CountedOrderPtr::copies);
+
+  // Crossing order is copied for the accept and the fill, and the filled
+  // order leaves the book by moving into the fill
+  CountedOrderPtr::copies = 0;
+  order_book.add(CountedOrderPtr(&ask0));
+  BOOST_REQUIRE_EQUAL(2, CountedOrderPtr::copies);
+  BOOST_REQUIRE_EQUAL(1, order_book.bids().size());
+  BOOST_REQUIRE(order_book.bids().begin()->second.ptr() == bid1_ptr);
+
+  // Unfilled IOC order is moved into its cancel
+  CountedOrderPtr::copies = 0;
+  order_book.add(CountedOrderPtr(&ask1), oc_immediate_or_cancel);
+  BOOST_REQUIRE_EQUAL(1, CountedOrderPtr::copies);
+  BOOST_REQUIRE(order_book.asks().empty());
+}
+#endif
+
 } // namespace
@@ -0,0 +1,202 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_PriceLevelBook
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+#include "book/price_level_book.h"
+#include "book/depth_subscriber.h"
+#include <stdlib.h>
+
+namespace liquibook {
+
+using impl::SimpleOrder;
+
+typedef book::PriceLevelBook<5> SizedLevelBook;
+typedef SizedLevelBook::TypedDepth SizedDepth;
+
+BOOST_AUTO_TEST_CASE(TestSetLevels)
+{
+  SizedLevelBook book;
+  SizedDepth& depth = book.depth();
+  BOOST_REQUIRE(!book.set_level(1250, 3, 700, true));
+  BOOST_REQUIRE(!book.set_level(1249, 1, 100, true));
+  BOOST_REQUIRE(!book.set_level(1251, 2, 400, false));
+  BOOST_REQUIRE_EQUAL(3, book.trans_id());
+  BOOST_REQUIRE(verify_depth(depth.bids()[0], 1250, 3, 700));
+  BOOST_REQUIRE(verify_depth(depth.bids()[1], 1249, 1, 100));
+  BOOST_REQUIRE(verify_depth(depth.asks()[0], 1251, 2, 400));
+  depth.published();
+
+  // Replacing a level changes only that level
+  book::DepthSubscriber<5> subscriber(depth);
+  subscriber.seen();
+  BOOST_REQUIRE(!book.set_level(1250, 2, 500, true));
+  BOOST_REQUIRE(depth.changed());
+  BOOST_REQUIRE(verify_depth(depth.bids()[0], 1250, 2, 500));
+  BOOST_REQUIRE_EQUAL(depth.bids(), subscriber.next_changed(depth.bids()));
+  BOOST_REQUIRE_EQUAL(depth.end(), subscriber.next_changed(depth.bids() + 1));
+
+  // A better level shifts those worse
+  subscriber.seen();
+  BOOST_REQUIRE(!book.set_level(1252, 1, 200, false));
+  BOOST_REQUIRE(!book.set_level(1250, 1, 300, false));
+  BOOST_REQUIRE(verify_depth(depth.asks()[0], 1250, 1, 300));
+  BOOST_REQUIRE(verify_depth(depth.asks()[1], 1251, 2, 400));
+  BOOST_REQUIRE(verify_depth(depth.asks()[2], 1252, 1, 200));
+  BOOST_REQUIRE_EQUAL(depth.asks(), subscriber.next_changed(depth.bids()));
+  BOOST_REQUIRE_EQUAL(6, book.trans_id());
+}
+
+BOOST_AUTO_TEST_CASE(TestDeleteLevels)
+{
+  SizedLevelBook book;
+  SizedDepth& depth = book.depth();
+  book.set_level(1250, 1, 100, true);
+  book.set_level(1249, 1, 200, true);
+  book.set_level(1248, 1, 300, true);
+  BOOST_REQUIRE(book.delete_level(1249, true));
+  BOOST_REQUIRE(verify_depth(depth.bids()[0], 1250, 1, 100));
+  BOOST_REQUIRE(verify_depth(depth.bids()[1], 1248, 1, 300));
+  BOOST_REQUIRE(verify_depth(depth.bids()[2], 0, 0, 0));
+  // A level of no quantity, or no orders, is deleted
+  BOOST_REQUIRE(book.set_level(1250, 1, 0, true));
+  BOOST_REQUIRE(book.set_level(1248, 0, 300, true));
+  BOOST_REQUIRE(verify_depth(depth.bids()[0], 0, 0, 0));
+  // Deleting a level not known changes nothing, but is a transaction
+  depth.published();
+  BOOST_REQUIRE(!book.delete_level(1247, true));
+  BOOST_REQUIRE(!book.delete_level(1247, false));
+  BOOST_REQUIRE(!depth.changed());
+  BOOST_REQUIRE_EQUAL(8, book.trans_id());
+}
+
+BOOST_AUTO_TEST_CASE(TestLevelsBeyondDepth)
+{
+  // Levels worse than the depth are kept, and shown once better are deleted
+  SizedLevelBook book;
+  SizedDepth& depth = book.depth();
+  for (book::Price price = 1251; price <= 1258; ++price) {
+    book.set_level(price, 1, price - 1150, false);
+  }
+  book.set_level(1257, 4, 900, false);
+  BOOST_REQUIRE(verify_depth(depth.asks()[4], 1255, 1, 105));
+  book.delete_level(1251, false);
+  book.delete_level(1252, false);
+  BOOST_REQUIRE(verify_depth(depth.asks()[0], 1253, 1, 103));
+  BOOST_REQUIRE(verify_depth(depth.asks()[3], 1256, 1, 106));
+  BOOST_REQUIRE(verify_depth(depth.asks()[4], 1257, 4, 900));
+  book.delete_level(1257, false);
+  BOOST_REQUIRE(verify_depth(depth.asks()[4], 1258, 1, 108));
+}
+
+BOOST_AUTO_TEST_CASE(TestRestoreAndClear)
+{
+  SizedLevelBook book;
+  SizedDepth& depth = book.depth();
+  book.set_level(1240, 1, 100, true);
+  book.set_level(1260, 1, 100, false);
+
+  // Restored from a snapshot, in one transaction
+  book::BidLevelMap bids;
+  book::AskLevelMap asks;
+  for (book::Price price = 1250; price > 1243; --price) {
+    bids[price].init(price, false);
+    bids[price].set(2, (1251 - price) * 100);
+  }
+  asks[1251].init(1251, false);
+  asks[1251].set(1, 500);
+  depth.published();
+  book.restore(bids.begin(), bids.end(), asks.begin(), asks.end());
+  BOOST_REQUIRE_EQUAL(3, book.trans_id());
+  BOOST_REQUIRE(depth.changed());
+  BOOST_REQUIRE(verify_depth(depth.bids()[0], 1250, 2, 100));
+  BOOST_REQUIRE(verify_depth(depth.bids()[4], 1246, 2, 500));
+  BOOST_REQUIRE(verify_depth(depth.asks()[0], 1251, 1, 500));
+  BOOST_REQUIRE(verify_depth(depth.asks()[1], 0, 0, 0));
+  // Levels of the snapshot beyond the depth are kept
+  book.delete_level(1250, true);
+  BOOST_REQUIRE(verify_depth(depth.bids()[4], 1245, 2, 600));
+
+  depth.published();
+  book.clear();
+  BOOST_REQUIRE_EQUAL(5, book.trans_id());
+  BOOST_REQUIRE(depth.changed());
+  for (const DepthLevel* level = depth.bids(); level != depth.end();
+       ++level) {
+    BOOST_REQUIRE(verify_depth(*level, 0, 0, 0));
+  }
+  book.delete_level(1249, true);
+  BOOST_REQUIRE(verify_depth(depth.bids()[0], 0, 0, 0));
+}
+
+// Set the level of an order book at a price on a level book
+void copy_level(const SimpleOrderBook& order_book,
+                SizedLevelBook& level_book,
+                book::Price price,
+                bool is_bid)
+{
+  if (is_bid) {
+    SimpleOrderBook::BidLevels::const_iterator level =
+        order_book.bid_levels().find(price);
+    if (level == order_book.bid_levels().end()) {
+      level_book.delete_level(price, true);
+    } else {
+      level_book.set_level(price, level->second.order_count(),
+                           level->second.aggregate_qty(), true);
+    }
+  } else {
+    SimpleOrderBook::AskLevels::const_iterator level =
+        order_book.ask_levels().find(price);
+    if (level == order_book.ask_levels().end()) {
+      level_book.delete_level(price, false);
+    } else {
+      level_book.set_level(price, level->second.order_count(),
+                           level->second.aggregate_qty(), false);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestSameDepthAsOrderBook)
+{
+  // A level book given the levels of an order book shows the same depth
+  SimpleOrderBook order_book;
+  SizedLevelBook level_book;
+  std::vector<SimpleOrder*> orders;
+  srand(1250);
+  for (int index = 0; index < 2000; ++index) {
+    SimpleOrder* order;
+    if (index % 3 == 2) {
+      size_t position = rand() % orders.size();
+      order = orders[position];
+      orders[position] = orders.back();
+      orders.pop_back();
+      order_book.cancel(order);
+    } else {
+      bool is_buy = rand() % 2 == 0;
+      order = new SimpleOrder(is_buy, is_buy ? 1240 + rand() % 10 :
+                                               1251 + rand() % 10,
+                              (rand() % 9 + 1) * 100);
+      orders.push_back(order);
+      order_book.add(order);
+    }
+    order_book.perform_callbacks();
+    copy_level(order_book, level_book, order->price(), order->is_buy());
+    const DepthLevel* expected = order_book.depth().bids();
+    const DepthLevel* level = level_book.depth().bids();
+    for ( ; level != level_book.depth().end(); ++level, ++expected) {
+      BOOST_REQUIRE(verify_depth(*level, expected->price(),
+                                 expected->order_count(),
+                                 expected->aggregate_qty()));
+    }
+    if (order->state() == impl::os_cancelled) {
+      delete order;
+    }
+  }
+  for (size_t index = 0; index < orders.size(); ++index) {
+    delete orders[index];
+  }
+}
+
+} // namespace
@@ -0,0 +1,190 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_ShardedEngine
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+#include "impl/sharded_engine.h"
+#include "impl/run_loop.h"
+#include "book/book_manager.h"
+#include <thread>
+
+namespace liquibook {
+
+using book::SymbolId;
+using impl::SimpleOrder;
+
+typedef impl::ShardedEngine<SimpleOrder*, SimpleOrderBook> SimpleEngine;
+typedef SimpleEngine::Result Result;
+typedef book::Callback<SimpleOrder*> Callback;
+
+BOOST_AUTO_TEST_CASE(TestSpscQueue)
+{
+  impl::SpscQueue<int> queue(3);
+  BOOST_REQUIRE_EQUAL(4, queue.capacity());
+  BOOST_REQUIRE(queue.empty());
+  for (int value = 0; value < 4; ++value) {
+    BOOST_REQUIRE(queue.push(value));
+  }
+  BOOST_REQUIRE(!queue.push(4));
+  int value = -1;
+  BOOST_REQUIRE(queue.pop(value));
+  BOOST_REQUIRE_EQUAL(0, value);
+  BOOST_REQUIRE(queue.push(4));
+  for (int expected = 1; expected < 5; ++expected) {
+    BOOST_REQUIRE(queue.pop(value));
+    BOOST_REQUIRE_EQUAL(expected, value);
+  }
+  BOOST_REQUIRE(!queue.pop(value));
+  BOOST_REQUIRE(queue.empty());
+}
+
+BOOST_AUTO_TEST_CASE(TestRunLoopDrivesBooks)
+{
+  typedef book::BookManager<SimpleOrder*, SimpleOrderBook> Books;
+  typedef impl::EngineCommand<SimpleOrder*> Command;
+  Books books;
+  SymbolId aapl = books.add_book("AAPL");
+  impl::SpscQueue<Command> commands(16);
+  impl::BookPoller<SimpleOrder*, Books> poller(commands, books, 2);
+  impl::RunLoop loop(0, impl::RunLoop::im_backoff);
+
+  SimpleOrder bid(true, 1250, 100);
+  SimpleOrder ask0(false, 1251, 100);
+  SimpleOrder ask1(false, 1250, 100);
+  SimpleOrder* orders[] = { &bid, &ask0, &ask1 };
+  std::thread worker(&impl::RunLoop::run<impl::BookPoller<SimpleOrder*, Books> >,
+                     &loop, std::ref(poller));
+  for (int i = 0; i < 3; ++i) {
+    Command command;
+    command.type = Command::ec_add;
+    command.symbol_id = aapl;
+    command.order = orders[i];
+    command.conditions = 0;
+    BOOST_REQUIRE(commands.push(command));
+  }
+  Command command;
+  command.type = Command::ec_replace;
+  command.symbol_id = aapl;
+  command.order = &ask0;
+  command.size_delta = -50;
+  command.new_price = PRICE_UNCHANGED;
+  BOOST_REQUIRE(commands.push(command));
+
+  // Stopping leaves no queued command unapplied
+  loop.stop();
+  worker.join();
+  BOOST_REQUIRE(loop.stopped());
+  BOOST_REQUIRE(loop.pinned());
+  BOOST_REQUIRE(commands.empty());
+  BOOST_REQUIRE_EQUAL(impl::os_complete, bid.state());
+  BOOST_REQUIRE_EQUAL(impl::os_complete, ask1.state());
+  BOOST_REQUIRE_EQUAL(50, ask0.order_qty());
+  BOOST_REQUIRE_EQUAL(1, books.book(aapl).asks().size());
+}
+
+BOOST_AUTO_TEST_CASE(TestRunLoopCpuRange)
+{
+  BOOST_REQUIRE_THROW(impl::RunLoop loop(-2), std::runtime_error);
+  BOOST_REQUIRE_THROW(impl::RunLoop loop(CPU_SETSIZE), std::runtime_error);
+  BOOST_REQUIRE(!impl::RunLoop::pin(CPU_SETSIZE));
+  BOOST_REQUIRE_THROW(SimpleEngine engine(1, 16, std::vector<int>(1, -5)),
+                      std::runtime_error);
+
+  // Not running, so not yet pinned
+  impl::RunLoop loop(CPU_SETSIZE - 1);
+  BOOST_REQUIRE(!loop.pinned());
+
+  // No such cpu, so runs unpinned
+  struct IdlePoller {
+    size_t poll() { return 0; }
+  } poller;
+  loop.stop();
+  loop.run(poller);
+  BOOST_REQUIRE(!loop.pinned());
+}
+
+BOOST_AUTO_TEST_CASE(TestShardBooks)
+{
+  SimpleEngine engine(2, 1024);
+  SymbolId aapl = engine.add_book("AAPL");
+  SymbolId msft = engine.add_book("MSFT");
+  SymbolId ibm = engine.add_book("IBM");
+  BOOST_REQUIRE_THROW(engine.add_book("IBM"), std::runtime_error);
+  BOOST_REQUIRE_EQUAL(0, engine.shard_of(aapl));
+  BOOST_REQUIRE_EQUAL(1, engine.shard_of(msft));
+  BOOST_REQUIRE_EQUAL(0, engine.shard_of(ibm));
+  SymbolId symbol_id;
+  BOOST_REQUIRE(engine.find_symbol("MSFT", symbol_id));
+  BOOST_REQUIRE_EQUAL(msft, symbol_id);
+
+  // Cross in each book
+  SimpleOrder orders[] = {
+    SimpleOrder(true, 1250, 100), SimpleOrder(false, 1250, 100),
+    SimpleOrder(true, 3000, 100), SimpleOrder(false, 3000, 100),
+    SimpleOrder(true, 1800, 100), SimpleOrder(false, 1800, 100) };
+  SymbolId symbols[] = { aapl, aapl, msft, msft, ibm, ibm };
+  engine.start();
+  for (int i = 0; i < 6; ++i) {
+    BOOST_REQUIRE(engine.add(symbols[i], &orders[i]));
+  }
+
+  // Each add is accepted, each cross fills
+  int accepts[3] = { 0, 0, 0 };
+  int fills[3] = { 0, 0, 0 };
+  int results = 0;
+  Result result;
+  while (results < 9) {
+    for (size_t shard = 0; shard < engine.shard_count(); ++shard) {
+      while (engine.poll(shard, result)) {
+        BOOST_REQUIRE_EQUAL(shard, engine.shard_of(result.symbol_id));
+        if (result.callback.type == Callback::cb_order_accept) {
+          ++accepts[result.symbol_id];
+        } else if (result.callback.type == Callback::cb_order_fill) {
+          ++fills[result.symbol_id];
+          BOOST_REQUIRE_EQUAL(100, result.callback.fill_qty);
+        }
+        ++results;
+      }
+    }
+  }
+  engine.stop();
+  for (int book = 0; book < 3; ++book) {
+    BOOST_REQUIRE_EQUAL(2, accepts[book]);
+    BOOST_REQUIRE_EQUAL(1, fills[book]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TestStopWithFullResults)
+{
+  SimpleEngine engine(1, 4);
+  SymbolId aapl = engine.add_book("AAPL");
+  engine.start();
+
+  // No polling, so the worker fills the results queue with the first four
+  // accepts, then waits to queue the fifth
+  SimpleOrder orders[] = {
+    SimpleOrder(true, 1250, 100), SimpleOrder(true, 1249, 100),
+    SimpleOrder(true, 1248, 100), SimpleOrder(true, 1247, 100),
+    SimpleOrder(true, 1246, 100), SimpleOrder(true, 1245, 100),
+    SimpleOrder(true, 1244, 100), SimpleOrder(true, 1243, 100) };
+  for (int i = 0; i < 8; ++i) {
+    while (!engine.add(aapl, &orders[i])) {
+      std::this_thread::yield();
+    }
+  }
+
+  // Stopping drains the commands without waiting for the consumer
+  engine.stop();
+  BOOST_REQUIRE_EQUAL(4, engine.dropped(0));
+  Result result;
+  int results = 0;
+  while (engine.poll(0, result)) {
+    BOOST_REQUIRE_EQUAL(Callback::cb_order_accept, result.callback.type);
+    ++results;
+  }
+  BOOST_REQUIRE_EQUAL(4, results);
+}
+
+} // namespace
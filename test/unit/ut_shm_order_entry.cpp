@@ -0,0 +1,193 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_ShmOrderEntry
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+#include "impl/shm_order_entry.h"
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace liquibook {
+
+using impl::SimpleOrder;
+using impl::ShmCommand;
+using impl::ShmResponse;
+
+BOOST_AUTO_TEST_CASE(TestShmRingProducers)
+{
+  impl::SharedMemory memory(temp_path("shm_order_entry_ring", "/dev/shm"),
+                            impl::ShmRing<uint64_t>::footprint(64));
+  memory.remove();
+  impl::ShmRing<uint64_t> ring(memory.address(), 64, true);
+  BOOST_REQUIRE_EQUAL(64, ring.capacity());
+  BOOST_REQUIRE_THROW(impl::ShmRing<uint64_t>(memory.address(), 48, false),
+                      std::runtime_error);
+
+  const uint64_t count = 20000;
+  std::thread producers[2];
+  for (uint64_t producer = 0; producer < 2; ++producer) {
+    producers[producer] = std::thread([&ring, producer, count]() {
+      for (uint64_t value = 0; value < count; ++value) {
+        while (!ring.push(producer << 32 | value)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  // Each producer's values arrive in order
+  uint64_t expected[2] = { 0, 0 };
+  uint64_t value;
+  while (expected[0] < count || expected[1] < count) {
+    if (ring.pop(value)) {
+      uint64_t producer = value >> 32;
+      BOOST_REQUIRE_EQUAL(expected[producer], value & 0xFFFFFFFF);
+      ++expected[producer];
+    }
+  }
+  producers[0].join();
+  producers[1].join();
+  BOOST_REQUIRE(!ring.pop(value));
+}
+
+BOOST_AUTO_TEST_CASE(TestShmRingFull)
+{
+  impl::SharedMemory memory(temp_path("shm_order_entry_full", "/dev/shm"),
+                            impl::ShmRing<uint32_t>::footprint(4));
+  memory.remove();
+  impl::ShmRing<uint32_t> ring(memory.address(), 4, true);
+  for (uint32_t value = 0; value < 4; ++value) {
+    BOOST_REQUIRE(ring.push(value));
+  }
+  BOOST_REQUIRE(!ring.push(4));
+  uint32_t value;
+  BOOST_REQUIRE(ring.pop(value));
+  BOOST_REQUIRE_EQUAL(0, value);
+  BOOST_REQUIRE(ring.push(4));
+  for (uint32_t expected = 1; expected < 5; ++expected) {
+    BOOST_REQUIRE(ring.pop(value));
+    BOOST_REQUIRE_EQUAL(expected, value);
+  }
+  BOOST_REQUIRE(!ring.pop(value));
+}
+
+BOOST_AUTO_TEST_CASE(TestShmClientsAttach)
+{
+  std::string path = temp_path("shm_order_entry_attach", "/dev/shm");
+  BOOST_REQUIRE_THROW(impl::ShmOrderClient client(path), std::runtime_error);
+  impl::ShmOrderEntry entry(path, 2, 16, 16);
+  impl::ShmOrderClient client0(path);
+  impl::ShmOrderClient client1(path);
+  BOOST_REQUIRE_EQUAL(0, client0.client_id());
+  BOOST_REQUIRE_EQUAL(1, client1.client_id());
+  BOOST_REQUIRE_EQUAL(2, entry.client_count());
+  BOOST_REQUIRE_THROW(impl::ShmOrderClient client2(path), std::runtime_error);
+  BOOST_REQUIRE_EQUAL(2, entry.client_count());
+  BOOST_REQUIRE_THROW(entry.respond(2, ShmResponse()), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(TestShmClientsDetach)
+{
+  std::string path = temp_path("shm_order_entry_detach", "/dev/shm");
+  impl::ShmOrderEntry entry(path, 2, 16, 16);
+  impl::ShmOrderClient client0(path);
+  {
+    impl::ShmOrderClient client1(path);
+    BOOST_REQUIRE_EQUAL(1, client1.client_id());
+    ShmResponse response = ShmResponse();
+    response.client_order_id = 3;
+    BOOST_REQUIRE(entry.respond(1, response));
+  }
+  BOOST_REQUIRE_EQUAL(1, entry.client_count());
+
+  // The freed id is taken again, without the responses to its last client
+  impl::ShmOrderClient client2(path);
+  BOOST_REQUIRE_EQUAL(1, client2.client_id());
+  BOOST_REQUIRE_EQUAL(2, entry.client_count());
+  ShmResponse response;
+  BOOST_REQUIRE(!client2.poll(response));
+}
+
+BOOST_AUTO_TEST_CASE(TestShmClientsReclaim)
+{
+  std::string path = temp_path("shm_order_entry_reclaim", "/dev/shm");
+  impl::ShmOrderEntry entry(path, 1, 16, 16);
+
+  // A client process exits without detaching
+  pid_t child = fork();
+  BOOST_REQUIRE(child >= 0);
+  if (!child) {
+    new impl::ShmOrderClient(path);
+    _exit(0);
+  }
+  int status;
+  BOOST_REQUIRE_EQUAL(child, waitpid(child, &status, 0));
+  BOOST_REQUIRE_EQUAL(1, entry.client_count());
+  BOOST_REQUIRE_THROW(impl::ShmOrderClient client(path), std::runtime_error);
+
+  // Only its slot is freed
+  BOOST_REQUIRE_EQUAL(1, entry.reclaim());
+  BOOST_REQUIRE_EQUAL(0, entry.client_count());
+  impl::ShmOrderClient client(path);
+  BOOST_REQUIRE_EQUAL(0, client.client_id());
+  BOOST_REQUIRE_EQUAL(0, entry.reclaim());
+}
+
+BOOST_AUTO_TEST_CASE(TestShmOrderEntry)
+{
+  std::string path = temp_path("shm_order_entry_entry", "/dev/shm");
+  impl::ShmOrderEntry entry(path, 2, 16, 16);
+  impl::ShmOrderClient buyer(path);
+  impl::ShmOrderClient seller(path);
+  SimpleOrderBook order_book;
+
+  ShmCommand command = ShmCommand();
+  command.client_order_id = 7;
+  command.type = ShmCommand::sc_add;
+  command.is_buy = true;
+  command.price = 1250;
+  command.qty = 100;
+  BOOST_REQUIRE(buyer.submit(command));
+  command.client_order_id = 9;
+  command.is_buy = false;
+  command.price = 1251;
+  BOOST_REQUIRE(seller.submit(command));
+
+  // Matching process applies each command, and responds to its client
+  SimpleOrder* orders[2] = { NULL, NULL };
+  ShmCommand received;
+  for (int index = 0; index < 2; ++index) {
+    BOOST_REQUIRE(entry.poll(received));
+    BOOST_REQUIRE_EQUAL(ShmCommand::sc_add, received.type);
+    orders[index] = new SimpleOrder(received.is_buy != 0,
+                                    received.price,
+                                    received.qty);
+    order_book.add(orders[index], received.conditions);
+    order_book.perform_callbacks();
+    ShmResponse response = ShmResponse();
+    response.client_order_id = received.client_order_id;
+    response.type = orders[index]->state() == impl::os_accepted ?
+                    ShmResponse::sr_accept : ShmResponse::sr_reject;
+    BOOST_REQUIRE(entry.respond(received.client_id, response));
+  }
+  BOOST_REQUIRE(!entry.poll(received));
+  BOOST_REQUIRE(orders[0]->is_buy());
+  BOOST_REQUIRE_EQUAL(1250, orders[0]->price());
+
+  ShmResponse response;
+  BOOST_REQUIRE(buyer.poll(response));
+  BOOST_REQUIRE_EQUAL(7, response.client_order_id);
+  BOOST_REQUIRE_EQUAL(ShmResponse::sr_accept, response.type);
+  BOOST_REQUIRE(!buyer.poll(response));
+  BOOST_REQUIRE(seller.poll(response));
+  BOOST_REQUIRE_EQUAL(9, response.client_order_id);
+  BOOST_REQUIRE_EQUAL(ShmResponse::sr_accept, response.type);
+  BOOST_REQUIRE(!seller.poll(response));
+
+  delete orders[0];
+  delete orders[1];
+}
+
+} // namespace
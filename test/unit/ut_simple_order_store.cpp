@@ -0,0 +1,73 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_SimpleOrderStore
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+#include "impl/simple_order_store.h"
+
+namespace liquibook {
+
+using impl::SimpleOrder;
+using impl::SimpleOrderStore;
+
+BOOST_AUTO_TEST_CASE(TestCreateFromSlabs)
+{
+  SimpleOrderStore store(2);
+  BOOST_REQUIRE_EQUAL(0, store.capacity());
+  SimpleOrder* order0 = store.create(true, 1250, 100);
+  SimpleOrder* order1 = store.create(false, 1251, 200);
+  SimpleOrder* order2 = store.create(false, 0, 300);
+  BOOST_REQUIRE_EQUAL(3, store.size());
+  BOOST_REQUIRE_EQUAL(4, store.capacity());
+
+  // Orders of a slab are contiguous
+  BOOST_REQUIRE(order0 + 1 == order1);
+
+  // Ids are assigned by the store
+  BOOST_REQUIRE_EQUAL(1, order0->order_id_);
+  BOOST_REQUIRE_EQUAL(2, order1->order_id_);
+  BOOST_REQUIRE_EQUAL(3, order2->order_id_);
+  BOOST_REQUIRE_EQUAL(3, store.last_order_id());
+
+  BOOST_REQUIRE(order0->is_buy());
+  BOOST_REQUIRE_EQUAL(1250, order0->price());
+  BOOST_REQUIRE_EQUAL(100, order0->order_qty());
+  BOOST_REQUIRE_EQUAL(impl::os_new, order0->state());
+  BOOST_REQUIRE(!order2->is_buy());
+  BOOST_REQUIRE_EQUAL(0, order2->price());
+  BOOST_REQUIRE_EQUAL(300, order2->open_qty());
+}
+
+BOOST_AUTO_TEST_CASE(TestRecycle)
+{
+  SimpleOrderStore store(2);
+  SimpleOrderBook order_book;
+  SimpleOrder* bid = store.create(true, 1250, 100);
+  SimpleOrder* ask = store.create(false, 1250, 100);
+  BOOST_REQUIRE(add_and_verify(order_book, bid, false));
+  BOOST_REQUIRE(add_and_verify(order_book, ask, true, true));
+  BOOST_REQUIRE_EQUAL(impl::os_complete, bid->state());
+  BOOST_REQUIRE_EQUAL(impl::os_complete, ask->state());
+
+  // Completed orders are reused, without growing the slabs
+  store.recycle(bid);
+  store.recycle(ask);
+  BOOST_REQUIRE_EQUAL(0, store.size());
+  SimpleOrder* order = store.create(false, 1252, 200);
+  BOOST_REQUIRE(order == ask);
+  BOOST_REQUIRE_EQUAL(3, order->order_id_);
+  BOOST_REQUIRE_EQUAL(impl::os_new, order->state());
+  BOOST_REQUIRE_EQUAL(0, order->filled_qty());
+  BOOST_REQUIRE_EQUAL(200, order->open_qty());
+  BOOST_REQUIRE(store.create(true, 1249, 100) == bid);
+  BOOST_REQUIRE_EQUAL(2, store.capacity());
+}
+
+BOOST_AUTO_TEST_CASE(TestZeroSlabSize)
+{
+  BOOST_REQUIRE_THROW(SimpleOrderStore store(0), std::runtime_error);
+}
+
+} // namespace
@@ -0,0 +1,202 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_StandbyReplica
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+#include "impl/standby_replica.h"
+#include "impl/run_loop.h"
+#include "impl/simple_order_store.h"
+#include "book/book_manager.h"
+#include <stdlib.h>
+#include <thread>
+#include <unistd.h>
+
+namespace liquibook {
+
+using book::SymbolId;
+using impl::CommandJournal;
+using impl::JournalReader;
+using impl::JournalRecord;
+using impl::ReplicationPublisher;
+using impl::ReplicationSubscriber;
+using impl::RunLoop;
+using impl::SimpleOrder;
+
+typedef book::BookManager<SimpleOrder*, SimpleOrderBook> SimpleBookManager;
+
+// Apply random adds and cancels on the primary, passing each command to
+// the standby once applied
+template <class Publish>
+void run_primary(SimpleBookManager& books,
+                 Publish publish,
+                 std::vector<SimpleOrder*>& orders,
+                 uint32_t num_commands)
+{
+  srand(num_commands);
+  for (uint32_t index = 0; index < num_commands; ++index) {
+    SymbolId symbol_id = rand() % books.size();
+    SimpleOrderBook& book = books.book(symbol_id);
+    JournalRecord record;
+    if (index % 3 == 2 && !orders.empty()) {
+      SimpleOrder* order = orders[rand() % orders.size()];
+      books.cancel(symbol_id, order);
+      record = JournalRecord::cancel(book.trans_id(), symbol_id,
+                                     order->order_id_);
+    } else {
+      bool is_buy = rand() % 2 == 0;
+      Price price = 1250 + rand() % 10 - (is_buy ? 6 : 3);
+      Quantity qty = (rand() % 9 + 1) * 100;
+      orders.push_back(new SimpleOrder(is_buy, price, qty));
+      // Some orders are icebergs
+      OrderConditions conditions = 0;
+      if (index % 5 == 0) {
+        orders.back()->set_display_qty(100);
+        conditions = book::oc_iceberg;
+      }
+      books.add(symbol_id, orders.back(), conditions);
+      record = JournalRecord::add(book.trans_id(), symbol_id,
+                                  orders.back()->order_id_, is_buy, price,
+                                  orders.back()->order_qty(), conditions, 0,
+                                  orders.back()->display_qty());
+    }
+    books.perform_callbacks();
+    publish(record);
+  }
+}
+
+void verify_books(SimpleBookManager& expected, SimpleBookManager& standby)
+{
+  BOOST_REQUIRE_EQUAL(expected.size(), standby.size());
+  for (SymbolId symbol_id = 0; symbol_id < expected.size(); ++symbol_id) {
+    SimpleOrderBook& expected_book = expected.book(symbol_id);
+    SimpleOrderBook& standby_book = standby.book(symbol_id);
+    BOOST_REQUIRE_EQUAL(expected_book.trans_id(), standby_book.trans_id());
+    BOOST_REQUIRE_EQUAL(expected_book.bids().size(),
+                        standby_book.bids().size());
+    BOOST_REQUIRE_EQUAL(expected_book.asks().size(),
+                        standby_book.asks().size());
+    const book::DepthLevel* expected_level = expected_book.depth().bids();
+    const book::DepthLevel* standby_level = standby_book.depth().bids();
+    for ( ; expected_level != expected_book.depth().end();
+         ++expected_level, ++standby_level) {
+      BOOST_REQUIRE_EQUAL(expected_level->price(), standby_level->price());
+      BOOST_REQUIRE_EQUAL(expected_level->order_count(),
+                          standby_level->order_count());
+      BOOST_REQUIRE_EQUAL(expected_level->aggregate_qty(),
+                          standby_level->aggregate_qty());
+    }
+  }
+}
+
+void add_books(SimpleBookManager& books)
+{
+  books.add_book("AAPL");
+  books.add_book("MSFT");
+  books.add_book("IBM");
+}
+
+// Run the standby on its own thread while the primary publishes
+template <class Source, class Publish>
+void run_standby(Source& source, Publish publish, uint32_t num_commands)
+{
+  SimpleBookManager primary;
+  add_books(primary);
+  SimpleBookManager standby;
+  add_books(standby);
+  StoreFactory factory;
+  impl::StandbyReplica<SimpleOrder*, SimpleBookManager, StoreFactory, Source>
+      replica(standby, factory, source);
+  RunLoop loop(-1, RunLoop::im_backoff);
+  std::thread standby_thread(&RunLoop::run<
+      impl::StandbyReplica<SimpleOrder*, SimpleBookManager, StoreFactory,
+                           Source> >, &loop, std::ref(replica));
+
+  std::vector<SimpleOrder*> orders;
+  run_primary(primary, publish, orders, num_commands);
+  // The standby catches up, then fails over
+  while (replica.applied() < num_commands && !replica.diverged()) {
+    std::this_thread::yield();
+  }
+  loop.stop();
+  standby_thread.join();
+  BOOST_REQUIRE(!replica.diverged());
+  BOOST_REQUIRE_EQUAL(num_commands, replica.applied());
+  verify_books(primary, standby);
+
+  for (size_t index = 0; index < orders.size(); ++index) {
+    delete orders[index];
+  }
+}
+
+struct JournalPublish {
+  void operator()(const JournalRecord& record) { journal->append(record); }
+  CommandJournal* journal;
+};
+
+struct RingPublish {
+  void operator()(const JournalRecord& record) { publisher->publish(record); }
+  ReplicationPublisher* publisher;
+};
+
+BOOST_AUTO_TEST_CASE(TestStandbyFromJournal)
+{
+  std::string path = temp_path("standby_replica_journal", "/tmp");
+  const uint32_t num_commands = 20000;
+  {
+    CommandJournal journal(path, num_commands);
+    JournalReader reader(path);
+    JournalPublish publish = { &journal };
+    run_standby(reader, publish, num_commands);
+  }
+  ::unlink(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(TestStandbyFromSharedMemory)
+{
+  std::string path = temp_path("standby_replica_ring", "/dev/shm");
+  // A small ring, so the primary waits on the standby
+  ReplicationPublisher publisher(path, 64);
+  ReplicationSubscriber subscriber(path);
+  RingPublish publish = { &publisher };
+  run_standby(subscriber, publish, 20000);
+}
+
+BOOST_AUTO_TEST_CASE(TestStandbyDiverged)
+{
+  std::string path = temp_path("standby_replica_diverged", "/dev/shm");
+  ReplicationPublisher publisher(path, 16);
+  ReplicationSubscriber subscriber(path);
+  publisher.publish(JournalRecord::add(1, 0, 1, true, 1250, 100));
+  // Published as though the primary had applied a command not published
+  publisher.publish(JournalRecord::add(3, 0, 2, false, 1251, 100));
+  publisher.publish(JournalRecord::add(4, 0, 3, false, 1252, 100));
+
+  SimpleBookManager standby;
+  add_books(standby);
+  StoreFactory factory;
+  impl::StandbyReplica<SimpleOrder*, SimpleBookManager, StoreFactory,
+                       ReplicationSubscriber>
+      replica(standby, factory, subscriber);
+  BOOST_REQUIRE_EQUAL(1, replica.poll());
+  BOOST_REQUIRE(replica.diverged());
+  BOOST_REQUIRE(replica.divergence().find("transaction id mismatch") !=
+                std::string::npos);
+  // No longer applied
+  BOOST_REQUIRE_EQUAL(0, replica.poll());
+  BOOST_REQUIRE_EQUAL(1, replica.applied());
+}
+
+BOOST_AUTO_TEST_CASE(TestSubscriberNotInitialized)
+{
+  std::string path = temp_path("standby_replica_uninitialized", "/dev/shm");
+  {
+    impl::SharedMemory memory(path, 4096);
+  }
+  BOOST_REQUIRE_THROW(ReplicationSubscriber subscriber(path),
+                      std::runtime_error);
+  ::unlink(path.c_str());
+}
+
+} // namespace
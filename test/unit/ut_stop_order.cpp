@@ -0,0 +1,314 @@
+// Copyright (c) 2012, 2013 Object Computing, Inc.
+// All rights reserved.
+// See the file license.txt for licensing information.
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE liquibook_StopOrder
+#include <boost/test/unit_test.hpp>
+#include "ut_utils.h"
+
+namespace liquibook {
+
+using impl::SimpleOrder;
+typedef FillCheck<SimpleOrder*> SimpleFillCheck;
+
+OrderConditions STOP(oc_stop);
+OrderConditions STOP_IOC(oc_stop | oc_immediate_or_cancel);
+
+BOOST_AUTO_TEST_CASE(TestBuyStopLimit)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder ask0(false, 1251, 100);
+  SimpleOrder ask1(false, 1252, 100);
+  SimpleOrder ask2(false, 1253, 200);
+  SimpleOrder bid0(true,  1251, 100);
+  SimpleOrder bid1(true,  1252, 50);
+  SimpleOrder stop(true,  1253, 200);
+  stop.set_stop_price(1252);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &ask0, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask1, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask2, false));
+
+  // Held until triggered
+  BOOST_REQUIRE(add_and_verify(order_book, &stop, false, false, STOP));
+  BOOST_REQUIRE_EQUAL(0, order_book.bids().size());
+  BOOST_REQUIRE_EQUAL(1, order_book.buy_stops().size());
+  DepthCheck dc(order_book.depth());
+  BOOST_REQUIRE(dc.verify_bid(0, 0, 0));
+
+  // A trade below the stop price does not trigger
+  { BOOST_REQUIRE_NO_THROW(
+    SimpleFillCheck fc0(&bid0, 100, 125100);
+    SimpleFillCheck fc1(&ask0, 100, 125100);
+    SimpleFillCheck fc2(&stop, 0, 0);
+    BOOST_REQUIRE(add_and_verify(order_book, &bid0, true, true));
+  ); }
+  BOOST_REQUIRE_EQUAL(1251, order_book.market_price());
+  BOOST_REQUIRE_EQUAL(1, order_book.buy_stops().size());
+
+  // A trade at the stop price triggers, in the same transaction
+  { BOOST_REQUIRE_NO_THROW(
+    SimpleFillCheck fc0(&bid1, 50, 50 * 1252);
+    SimpleFillCheck fc1(&ask1, 100, 100 * 1252);
+    SimpleFillCheck fc2(&ask2, 150, 150 * 1253);
+    SimpleFillCheck fc3(&stop, 200, 50 * 1252 + 150 * 1253);
+    BOOST_REQUIRE(add_and_verify(order_book, &bid1, true, true));
+  ); }
+  BOOST_REQUIRE_EQUAL(6, order_book.trans_id());
+  BOOST_REQUIRE_EQUAL(1253, order_book.market_price());
+  BOOST_REQUIRE_EQUAL(0, order_book.buy_stops().size());
+  BOOST_REQUIRE_EQUAL(0, order_book.bids().size());
+  dc.reset();
+  BOOST_REQUIRE(dc.verify_ask(1253, 1, 50));
+}
+
+BOOST_AUTO_TEST_CASE(TestSellStopMarket)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder bid0(true,  1250, 100);
+  SimpleOrder bid1(true,  1249, 100);
+  SimpleOrder bid2(true,  1248, 100);
+  SimpleOrder ask0(false, 1250, 100);
+  SimpleOrder ask1(false, 1249, 50);
+  SimpleOrder stop(false, 0, 150);
+  stop.set_stop_price(1249);
+
+  // Not triggered before any trade
+  BOOST_REQUIRE(add_and_verify(order_book, &stop, false, false, STOP));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid0, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid1, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid2, false));
+  BOOST_REQUIRE_EQUAL(1, order_book.sell_stops().size());
+
+  // A trade above the stop price does not trigger
+  BOOST_REQUIRE(add_and_verify(order_book, &ask0, true, true));
+  BOOST_REQUIRE_EQUAL(1, order_book.sell_stops().size());
+
+  // A trade at the stop price triggers the market order
+  { BOOST_REQUIRE_NO_THROW(
+    SimpleFillCheck fc0(&ask1, 50, 50 * 1249);
+    SimpleFillCheck fc1(&bid1, 100, 100 * 1249);
+    SimpleFillCheck fc2(&bid2, 100, 100 * 1248);
+    SimpleFillCheck fc3(&stop, 150, 50 * 1249 + 100 * 1248);
+    BOOST_REQUIRE(add_and_verify(order_book, &ask1, true, true));
+  ); }
+  BOOST_REQUIRE_EQUAL(1248, order_book.market_price());
+  BOOST_REQUIRE_EQUAL(0, order_book.sell_stops().size());
+  BOOST_REQUIRE_EQUAL(0, order_book.bids().size());
+  BOOST_REQUIRE_EQUAL(0, order_book.asks().size());
+}
+
+BOOST_AUTO_TEST_CASE(TestStopCascade)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder bid0(true,  1250, 100);
+  SimpleOrder bid1(true,  1248, 100);
+  SimpleOrder bid2(true,  1246, 100);
+  SimpleOrder bid3(true,  1240, 500);
+  SimpleOrder ask0(false, 1250, 100);
+  SimpleOrder ask1(false, 1240, 100);
+  SimpleOrder stop0(false, 0, 100);
+  SimpleOrder stop1(false, 0, 100);
+  SimpleOrder stop2(false, 0, 100);
+  SimpleOrder stop3(true, 0, 100);
+  stop0.set_stop_price(1250);
+  stop1.set_stop_price(1248);
+  stop2.set_stop_price(1245);
+  stop3.set_stop_price(1260);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &bid0, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid1, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid2, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid3, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &stop2, false, false, STOP));
+  BOOST_REQUIRE(add_and_verify(order_book, &stop0, false, false, STOP));
+  BOOST_REQUIRE(add_and_verify(order_book, &stop3, false, false, STOP));
+  BOOST_REQUIRE(add_and_verify(order_book, &stop1, false, false, STOP));
+  // Sorted by trigger price
+  BOOST_REQUIRE_EQUAL(3, order_book.sell_stops().size());
+  BOOST_REQUIRE_EQUAL(1250, order_book.sell_stops().begin()->first);
+  BOOST_REQUIRE_EQUAL(1245, order_book.sell_stops().rbegin()->first);
+
+  // Each stop trades lower, triggering the next, until one is not reached
+  { BOOST_REQUIRE_NO_THROW(
+    SimpleFillCheck fc0(&ask0, 100, 100 * 1250);
+    SimpleFillCheck fc1(&stop0, 100, 100 * 1248);
+    SimpleFillCheck fc2(&stop1, 100, 100 * 1246);
+    SimpleFillCheck fc3(&stop2, 0, 0);
+    SimpleFillCheck fc4(&stop3, 0, 0);
+    SimpleFillCheck fc5(&bid3, 0, 0);
+    BOOST_REQUIRE(add_and_verify(order_book, &ask0, true, true));
+  ); }
+  BOOST_REQUIRE_EQUAL(9, order_book.trans_id());
+  BOOST_REQUIRE_EQUAL(1246, order_book.market_price());
+  BOOST_REQUIRE_EQUAL(1, order_book.sell_stops().size());
+  BOOST_REQUIRE_EQUAL(1, order_book.buy_stops().size());
+  BOOST_REQUIRE_EQUAL(1, order_book.bids().size());
+
+  // The last is triggered once the price falls to it
+  { BOOST_REQUIRE_NO_THROW(
+    SimpleFillCheck fc0(&ask1, 100, 100 * 1240);
+    SimpleFillCheck fc1(&stop2, 100, 100 * 1240);
+    SimpleFillCheck fc2(&bid3, 200, 200 * 1240);
+    BOOST_REQUIRE(add_and_verify(order_book, &ask1, true, true));
+  ); }
+  BOOST_REQUIRE_EQUAL(0, order_book.sell_stops().size());
+  DepthCheck dc(order_book.depth());
+  BOOST_REQUIRE(dc.verify_bid(1240, 1, 300));
+}
+
+BOOST_AUTO_TEST_CASE(TestStopTriggeredOnAdd)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder bid0(true,  1250, 100);
+  SimpleOrder ask0(false, 1250, 100);
+  SimpleOrder ask1(false, 1251, 100);
+  SimpleOrder bid1(true,  1247, 100);
+  SimpleOrder stop0(true, 1251, 100);
+  SimpleOrder stop1(false, 1248, 100);
+  stop0.set_stop_price(1249);
+  stop1.set_stop_price(1251);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &bid0, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask0, true, true));
+  BOOST_REQUIRE(add_and_verify(order_book, &ask1, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid1, false));
+
+  // Already through their stop prices, so added at once
+  BOOST_REQUIRE(add_and_verify(order_book, &stop0, true, true, STOP));
+  BOOST_REQUIRE_EQUAL(1251, order_book.market_price());
+  BOOST_REQUIRE(add_and_verify(order_book, &stop1, false, false, STOP));
+  BOOST_REQUIRE_EQUAL(0, order_book.buy_stops().size());
+  BOOST_REQUIRE_EQUAL(0, order_book.sell_stops().size());
+  DepthCheck dc(order_book.depth());
+  BOOST_REQUIRE(dc.verify_bid(1247, 1, 100));
+  BOOST_REQUIRE(dc.verify_ask(1248, 1, 100));
+}
+
+BOOST_AUTO_TEST_CASE(TestStopImmediateOrCancel)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder bid0(true,  1250, 100);
+  SimpleOrder ask0(false, 1250, 100);
+  SimpleOrder ask1(false, 1251, 100);
+  SimpleOrder stop(true, 1251, 300);
+  stop.set_stop_price(1250);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &ask1, false));
+  // Not cancelled while held
+  BOOST_REQUIRE(!order_book.add(&stop, STOP_IOC));
+  order_book.perform_callbacks();
+  BOOST_REQUIRE_EQUAL(impl::os_accepted, stop.state());
+  BOOST_REQUIRE(add_and_verify(order_book, &bid0, false));
+
+  // Triggered, the rest of the order is cancelled
+  { BOOST_REQUIRE_NO_THROW(
+    SimpleFillCheck fc0(&stop, 100, 100 * 1251, STOP_IOC);
+    BOOST_REQUIRE(add_and_verify(order_book, &ask0, true, true));
+  ); }
+  BOOST_REQUIRE_EQUAL(impl::os_cancelled, stop.state());
+  BOOST_REQUIRE_EQUAL(0, order_book.bids().size());
+  BOOST_REQUIRE_EQUAL(0, order_book.asks().size());
+}
+
+BOOST_AUTO_TEST_CASE(TestCancelStop)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder stop0(true, 1251, 100);
+  SimpleOrder stop1(true, 1252, 100);
+  SimpleOrder stop2(false, 1240, 100);
+  SimpleOrder bid0(true,  1250, 100);
+  SimpleOrder ask0(false, 1250, 100);
+  stop0.set_stop_price(1260);
+  stop1.set_stop_price(1260);
+  stop2.set_stop_price(1240);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &stop0, false, false, STOP));
+  BOOST_REQUIRE(add_and_verify(order_book, &stop1, false, false, STOP));
+  BOOST_REQUIRE(add_and_verify(order_book, &stop2, false, false, STOP));
+  BOOST_REQUIRE(cancel_and_verify(order_book, &stop1, impl::os_cancelled));
+  BOOST_REQUIRE(cancel_and_verify(order_book, &stop2, impl::os_cancelled));
+  BOOST_REQUIRE_EQUAL(1, order_book.buy_stops().size());
+  BOOST_REQUIRE_EQUAL(&stop0, order_book.buy_stops().begin()->second.ptr());
+  BOOST_REQUIRE_EQUAL(0, order_book.sell_stops().size());
+  // Not found once cancelled
+  BOOST_REQUIRE(cancel_and_verify(order_book, &stop1, impl::os_cancelled));
+  BOOST_REQUIRE_EQUAL(1, order_book.buy_stops().size());
+
+  // A cancelled stop is not triggered
+  { BOOST_REQUIRE_NO_THROW(
+    SimpleFillCheck fc0(&stop0, 0, 0);
+    BOOST_REQUIRE(add_and_verify(order_book, &bid0, false));
+    BOOST_REQUIRE(add_and_verify(order_book, &ask0, true, true));
+  ); }
+  BOOST_REQUIRE_EQUAL(0, stop1.filled_qty());
+}
+
+BOOST_AUTO_TEST_CASE(TestCancelStopAtBidPrice)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder bid0(true,  1252, 100);
+  SimpleOrder bid1(true,  1251, 100);
+  SimpleOrder stop(true,  1252, 100);
+  stop.set_stop_price(1260);
+
+  BOOST_REQUIRE(add_and_verify(order_book, &bid0, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &bid1, false));
+  BOOST_REQUIRE(add_and_verify(order_book, &stop, false, false, STOP));
+  // The bids of and below the stop's limit price are not taken for it
+  BOOST_REQUIRE(cancel_and_verify(order_book, &stop, impl::os_cancelled));
+  BOOST_REQUIRE_EQUAL(0, order_book.buy_stops().size());
+  BOOST_REQUIRE_EQUAL(2, order_book.bids().size());
+  DepthCheck dc(order_book.depth());
+  BOOST_REQUIRE(dc.verify_bid(1252, 1, 100));
+  BOOST_REQUIRE(dc.verify_bid(1251, 1, 100));
+}
+
+// Book noting the callbacks it performs
+class CallbackTypesBook : public SimpleOrderBook {
+public:
+  virtual void perform_callback(TypedCallback& cb)
+  {
+    types.push_back(cb.type);
+    SimpleOrderBook::perform_callback(cb);
+  }
+  std::vector<int> types;
+};
+
+BOOST_AUTO_TEST_CASE(TestReplaceStopRejected)
+{
+  CallbackTypesBook order_book;
+  SimpleOrder buy_stop(true, 1251, 100);
+  SimpleOrder sell_stop(false, 1240, 100);
+  buy_stop.set_stop_price(1260);
+  sell_stop.set_stop_price(1240);
+  BOOST_REQUIRE(add_and_verify(order_book, &buy_stop, false, false, STOP));
+  BOOST_REQUIRE(add_and_verify(order_book, &sell_stop, false, false, STOP));
+
+  // A waiting stop can be cancelled, but not replaced, on either side
+  order_book.types.clear();
+  order_book.replace(&buy_stop, 0, 1252);
+  order_book.replace(&sell_stop, 0, 1239);
+  order_book.perform_callbacks();
+  BOOST_REQUIRE_EQUAL(2, order_book.types.size());
+  BOOST_REQUIRE_EQUAL(SimpleOrderBook::TypedCallback::cb_order_replace_reject,
+                      order_book.types[0]);
+  BOOST_REQUIRE_EQUAL(SimpleOrderBook::TypedCallback::cb_order_replace_reject,
+                      order_book.types[1]);
+  BOOST_REQUIRE_EQUAL(1251, buy_stop.price());
+  BOOST_REQUIRE_EQUAL(1, order_book.buy_stops().size());
+  BOOST_REQUIRE_EQUAL(1, order_book.sell_stops().size());
+}
+
+BOOST_AUTO_TEST_CASE(TestStopPriceRequired)
+{
+  SimpleOrderBook order_book;
+  SimpleOrder stop(true, 1251, 100);
+  order_book.add(&stop, STOP);
+  order_book.perform_callbacks();
+  // Rejected, so never accepted
+  BOOST_REQUIRE_EQUAL(impl::os_new, stop.state());
+  BOOST_REQUIRE_EQUAL(0, order_book.buy_stops().size());
+}
+
+} // namespace
@@ -7,6 +7,10 @@
 #include "book/order_book.h"
 #include "impl/simple_order_book.h"
 #include "impl/simple_order.h"
+#include "impl/simple_order_store.h"
+#include <sstream>
+#include <string>
+#include <unistd.h>
 
 namespace liquibook {
 
@@ -206,6 +210,35 @@ private:
   const DepthLevel* next_ask_;
 };
 
+// Factory of the orders of journaled or replicated adds, from a store
+struct StoreFactory {
+  template <class Record>
+  impl::SimpleOrder* operator()(const Record& add)
+  {
+    impl::SimpleOrder* order = store.create(add.is_buy != 0, add.price,
+                                            add.qty);
+    order->set_stop_price(add.stop_price);
+    order->set_display_qty(add.display_qty);
+    return order;
+  }
+  impl::SimpleOrderStore store;
+};
+
+// Ids of orders, as logged or checkpointed
+struct SimpleOrderIds {
+  uint32_t operator()(impl::SimpleOrder* order) { return order->order_id_; }
+};
+
+// Path of a file of a test, unique to the test process, removed if left by
+// an earlier run
+inline std::string temp_path(const char* name, const char* dir = "/tmp")
+{
+  std::ostringstream path;
+  path << dir << "/ut_" << name << "_" << getpid();
+  ::unlink(path.str().c_str());
+  return path.str();
+}
+
 } // namespace
 
 #endif